@@ -0,0 +1,607 @@
+// Load generator for ircserv. Opens many client connections, registers
+// them (PASS/NICK/USER) and drives one scenario for a fixed time, then
+// prints the results as JSON on stdout:
+//
+//   ./ircbench --port=6667 --password=pw --clients=1000 --scenario=fanout
+//
+// Scenarios:
+//   fanout   - clients spread over --channels channels; senders PRIVMSG their channel
+//   dm       - senders PRIVMSG random other clients
+//   joinpart - every client JOINs and PARTs a channel in a loop
+//   connect  - every slot connects, registers, QUITs and reconnects
+//
+// "accepts_per_s" is the headline connection-handling figure: registrations
+// per second over the run for connect, during setup for the others.
+//
+// Messages carry their send time ("t=<us>"), so delivery latency is
+// measured on receipt. Run the server with --flood-rate=0, otherwise flood
+// control throttles the simulated clients.
+
+#include "Poller.hpp"
+#include "Clock.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// How long to wait for registration/joins, and for in-flight messages
+// once the run is over
+static const long SETUP_TIMEOUT_US = 30000000;
+static const long DRAIN_TIMEOUT_US = 2000000;
+
+// --- Options ---
+struct BenchConfig {
+    std::string host;
+    int port;
+    std::string password;
+    int clients;
+    std::string scenario;
+    int duration;   // Seconds
+    long rate;      // Messages (or operations) per second in total; 0 = as fast as possible
+    int channels;
+    int senders;    // 0 = scenario default
+    int payload;    // Bytes of filler per message
+    int pid;        // Server pid for RSS, 0 = don't report
+    int window;     // Connections allowed to be connecting/registering at once; keep below the server's --backlog
+    std::string backend;
+
+    BenchConfig();
+    void parse(int argc, char** argv);
+};
+
+BenchConfig::BenchConfig()
+    : host("127.0.0.1"), port(6667), password(""), clients(100), scenario("fanout"),
+      duration(10), rate(0), channels(1), senders(0), payload(64), pid(0), window(256),
+#ifdef __linux__
+      backend("epoll") {}
+#else
+      backend("poll") {}
+#endif
+
+static long parseNumber(const std::string& name, const std::string& value, long min, long max) {
+    char* end;
+    errno = 0;
+    long number = std::strtol(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || errno == ERANGE || number < min || number > max)
+        throw std::runtime_error("Invalid value for --" + name + ": " + value);
+    return number;
+}
+
+void BenchConfig::parse(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        std::string option(argv[i]);
+        size_t eq = option.find('=');
+        if (option.compare(0, 2, "--") != 0 || eq == std::string::npos)
+            throw std::runtime_error("Invalid option: " + option);
+
+        std::string name = option.substr(2, eq - 2);
+        std::string value = option.substr(eq + 1);
+
+        if (name == "host") host = value;
+        else if (name == "port") port = parseNumber(name, value, 1, 65535);
+        else if (name == "password") password = value;
+        else if (name == "clients") clients = parseNumber(name, value, 1, 1000000);
+        else if (name == "scenario") scenario = value;
+        else if (name == "duration") duration = parseNumber(name, value, 1, 86400);
+        else if (name == "rate") rate = parseNumber(name, value, 0, 100000000);
+        else if (name == "channels") channels = parseNumber(name, value, 1, 100000);
+        else if (name == "senders") senders = parseNumber(name, value, 0, 1000000);
+        else if (name == "payload") payload = parseNumber(name, value, 0, 400);
+        else if (name == "pid") pid = parseNumber(name, value, 0, 1L << 30);
+        else if (name == "backend") backend = value;
+        else if (name == "window") window = parseNumber(name, value, 1, 100000);
+        else throw std::runtime_error("Unknown option: --" + name);
+    }
+    if (scenario != "fanout" && scenario != "dm" && scenario != "joinpart" && scenario != "connect")
+        throw std::runtime_error("Unknown scenario: " + scenario);
+}
+
+// --- Server RSS ---
+struct MemoryUsage {
+    long rssKb;
+    long peakKb;
+};
+
+static MemoryUsage readMemory(int pid) {
+    MemoryUsage usage = { -1, -1 };
+    if (pid <= 0) return usage;
+    std::ostringstream path;
+    path << "/proc/" << pid << "/status";
+    std::ifstream status(path.str().c_str());
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) usage.rssKb = std::atol(line.c_str() + 6);
+        else if (line.compare(0, 6, "VmHWM:") == 0) usage.peakKb = std::atol(line.c_str() + 6);
+    }
+    return usage;
+}
+
+// --- Connections ---
+enum ConnState {
+    CONN_CONNECTING,
+    CONN_REGISTERING,
+    CONN_READY,
+    CONN_CLOSED
+};
+
+struct Connection {
+    int index;
+    int fd;
+    ConnState state;
+    std::string nick;
+    std::string input;
+    std::string output;  // Unsent tail; nothing new is generated while non-empty
+    long startedUs;      // Connect, JOIN or PART time, for churn latency
+    int channel;
+    bool inChannel;
+    bool pending;        // JOIN/PART sent, echo not seen yet
+};
+
+class LoadGenerator {
+public:
+    explicit LoadGenerator(const BenchConfig& config);
+    ~LoadGenerator();
+
+    void run();
+    void report(std::ostream& out) const;
+
+private:
+    BenchConfig _config;
+    Poller* _poller;
+    std::vector<Connection> _conns;
+    std::map<int, Connection*> _byFd;
+    std::vector<int> _channelSize;
+    unsigned long _nickSerial;
+    bool _measuring;
+    std::string _filler;
+    int _inFlight; // Connections not registered yet
+
+    // Results
+    unsigned long _sent;
+    unsigned long _received;
+    unsigned long _expected;   // Deliveries the sent messages should produce
+    unsigned long _ops;
+    unsigned long _errors;
+    unsigned long _disconnects;
+    std::vector<unsigned int> _latencies;
+    long _startUs;
+    long _elapsedUs;
+    long _setupUs;  // Connecting and registering every client, before the run
+    int _connected;
+    MemoryUsage _memBefore;
+    MemoryUsage _memAfter;
+
+    void openConnection(Connection& conn);
+    void closeConnection(Connection& conn);
+    void sendLine(Connection& conn, const std::string& line);
+    void flush(Connection& conn);
+    void pump(int timeoutMs);
+    void handleReadable(Connection& conn);
+    void handleLine(Connection& conn, const std::string& line);
+    void recordLatency(long sentUs);
+
+    int countState(ConnState state) const;
+    int countInChannel() const;
+    void setup();
+    void tick(long budget);
+    long budget() const;
+    std::string stamp() const;
+    std::string channelName(int channel) const;
+
+    LoadGenerator(const LoadGenerator&);
+    LoadGenerator& operator=(const LoadGenerator&);
+};
+
+LoadGenerator::LoadGenerator(const BenchConfig& config)
+    : _config(config), _poller(Poller::create(config.backend)), _conns(config.clients),
+      _channelSize(config.channels, 0), _nickSerial(0), _measuring(false), _filler(config.payload, 'x'), _inFlight(0),
+      _sent(0), _received(0), _expected(0), _ops(0), _errors(0), _disconnects(0),
+      _startUs(0), _elapsedUs(0), _setupUs(0), _connected(0) {
+    for (size_t i = 0; i < _conns.size(); ++i) {
+        _conns[i].index = i;
+        _conns[i].fd = -1;
+        _conns[i].state = CONN_CLOSED;
+        _conns[i].channel = i % config.channels;
+        _conns[i].inChannel = false;
+        _conns[i].pending = false;
+    }
+}
+
+LoadGenerator::~LoadGenerator() {
+    for (size_t i = 0; i < _conns.size(); ++i) {
+        if (_conns[i].fd >= 0) close(_conns[i].fd);
+    }
+    delete _poller;
+}
+
+void LoadGenerator::openConnection(Connection& conn) {
+    std::ostringstream nick;
+    nick << "b" << _nickSerial++;
+    conn.nick = nick.str();
+    conn.input.clear();
+    conn.output.clear();
+    conn.inChannel = false;
+    conn.pending = false;
+    conn.startedUs = monotonicUs();
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(_config.port);
+    if (inet_pton(AF_INET, _config.host.c_str(), &addr.sin_addr) != 1)
+        throw std::runtime_error("Invalid --host (IPv4 address expected): " + _config.host);
+
+    conn.fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (conn.fd < 0) throw std::runtime_error("socket() failed; raise the open file limit");
+    fcntl(conn.fd, F_SETFL, O_NONBLOCK);
+    int one = 1;
+    setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    conn.state = CONN_CONNECTING;
+    ++_inFlight;
+    _byFd[conn.fd] = &conn;
+    if (connect(conn.fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+        ++_errors;
+        closeConnection(conn);
+        return;
+    }
+    _poller->add(conn.fd, POLLER_READ | POLLER_WRITE);
+}
+
+void LoadGenerator::closeConnection(Connection& conn) {
+    if (conn.fd < 0) return;
+    if (conn.inChannel) --_channelSize[conn.channel];
+    if (conn.state == CONN_CONNECTING || conn.state == CONN_REGISTERING) --_inFlight;
+    _poller->remove(conn.fd);
+    _byFd.erase(conn.fd);
+    close(conn.fd);
+    conn.fd = -1;
+    conn.state = CONN_CLOSED;
+    conn.inChannel = false;
+}
+
+void LoadGenerator::sendLine(Connection& conn, const std::string& line) {
+    conn.output += line;
+    conn.output += "\r\n";
+    if (conn.state != CONN_CONNECTING) flush(conn);
+}
+
+void LoadGenerator::flush(Connection& conn) {
+    while (!conn.output.empty()) {
+        ssize_t n = send(conn.fd, conn.output.data(), conn.output.length(), 0);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            ++_disconnects;
+            closeConnection(conn);
+            return;
+        }
+        conn.output.erase(0, n);
+    }
+    _poller->modify(conn.fd, conn.output.empty() ? POLLER_READ : (POLLER_READ | POLLER_WRITE));
+}
+
+void LoadGenerator::pump(int timeoutMs) {
+    std::vector<PollerEvent> ready;
+    _poller->wait(ready, timeoutMs);
+    for (size_t i = 0; i < ready.size(); ++i) {
+        std::map<int, Connection*>::iterator it = _byFd.find(ready[i].fd);
+        if (it == _byFd.end()) continue;
+        Connection& conn = *it->second;
+
+        if (conn.state == CONN_CONNECTING) {
+            int error = 0;
+            socklen_t len = sizeof(error);
+            getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &error, &len);
+            if (error != 0) {
+                ++_errors;
+                closeConnection(conn);
+                continue;
+            }
+            conn.state = CONN_REGISTERING;
+            if (!_config.password.empty()) sendLine(conn, "PASS " + _config.password);
+            sendLine(conn, "NICK " + conn.nick);
+            sendLine(conn, "USER bench 0 * :ircbench");
+            continue;
+        }
+        if (ready[i].events & POLLER_WRITE) flush(conn);
+        if (conn.fd >= 0 && (ready[i].events & (POLLER_READ | POLLER_ERROR))) handleReadable(conn);
+    }
+}
+
+void LoadGenerator::handleReadable(Connection& conn) {
+    char buffer[16384];
+    while (true) {
+        ssize_t n = recv(conn.fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) {
+            ++_disconnects;
+            closeConnection(conn);
+            return;
+        }
+        conn.input.append(buffer, n);
+        if (!_poller->isEdgeTriggered()) break;
+    }
+
+    size_t start = 0;
+    size_t newline;
+    while ((newline = conn.input.find('\n', start)) != std::string::npos) {
+        size_t end = (newline > start && conn.input[newline - 1] == '\r') ? newline - 1 : newline;
+        handleLine(conn, conn.input.substr(start, end - start));
+        start = newline + 1;
+        if (conn.fd < 0) return;
+    }
+    conn.input.erase(0, start);
+}
+
+void LoadGenerator::recordLatency(long sentUs) {
+    if (!_measuring) return;
+    long latency = monotonicUs() - sentUs;
+    _latencies.push_back(latency < 0 ? 0 : static_cast<unsigned int>(latency));
+}
+
+void LoadGenerator::handleLine(Connection& conn, const std::string& line) {
+    // ":prefix COMMAND args" -> the command or numeric
+    size_t space = line.find(' ');
+    if (line.compare(0, 5, "ERROR") == 0) {
+        ++_errors;
+        return;
+    }
+    if (line.empty() || line[0] != ':' || space == std::string::npos) return;
+    std::string command = line.substr(space + 1, line.find(' ', space + 1) - space - 1);
+
+    if (command == "PRIVMSG") {
+        size_t t = line.find(" :t=");
+        if (t != std::string::npos) {
+            ++_received;
+            recordLatency(std::atol(line.c_str() + t + 4));
+        }
+        return;
+    }
+    if (command == "001") {
+        conn.state = CONN_READY;
+        --_inFlight;
+        if (_config.scenario == "connect" && _measuring) {
+            ++_ops;
+            recordLatency(conn.startedUs);
+            sendLine(conn, "QUIT :bench");
+            closeConnection(conn);
+        }
+        return;
+    }
+    if (command.length() == 3 && (command[0] == '4' || command[0] == '5')) {
+        ++_errors;
+        return;
+    }
+
+    bool own = line.length() > conn.nick.length() + 1 && line.compare(1, conn.nick.length(), conn.nick) == 0
+               && line[conn.nick.length() + 1] == '!';
+    if (!own) return;
+    if (command == "JOIN" || command == "PART") {
+        conn.inChannel = (command == "JOIN");
+        _channelSize[conn.channel] += conn.inChannel ? 1 : -1;
+        if (conn.pending && _measuring) {
+            ++_ops;
+            recordLatency(conn.startedUs);
+        }
+        conn.pending = false;
+    }
+}
+
+int LoadGenerator::countState(ConnState state) const {
+    int count = 0;
+    for (size_t i = 0; i < _conns.size(); ++i) {
+        if (_conns[i].state == state) ++count;
+    }
+    return count;
+}
+
+int LoadGenerator::countInChannel() const {
+    int count = 0;
+    for (size_t i = 0; i < _conns.size(); ++i) {
+        if (_conns[i].inChannel) ++count;
+    }
+    return count;
+}
+
+std::string LoadGenerator::channelName(int channel) const {
+    std::ostringstream name;
+    name << "#bench" << channel;
+    return name.str();
+}
+
+std::string LoadGenerator::stamp() const {
+    std::ostringstream text;
+    text << "t=" << monotonicUs() << " " << _filler;
+    return text.str();
+}
+
+// Connects and registers every client; fanout also joins the channels.
+// The connect scenario starts from nothing: connecting is what it measures.
+void LoadGenerator::setup() {
+    if (_config.scenario == "connect") return;
+    // A burst of connects beyond the server's listen backlog stalls in SYN
+    // retries, so only --window of them are in flight at a time
+    long started = monotonicUs();
+    long deadline = started + SETUP_TIMEOUT_US;
+    size_t next = 0;
+    while ((next < _conns.size() || _inFlight > 0) && monotonicUs() < deadline) {
+        while (next < _conns.size() && _inFlight < _config.window) {
+            openConnection(_conns[next++]);
+        }
+        pump(10);
+    }
+    _setupUs = monotonicUs() - started;
+    _connected = countState(CONN_READY);
+    std::cerr << "ircbench: " << _connected << "/" << _conns.size() << " clients registered" << std::endl;
+
+    if (_config.scenario == "fanout") {
+        for (size_t i = 0; i < _conns.size(); ++i) {
+            if (_conns[i].state == CONN_READY) sendLine(_conns[i], "JOIN " + channelName(_conns[i].channel));
+        }
+        while (countInChannel() < countState(CONN_READY) && monotonicUs() < deadline) {
+            pump(10);
+        }
+    }
+}
+
+// Operations still allowed by --rate at this point of the run
+long LoadGenerator::budget() const {
+    if (_config.rate == 0) return -1;
+    long elapsed = monotonicUs() - _startUs;
+    long allowed = static_cast<long>(static_cast<double>(_config.rate) * elapsed / 1000000.0);
+    unsigned long done = (_config.scenario == "fanout" || _config.scenario == "dm") ? _sent : _ops;
+    return allowed > (long)done ? allowed - (long)done : 0;
+}
+
+// One round over the senders; budget < 0 means unlimited. Connections with
+// unsent output are skipped, so a slow server pushes back on the generator.
+void LoadGenerator::tick(long budget) {
+    const std::string& scenario = _config.scenario;
+    size_t senders = _config.senders > 0 ? std::min<size_t>(_config.senders, _conns.size())
+                   : (scenario == "fanout" ? std::min<size_t>(_config.channels, _conns.size()) : _conns.size());
+
+    for (size_t i = 0; i < senders && budget != 0; ++i) {
+        Connection& conn = _conns[i];
+
+        if (scenario == "connect") {
+            if (conn.state == CONN_CLOSED && _inFlight < _config.window) {
+                openConnection(conn);
+                if (budget > 0) --budget;
+            }
+            continue;
+        }
+        if (conn.state != CONN_READY || !conn.output.empty()) continue;
+
+        if (scenario == "fanout") {
+            sendLine(conn, "PRIVMSG " + channelName(conn.channel) + " :" + stamp());
+            ++_sent;
+            _expected += _channelSize[conn.channel] - (conn.inChannel ? 1 : 0);
+        } else if (scenario == "dm") {
+            Connection& target = _conns[std::rand() % _conns.size()];
+            if (&target == &conn || target.state != CONN_READY) continue;
+            sendLine(conn, "PRIVMSG " + target.nick + " :" + stamp());
+            ++_sent;
+            ++_expected;
+        } else if (scenario == "joinpart") {
+            if (conn.pending) continue;
+            conn.pending = true;
+            conn.startedUs = monotonicUs();
+            sendLine(conn, (conn.inChannel ? "PART " : "JOIN ") + channelName(conn.channel));
+        }
+        if (budget > 0) --budget;
+    }
+}
+
+void LoadGenerator::run() {
+    _memBefore = readMemory(_config.pid);
+    setup();
+
+    _measuring = true;
+    _startUs = monotonicUs();
+    long endUs = _startUs + _config.duration * 1000000L;
+    while (monotonicUs() < endUs) {
+        tick(budget());
+        pump(_config.rate == 0 ? 0 : 1);
+    }
+    _elapsedUs = monotonicUs() - _startUs;
+
+    // Let in-flight messages arrive before reading the counters
+    long deadline = monotonicUs() + DRAIN_TIMEOUT_US;
+    while (_received < _expected && monotonicUs() < deadline) {
+        pump(10);
+    }
+    _measuring = false;
+    _memAfter = readMemory(_config.pid);
+}
+
+// --- Report ---
+static unsigned int percentile(const std::vector<unsigned int>& sorted, double q) {
+    if (sorted.empty()) return 0;
+    size_t rank = static_cast<size_t>(q * (sorted.size() - 1) + 0.5);
+    return sorted[rank];
+}
+
+static void writeMemory(std::ostream& out, const MemoryUsage& usage) {
+    if (usage.rssKb < 0) out << "null";
+    else out << "{\"rss_kb\": " << usage.rssKb << ", \"peak_kb\": " << usage.peakKb << "}";
+}
+
+void LoadGenerator::report(std::ostream& out) const {
+    std::vector<unsigned int> sorted(_latencies);
+    std::sort(sorted.begin(), sorted.end());
+    double seconds = _elapsedUs / 1000000.0;
+    // Registrations completed per second: over the run for the connect
+    // scenario, otherwise while the clients were being set up
+    double accepts = _config.scenario == "connect" ? _ops / seconds
+                   : (_setupUs > 0 ? _connected / (_setupUs / 1000000.0) : 0);
+
+    out << "{\n"
+        << "  \"scenario\": \"" << _config.scenario << "\",\n"
+        << "  \"accepts_per_s\": " << accepts << ",\n"
+        << "  \"clients\": " << _config.clients << ",\n"
+        << "  \"registered\": " << _connected << ",\n"
+        << "  \"channels\": " << _config.channels << ",\n"
+        << "  \"rate\": " << _config.rate << ",\n"
+        << "  \"payload_bytes\": " << _config.payload << ",\n"
+        << "  \"duration_s\": " << seconds << ",\n"
+        << "  \"sent\": " << _sent << ",\n"
+        << "  \"expected\": " << _expected << ",\n"
+        << "  \"received\": " << _received << ",\n"
+        << "  \"ops\": " << _ops << ",\n"
+        << "  \"errors\": " << _errors << ",\n"
+        << "  \"disconnects\": " << _disconnects << ",\n"
+        << "  \"throughput_per_s\": {\"sent\": " << _sent / seconds << ", \"received\": " << _received / seconds
+        << ", \"ops\": " << _ops / seconds << "},\n"
+        << "  \"latency_us\": {\"samples\": " << sorted.size() << ", \"p50\": " << percentile(sorted, 0.5)
+        << ", \"p99\": " << percentile(sorted, 0.99) << ", \"p999\": " << percentile(sorted, 0.999)
+        << ", \"max\": " << (sorted.empty() ? 0 : sorted.back()) << "},\n"
+        << "  \"server_memory_before\": ";
+    writeMemory(out, _memBefore);
+    out << ",\n  \"server_memory_after\": ";
+    writeMemory(out, _memAfter);
+    out << "\n}\n";
+}
+
+// Thousands of sockets need more than the usual 1024 descriptors
+static void raiseFileLimit() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+int main(int argc, char** argv) {
+    signal(SIGPIPE, SIG_IGN);
+    try {
+        BenchConfig config;
+        config.parse(argc, argv);
+        raiseFileLimit();
+
+        LoadGenerator generator(config);
+        generator.run();
+        generator.report(std::cout);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        std::cerr << "Usage: " << argv[0] << " [--port=N] [--password=PW] [--clients=N] "
+                  << "[--scenario=fanout|dm|joinpart|connect] [--duration=S] [--rate=N] [--channels=N] "
+                  << "[--senders=N] [--payload=BYTES] [--pid=SERVER_PID] [--host=IPV4] [--backend=NAME] [--window=N]" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,522 @@
+// Microbenchmarks for the server's hot paths. Links the server objects and
+// drives them in-process, without sockets, then prints one line per case:
+//
+//   ./ircmicrobench [--filter=SUBSTRING] [--min-ms=N]
+//
+// Each case runs with a growing iteration count until one run takes at
+// least --min-ms, and reports that run's ns/op and heap allocations/op
+// (counted by replacing the global operator new).
+//
+// Cases:
+//   parse_mix              parseMessage + lookupCommand on a realistic mix
+//   command_mix            Server::onLine (parse, dispatch, replies) on the same mix
+//   find_nick/N            findClientByNick among N users, case-folded hits
+//   channel_add_remove/N   addClient + removeClient on a channel of N members
+//   channel_contains/N     isClientInChannel, members and non-members alternating
+//   channel_members/N      walking getMembers() once
+//   privmsg_broadcast/N    cmdPrivmsg's line construction + broadcast to N members
+//   names/N                NAMES on a channel of N members, through onLine
+//   join_names/N           a JOIN into a channel of N members, then its PART
+//
+// Output goes to a discarded outbound batch, as on the core thread with
+// --threads > 1; writing to sockets is left to the load generator.
+
+#include "Server.hpp"
+#include "Clock.hpp"
+#include "Logger.hpp"
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <new>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+
+// --- Allocation Counting ---
+// The benchmark is single-threaded, so a plain counter is enough.
+static unsigned long allocations = 0;
+
+void* operator new(size_t size) throw(std::bad_alloc) {
+    ++allocations;
+    void* p = std::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) throw() {
+    std::free(p);
+}
+
+// Keeps results alive so the compiler cannot drop the measured work
+static volatile size_t sink = 0;
+
+// --- Fixture ---
+// A Server in threaded mode with one idle reactor. Clients are registered
+// by hand; their output piles up in the reactor's outbound batch, which
+// discardOutput() empties without giving the capacity back.
+class MicroBench {
+public:
+    MicroBench();
+    ~MicroBench();
+
+    Client* addUser(const std::string& nick);
+    Channel* addChannel(const std::string& name, const std::vector<Client*>& members);
+
+    void line(Client* client, const std::string& text);
+    Client* findNick(const std::string& nick);
+    void privmsg(Client* sender, Channel* channel, const std::string& text);
+    void discardOutput();
+
+private:
+    Server* _server;
+    std::vector<Client*> _users;
+    std::vector<char> _scratch;
+
+    MicroBench(const MicroBench&);
+    MicroBench& operator=(const MicroBench&);
+};
+
+MicroBench::MicroBench() : _server(NULL) {
+    ServerConfig config;
+    config.backend = "poll";
+    config.threads = 2;
+    config.floodRate = 0;
+    _server = new Server(0, "pw", config);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) throw std::runtime_error("socket() failed");
+    _server->_reactors.push_back(new Reactor(*_server, 0, fd, config));
+    _server->_outbound.resize(1, NULL);
+}
+
+// Channels detach from their members on delete, so users go last
+MicroBench::~MicroBench() {
+    delete _server;
+    for (size_t i = 0; i < _users.size(); ++i) {
+        delete _users[i];
+    }
+}
+
+Client* MicroBench::addUser(const std::string& nick) {
+    int fd = 1000000 + static_cast<int>(_users.size()); // Never used for I/O
+    Client* client = new Client(fd, "127.0.0.1", _server->_reactors[0]);
+    client->setAuthenticated(true);
+    client->setNickname(nick);
+    client->setUsername(nick);
+    client->setRegistrationState(REGISTERED);
+    _users.push_back(client);
+    _server->_clients[fd] = client;
+    _server->_nickIndex.insert(nick, client);
+    ++_server->_registered;
+    return client;
+}
+
+Channel* MicroBench::addChannel(const std::string& name, const std::vector<Client*>& members) {
+    Channel* channel = new Channel(name, members[0]);
+    for (size_t i = 1; i < members.size(); ++i) {
+        channel->addClient(members[i]);
+    }
+    _server->_channels[name] = channel;
+    return channel;
+}
+
+// Same contract as a reactor: the line without CRLF, NUL-terminated
+void MicroBench::line(Client* client, const std::string& text) {
+    _scratch.assign(text.begin(), text.end());
+    _scratch.push_back('\0');
+    _server->onLine(client, &_scratch[0], text.length());
+}
+
+Client* MicroBench::findNick(const std::string& nick) {
+    return _server->findClientByNick(nick);
+}
+
+// The message construction in cmdPrivmsg, then the channel fan-out
+void MicroBench::privmsg(Client* sender, Channel* channel, const std::string& text) {
+    LineBuilder full_message;
+    full_message << sender->getPrefix() << " PRIVMSG " << channel->getName() << " :" << text;
+    _server->broadcast(channel, full_message, sender);
+}
+
+void MicroBench::discardOutput() {
+    OutboundBatch* batch = _server->_outbound[0];
+    if (batch) batch->items.clear();
+}
+
+static std::string nickFor(size_t i) {
+    std::ostringstream nick;
+    nick << "user" << i;
+    return nick.str();
+}
+
+// --- Cases ---
+class Case {
+public:
+    virtual ~Case() {}
+    virtual void run(size_t iterations) = 0;
+};
+
+// What a busy channel's clients send, roughly in proportion
+static const char* const COMMAND_MIX[] = {
+    "PRIVMSG #lobby :hello everyone, how is it going?",
+    "PRIVMSG user7 :are you around? I have a question about the build",
+    "PING :irc.42.fr",
+    "PRIVMSG #lobby :sure, one second",
+    ":user0 PRIVMSG #lobby :with a prefix, as some clients send",
+    "JOIN #side",
+    "MODE #lobby",
+    "PRIVMSG #side :anyone here?",
+    "PONG :irc.42.fr",
+    "TOPIC #lobby",
+    "PART #side :bye",
+    "PRIVMSG #lobby :ok, back to work",
+    "WHO #lobby",
+};
+static const size_t COMMAND_MIX_SIZE = sizeof(COMMAND_MIX) / sizeof(COMMAND_MIX[0]);
+
+class ParseMix : public Case {
+public:
+    ParseMix() {
+        for (size_t i = 0; i < COMMAND_MIX_SIZE; ++i) {
+            _lines.push_back(COMMAND_MIX[i]);
+        }
+        _scratch.resize(512);
+    }
+
+    // The copy stands in for the bytes landing in the input buffer
+    void run(size_t iterations) {
+        size_t total = 0;
+        for (size_t i = 0; i < iterations; ++i) {
+            const std::string& line = _lines[i % _lines.size()];
+            std::memcpy(&_scratch[0], line.c_str(), line.length() + 1);
+            MessageView message;
+            if (parseMessage(&_scratch[0], line.length(), message))
+                total += lookupCommand(message.command) + message.size();
+        }
+        sink = total;
+    }
+
+private:
+    std::vector<std::string> _lines;
+    std::vector<char> _scratch;
+};
+
+class CommandMix : public Case {
+public:
+    CommandMix() : _next(0) {
+        std::vector<Client*> members;
+        for (size_t i = 0; i < 100; ++i) {
+            Client* client = _bench.addUser(nickFor(i));
+            if (i < 50) members.push_back(client);
+        }
+        _sender = members[0];
+        _bench.addChannel("#lobby", members);
+        for (size_t i = 0; i < COMMAND_MIX_SIZE; ++i) {
+            _lines.push_back(COMMAND_MIX[i]);
+        }
+    }
+
+    // Keeps its place across runs so JOIN and PART stay paired
+    void run(size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            _bench.line(_sender, _lines[_next]);
+            _bench.discardOutput();
+            _next = (_next + 1) % _lines.size();
+        }
+    }
+
+private:
+    MicroBench _bench;
+    Client* _sender;
+    std::vector<std::string> _lines;
+    size_t _next;
+};
+
+class FindNick : public Case {
+public:
+    explicit FindNick(size_t users) {
+        for (size_t i = 0; i < users; ++i) {
+            _bench.addUser(nickFor(i));
+            std::string key = nickFor(i);
+            if (i % 2) std::transform(key.begin(), key.end(), key.begin(), ::toupper);
+            _keys.push_back(key);
+        }
+        std::random_shuffle(_keys.begin(), _keys.end());
+    }
+
+    void run(size_t iterations) {
+        size_t found = 0;
+        for (size_t i = 0; i < iterations; ++i) {
+            found += _bench.findNick(_keys[i % _keys.size()]) != NULL;
+        }
+        sink = found;
+    }
+
+private:
+    MicroBench _bench;
+    std::vector<std::string> _keys;
+};
+
+// Channel cases work on bare clients: Channel never touches the server
+class ChannelCase : public Case {
+public:
+    ChannelCase(size_t members, size_t outsiders) : _channel(NULL) {
+        for (size_t i = 0; i < members + outsiders; ++i) {
+            _clients.push_back(new Client(1000000 + static_cast<int>(i), "127.0.0.1", NULL));
+        }
+        _channel = new Channel("#bench", _clients[0]);
+        for (size_t i = 1; i < members; ++i) {
+            _channel->addClient(_clients[i]);
+        }
+        _outsiders.assign(_clients.begin() + members, _clients.end());
+    }
+
+    virtual ~ChannelCase() {
+        delete _channel;
+        for (size_t i = 0; i < _clients.size(); ++i) {
+            delete _clients[i];
+        }
+    }
+
+protected:
+    Channel* _channel;
+    std::vector<Client*> _clients;  // Members first, then outsiders
+    std::vector<Client*> _outsiders;
+};
+
+class ChannelAddRemove : public ChannelCase {
+public:
+    explicit ChannelAddRemove(size_t members) : ChannelCase(members, 64) {}
+
+    void run(size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            Client* client = _outsiders[i % _outsiders.size()];
+            _channel->addClient(client);
+            _channel->removeClient(client);
+        }
+    }
+};
+
+class ChannelContains : public ChannelCase {
+public:
+    explicit ChannelContains(size_t members) : ChannelCase(members, members) {
+        for (size_t i = 0; i < members; ++i) {
+            _probes.push_back(_clients[i]);
+            _probes.push_back(_outsiders[i]);
+        }
+        std::random_shuffle(_probes.begin(), _probes.end());
+    }
+
+    void run(size_t iterations) {
+        size_t found = 0;
+        for (size_t i = 0; i < iterations; ++i) {
+            found += _channel->isClientInChannel(_probes[i % _probes.size()]);
+        }
+        sink = found;
+    }
+
+private:
+    std::vector<Client*> _probes;
+};
+
+class ChannelMembers : public ChannelCase {
+public:
+    explicit ChannelMembers(size_t members) : ChannelCase(members, 0) {}
+
+    void run(size_t iterations) {
+        size_t total = 0;
+        for (size_t i = 0; i < iterations; ++i) {
+            const std::vector<Client*>& members = _channel->getMembers();
+            for (size_t j = 0; j < members.size(); ++j) {
+                total += members[j]->getFd();
+            }
+        }
+        sink = total;
+    }
+};
+
+class PrivmsgBroadcast : public Case {
+public:
+    explicit PrivmsgBroadcast(size_t members)
+        : _channel(NULL), _text("the quick brown fox jumps over the lazy dog") {
+        std::vector<Client*> clients;
+        for (size_t i = 0; i < members; ++i) {
+            clients.push_back(_bench.addUser(nickFor(i)));
+        }
+        _sender = clients[0];
+        _channel = _bench.addChannel("#lobby", clients);
+    }
+
+    void run(size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            _bench.privmsg(_sender, _channel, _text);
+            _bench.discardOutput();
+        }
+    }
+
+private:
+    MicroBench _bench;
+    Client* _sender;
+    Channel* _channel;
+    std::string _text; // As if parsed from the sender's line
+};
+
+// A member asks for the names again and again: the list is cached, so this
+// is the cost of cutting it into replies. join_names adds a JOIN and a
+// PART, which change the membership between requests.
+class NamesReply : public Case {
+public:
+    NamesReply(size_t members, bool rejoin) : _rejoin(rejoin) {
+        std::vector<Client*> clients;
+        for (size_t i = 0; i < members; ++i) {
+            clients.push_back(_bench.addUser(nickFor(i)));
+        }
+        _bench.addChannel("#lobby", clients);
+        _asker = clients[members - 1];
+        _joiner = _bench.addUser(nickFor(members));
+    }
+
+    void run(size_t iterations) {
+        for (size_t i = 0; i < iterations; ++i) {
+            if (_rejoin) {
+                _bench.line(_joiner, "JOIN #lobby");
+                _bench.line(_joiner, "PART #lobby");
+            } else {
+                _bench.line(_asker, "NAMES #lobby");
+            }
+            _bench.discardOutput();
+        }
+    }
+
+private:
+    MicroBench _bench;
+    bool _rejoin;
+    Client* _asker;
+    Client* _joiner;
+};
+
+// --- Runner ---
+struct BenchOptions {
+    std::string filter;
+    long minMs;
+
+    BenchOptions() : minMs(200) {}
+    void parse(int argc, char** argv);
+};
+
+void BenchOptions::parse(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 9, "--filter=") == 0) {
+            filter = arg.substr(9);
+        } else if (arg.compare(0, 9, "--min-ms=") == 0) {
+            minMs = std::atol(arg.c_str() + 9);
+            if (minMs < 1) throw std::runtime_error("--min-ms must be positive");
+        } else {
+            throw std::runtime_error("Unknown option: " + arg);
+        }
+    }
+}
+
+static const size_t MAX_ITERATIONS = 1UL << 30;
+
+static void measure(const std::string& name, Case& bench, long minNs) {
+    size_t iterations = 1;
+    while (true) {
+        unsigned long allocsBefore = allocations;
+        long start = monotonicNs();
+        bench.run(iterations);
+        long elapsed = monotonicNs() - start;
+        unsigned long allocs = allocations - allocsBefore;
+
+        if (elapsed >= minNs || iterations >= MAX_ITERATIONS) {
+            std::cout << std::left << std::setw(28) << name << std::right
+                      << std::setw(12) << iterations
+                      << std::fixed << std::setprecision(1)
+                      << std::setw(12) << (double)elapsed / iterations << " ns/op"
+                      << std::setprecision(2)
+                      << std::setw(10) << (double)allocs / iterations << " allocs/op" << std::endl;
+            return;
+        }
+        // Aim 20% past the target, growing at most 100x per step
+        size_t next = elapsed > 0 ? (size_t)((double)iterations * minNs * 1.2 / elapsed) + 1 : iterations * 100;
+        iterations = std::min(std::min(next, iterations * 100), MAX_ITERATIONS);
+    }
+}
+
+// Builds a case only when the filter selects it: the large fixtures take a while
+class Runner {
+public:
+    explicit Runner(const BenchOptions& options) : _options(options) {}
+
+    bool wants(const std::string& name) const {
+        return _options.filter.empty() || name.find(_options.filter) != std::string::npos;
+    }
+
+    void run(const std::string& name, Case* bench) {
+        measure(name, *bench, _options.minMs * 1000000L);
+        delete bench;
+    }
+
+private:
+    const BenchOptions& _options;
+};
+
+static std::string sized(const char* name, size_t n) {
+    std::ostringstream out;
+    out << name << "/" << n;
+    return out.str();
+}
+
+int main(int argc, char** argv) {
+    try {
+        BenchOptions options;
+        options.parse(argc, argv);
+        Logger::instance().configure("-", "error", "server");
+        Runner runner(options);
+
+        if (runner.wants("parse_mix")) runner.run("parse_mix", new ParseMix());
+        if (runner.wants("command_mix")) runner.run("command_mix", new CommandMix());
+
+        static const size_t USERS[] = { 10, 1000, 100000 };
+        for (size_t i = 0; i < 3; ++i) {
+            std::string name = sized("find_nick", USERS[i]);
+            if (runner.wants(name)) runner.run(name, new FindNick(USERS[i]));
+        }
+
+        static const size_t MEMBERS[] = { 10, 100, 1000, 10000 };
+        for (size_t i = 0; i < 4; ++i) {
+            std::string name = sized("channel_add_remove", MEMBERS[i]);
+            if (runner.wants(name)) runner.run(name, new ChannelAddRemove(MEMBERS[i]));
+        }
+        for (size_t i = 0; i < 4; ++i) {
+            std::string name = sized("channel_contains", MEMBERS[i]);
+            if (runner.wants(name)) runner.run(name, new ChannelContains(MEMBERS[i]));
+        }
+        for (size_t i = 0; i < 4; ++i) {
+            std::string name = sized("channel_members", MEMBERS[i]);
+            if (runner.wants(name)) runner.run(name, new ChannelMembers(MEMBERS[i]));
+        }
+        for (size_t i = 0; i < 3; ++i) {
+            std::string name = sized("privmsg_broadcast", MEMBERS[i]);
+            if (runner.wants(name)) runner.run(name, new PrivmsgBroadcast(MEMBERS[i]));
+        }
+        for (size_t i = 0; i < 4; ++i) {
+            std::string name = sized("names", MEMBERS[i]);
+            if (runner.wants(name)) runner.run(name, new NamesReply(MEMBERS[i], false));
+        }
+        for (size_t i = 0; i < 4; ++i) {
+            std::string name = sized("join_names", MEMBERS[i]);
+            if (runner.wants(name)) runner.run(name, new NamesReply(MEMBERS[i], true));
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        std::cerr << "Usage: " << argv[0] << " [--filter=SUBSTRING] [--min-ms=N]" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef ADMINLISTENER_HPP
+#define ADMINLISTENER_HPP
+
+#include <pthread.h>
+#include "MpscQueue.hpp"
+
+class Server;
+
+// Loopback-only HTTP endpoint serving the server's metrics in Prometheus
+// text format. It runs on its own thread with plain blocking I/O, one
+// short-lived connection per scrape, and only reads the lock-free metric
+// counters, so it never touches the event loops.
+class AdminListener {
+public:
+    AdminListener(Server& server, int port);
+    ~AdminListener(); // Stops and joins the thread
+
+    void start();
+
+private:
+    Server& _server;
+    int _listenFd;
+    Notifier _stop;
+    volatile int _running;
+    pthread_t _thread;
+    bool _threadStarted;
+
+    static void* threadMain(void* arg);
+    void serve();
+    void handleRequest(int fd);
+
+    AdminListener();
+    AdminListener(const AdminListener&);
+    AdminListener& operator=(const AdminListener&);
+};
+
+#endif // ADMINLISTENER_HPP
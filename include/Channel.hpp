@@ -4,23 +4,44 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <ctime>
 #include "Client.hpp"
+#include "HashMap.hpp"
+#include "ChannelHistory.hpp"
+
+// Per-client flag bits kept in the channel's member table
+enum MemberFlags {
+    MEMBER_JOINED = 1,
+    MEMBER_OPERATOR = 2,
+    MEMBER_INVITED = 4 // For +i mode; may be set for non-members
+};
 
 class Channel {
 public:
     Channel(const std::string& name, Client* creator);
     ~Channel();
 
+    // Allocated from a slab pool, like Client
+    static void* operator new(size_t size);
+    static void operator delete(void* block, size_t size);
+
     // Basic Info
     const std::string& getName() const;
     const std::string& getTopic() const;
-    void setTopic(const std::string& topic);
+    void setTopic(const std::string& topic, time_t when = time(NULL));
+    time_t getTopicTime() const;
+    // Creation time, TS6 style: when linked servers disagree about a
+    // channel, the older one keeps its modes and operators
+    time_t getCreatedAt() const;
+    void setCreatedAt(time_t ts);
 
     // Member Management
     bool addClient(Client* client);
     void removeClient(Client* client);
     bool isClientInChannel(Client* client) const;
-    std::vector<Client*> getClients() const;
+    // Joined members, for fan-out without copying. Order is unspecified.
+    const std::vector<Client*>& getMembers() const;
+    size_t getMemberCount() const;
 
     // Operator Management
     bool isOperator(Client* client) const;
@@ -41,20 +62,44 @@ public:
     bool isInvited(Client* client);
     void removeInvite(Client* client);
 
+    // "@op nick ..." for RPL_NAMREPLY, in member order. Kept between
+    // calls: a join appends to it, other membership and operator changes
+    // drop it, and so must a member's nick change (forgetNames).
+    const std::string& getNames();
+    void forgetNames();
+
+    // Recent events, for CHATHISTORY
+    ChannelHistory& getHistory();
 
 private:
     std::string _name;
     std::string _topic;
     std::string _key; // Password for the channel ('k' mode)
-    std::vector<Client*> _clients;
-    std::vector<Client*> _operators;
-    std::vector<Client*> _invitedUsers; // For +i mode
+    time_t _topicTime;
+    time_t _createdAt;
+    struct MemberEntry {
+        unsigned int flags;
+        size_t index; // Position in _members while MEMBER_JOINED is set
+        MemberEntry() : flags(0), index(0) {}
+    };
+
+    HashMap<Client*, MemberEntry> _table; // Every client with at least one flag
+    std::vector<Client*> _members;        // Dense list of joined clients
+
+    bool hasFlag(Client* client, unsigned int flag) const;
+    void clearFlags(Client* client, unsigned int flags);
+
+    std::string _names;
+    bool _namesValid;
+    void appendName(Client* client);
 
     // Modes
     bool _inviteOnly; // 'i'
     bool _topicRestricted; // 't'
     int _userLimit; // 'l'
 
+    ChannelHistory _history;
+
     // Private default constructor
     Channel();
     Channel(const Channel&);
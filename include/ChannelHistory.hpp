@@ -0,0 +1,72 @@
+#ifndef CHANNELHISTORY_HPP
+#define CHANNELHISTORY_HPP
+
+#include <vector>
+#include <cstddef>
+#include "Payload.hpp"
+
+class ChannelHistory;
+
+struct HistoryEvent {
+    unsigned long msgid; // Increases with time, across restarts too
+    long long timeMs;    // Wall clock, for the server-time tag
+    PayloadRef line;     // The line members received
+    ChannelHistory* owner;
+    HistoryEvent* older; // Every channel's events, oldest first, for the memory cap
+    HistoryEvent* newer;
+};
+
+// A channel's recent events (PRIVMSG, JOIN, PART, KICK, TOPIC) for
+// CHATHISTORY, oldest first. Bounded per channel by --history-lines and
+// --history-bytes, and for all channels together by --history-memory:
+// past that, the oldest events anywhere go first. The lines are the
+// payloads already built for the broadcast, shared rather than copied.
+//
+// Core thread only. The ring is allocated on the first event, so quiet
+// channels cost nothing.
+class ChannelHistory {
+public:
+    static const size_t REPLY_MAX = 100; // Events one CHATHISTORY reply returns at most
+
+    // lines == 0 turns history off
+    static void configure(size_t lines, size_t bytes, size_t memory);
+    static bool enabled();
+    static size_t memoryUsed(); // Lines and bookkeeping, all channels
+    static size_t eventCount();
+
+    ChannelHistory();
+    ~ChannelHistory();
+
+    void record(const PayloadRef& line);
+
+    size_t size() const;
+    const HistoryEvent& at(size_t index) const; // 0 is the oldest
+    // Index of the first event with msgid >= msgid, or time >= timeMs;
+    // size() when there is none
+    size_t firstFrom(unsigned long msgid) const;
+    size_t firstAt(long long timeMs) const;
+
+private:
+    std::vector<HistoryEvent*> _ring; // Grows up to the line limit
+    size_t _head;                     // Oldest event
+    size_t _count;
+    size_t _bytes;
+
+    void dropOldest();
+    void grow();
+
+    static size_t _lineLimit;
+    static size_t _byteLimit;
+    static size_t _memoryLimit;
+    static size_t _memoryUsed;
+    static size_t _events;
+    static unsigned long _nextMsgid;
+    static long long _lastTimeMs; // Stamps never go back, or firstAt's search breaks on a clock step
+    static HistoryEvent* _oldest;
+    static HistoryEvent* _newest;
+
+    ChannelHistory(const ChannelHistory&);
+    ChannelHistory& operator=(const ChannelHistory&);
+};
+
+#endif // CHANNELHISTORY_HPP
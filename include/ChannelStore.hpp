@@ -0,0 +1,83 @@
+#ifndef CHANNELSTORE_HPP
+#define CHANNELSTORE_HPP
+
+#include "MpscQueue.hpp"
+#include <string>
+#include <map>
+#include <ctime>
+#include <pthread.h>
+
+// What outlives a restart: the channel's own settings. Operators and
+// invites belong to connections, which a restart ends anyway.
+struct ChannelSettings {
+    std::string name;
+    time_t createdAt;
+    std::string topic;
+    time_t topicTime;
+    std::string key;
+    bool inviteOnly;
+    bool topicRestricted;
+    int userLimit;
+
+    ChannelSettings() : createdAt(0), topicTime(0), inviteOnly(false), topicRestricted(true), userLimit(0) {}
+};
+
+// --channel-db: channel settings on disk, as a compacted snapshot at path
+// and an append-only journal of changes since at path.journal. Each journal
+// record is a channel's full settings, or its removal, so replaying it is
+// idempotent and the last record for a name wins.
+//
+// The core thread only encodes a record and queues it. A writer thread
+// appends batches to the journal (fdatasync'd) and keeps the latest record
+// per channel; once the journal passes compactBytes it writes those out as
+// a new snapshot beside the old one, renames it over, and empties the
+// journal.
+class ChannelStore {
+public:
+    ChannelStore();
+    ~ChannelStore();
+
+    // Loads the snapshot, then the journal on top (both mapped, not read),
+    // into channels, and starts the writer. A record cut short by a crash
+    // ends the journal. Throws std::runtime_error on an unreadable snapshot.
+    void open(const std::string& path, size_t compactBytes, std::map<std::string, ChannelSettings>& channels);
+    // Writes out everything queued, then joins the writer
+    void close();
+    bool isOpen() const;
+
+    // Core thread
+    void save(const ChannelSettings& settings);
+    void forget(const std::string& name);
+
+private:
+    struct Record : MpscNode {
+        std::string name;
+        std::string payload; // Framed; a removal when the name is all it holds
+        bool removal;
+    };
+
+    std::string _path;
+    size_t _compactBytes;
+    int _journalFd;
+    size_t _journalBytes;
+    // The writer's copy of every channel's latest record, for the snapshot
+    std::map<std::string, std::string> _latest;
+    bool _latestComplete; // Else compacting would drop what failed to load
+
+    MpscQueue _queue;
+    Notifier _notifier;
+    pthread_t _thread;
+    bool _threadStarted;
+    volatile int _running;
+
+    void push(Record* record);
+    void loadLatest();
+    static void* threadMain(void* arg);
+    void writeQueued();
+    void compact();
+
+    ChannelStore(const ChannelStore&);
+    ChannelStore& operator=(const ChannelStore&);
+};
+
+#endif // CHANNELSTORE_HPP
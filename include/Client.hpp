@@ -2,6 +2,15 @@
 #define CLIENT_HPP
 
 #include <string>
+#include <set>
+#include <ctime>
+#include "InputBuffer.hpp"
+#include "OutputQueue.hpp"
+#include "FloodControl.hpp"
+
+class Channel;
+class Reactor;
+struct RemoteServer;
 
 enum RegistrationState {
     PASS_NEEDED,
@@ -9,39 +18,104 @@ enum RegistrationState {
     REGISTERED
 };
 
+// A connection, or a user on another server of the network (no fd, no
+// reactor; see getServer()). A connection whose peer turned out to be a
+// server carries that server in getPeer() instead of being a user.
 class Client {
 public:
-    Client(int fd, const std::string& hostname);
+    Client(int fd, const std::string& hostname, Reactor* reactor);
     ~Client();
 
+    // Allocated from a slab pool: connections come and go in bursts
+    static void* operator new(size_t size);
+    static void operator delete(void* block, size_t size);
+
     // Getters
     int getFd() const;
+    unsigned long getId() const;
+    Reactor* getReactor() const;
     const std::string& getNickname() const;
     const std::string& getUsername() const;
+    const std::string& getRealname() const;
     const std::string& getHostname() const;
+    const std::string& getPrefix() const; // ":nick!user@host", kept current by the setters
     RegistrationState getRegistrationState() const;
-    const std::string& getBuffer() const;
-    std::string& getBufferRef();
+    InputBuffer& getInput();
     bool isAuthenticated() const;
+    OutputQueue& getOutput();
+    bool isWriteArmed() const;
+    bool isFlushPending() const;
+    bool isClosing() const;
+    TokenBucket& getFloodBucket();
+    bool isThrottled() const;
+    bool isSendqExceeded() const;
+    const std::set<Channel*>& getChannels() const;
+    const std::set<Channel*>& getInvites() const;
+
+    // Network identity: registered users have a UID and the time their
+    // nick was taken, which settles nick collisions between servers
+    const std::string& getUid() const;
+    time_t getNickTs() const;
+    RemoteServer* getServer() const;  // Server a remote user is on; NULL for a local client
+    bool isRemote() const;
+    RemoteServer* getPeer() const;    // Server at the other end of a link; NULL for users
+    const std::string& getLinkSid() const; // From a server's PASS, until SERVER completes the handshake
+    bool isServerLink() const;        // Reactor's view of getPeer(): no flood control, link sendq
 
     // Setters
     void setNickname(const std::string& nickname);
     void setUsername(const std::string& username);
+    void setRealname(const std::string& realname);
     void setRegistrationState(RegistrationState state);
-    void appendToBuffer(const char* data, size_t size);
-    void clearBuffer(size_t len);
     void setAuthenticated(bool auth);
+    void setWriteArmed(bool armed);
+    void setFlushPending(bool pending);
+    void setClosing(bool closing);
+    void setThrottled(bool throttled);
+    void setSendqExceeded(bool exceeded);
+    void setUid(const std::string& uid);
+    void setNickTs(time_t ts);
+    void setServer(RemoteServer* server);
+    void setPeer(RemoteServer* peer);
+    void setLinkSid(const std::string& sid);
+    void setServerLink(bool link);
+
+    // Membership/invite index, maintained by Channel
+    void addChannel(Channel* channel);
+    void removeChannel(Channel* channel);
+    void addInvite(Channel* channel);
+    void removeInvite(Channel* channel);
 
 
 private:
     int _fd;
+    unsigned long _id;  // Unique for the process lifetime, unlike fds and addresses
+    Reactor* _reactor;  // Event loop that owns the connection
     std::string _nickname;
     std::string _username;
     std::string _realname;
     std::string _hostname;
+    std::string _prefix;   // Source of lines this client causes
     RegistrationState _registrationState;
-    std::string _buffer; // Buffer for incoming data
+    InputBuffer _input; // Buffer for incoming data
     bool _authenticated;
+    OutputQueue _output; // Replies waiting for the socket to accept them
+    bool _writeArmed;    // Writable interest registered with the poller
+    bool _flushPending;  // Already listed in the reactor's pending flushes
+    bool _closing;       // Socket is dead, waiting for the core to release it
+    TokenBucket _floodBucket; // Owned by the reactor, like the buffers
+    bool _throttled;          // Listed in the reactor's throttled clients
+    bool _sendqExceeded;      // Output refused, drop at the next flush
+    std::set<Channel*> _channels; // Channels this client is a member of
+    std::set<Channel*> _invites;  // Channels holding a pending invite for it
+    std::string _uid;
+    time_t _nickTs;
+    RemoteServer* _server;
+    RemoteServer* _peer;
+    std::string _linkSid;
+    bool _serverLink; // Owned by the reactor, like the buffers
+
+    void updatePrefix();
 
     Client();
     Client(const Client&);
@@ -0,0 +1,27 @@
+#ifndef CLOCK_HPP
+#define CLOCK_HPP
+
+#include <ctime>
+
+// Milliseconds on a clock that never jumps with wall-clock changes
+inline long monotonicMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+// Same clock in microseconds, for latency measurements
+inline long monotonicUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000L + ts.tv_nsec / 1000L;
+}
+
+// Nanoseconds, for microbenchmarks
+inline long monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+#endif // CLOCK_HPP
@@ -0,0 +1,50 @@
+#ifndef COMMANDTABLE_HPP
+#define COMMANDTABLE_HPP
+
+#include "MessageView.hpp"
+
+// Every command the server understands. Values index Server's dispatch table.
+enum CommandId {
+    CMD_PASS,
+    CMD_NICK,
+    CMD_USER,
+    CMD_QUIT,
+    CMD_PING,
+    CMD_PONG,
+    CMD_PRIVMSG,
+    CMD_JOIN,
+    CMD_PART,
+    CMD_TOPIC,
+    CMD_KICK,
+    CMD_INVITE,
+    CMD_MODE,
+    CMD_STATS,
+    CMD_CHATHISTORY,
+    CMD_NAMES,
+    // Server-to-server (see ServerLink.cpp)
+    CMD_SERVER,
+    CMD_SID,
+    CMD_UID,
+    CMD_SJOIN,
+    CMD_TMODE,
+    CMD_TB,
+    CMD_EOB,
+    CMD_SQUIT,
+    CMD_KILL,
+    CMD_ERROR,
+    CMD_COUNT,
+    CMD_UNKNOWN = CMD_COUNT
+};
+
+// What a client must have done before a command is accepted
+enum CommandAccess {
+    ACCESS_ANY,           // PASS, QUIT, PING, ...
+    ACCESS_AUTHENTICATED, // Correct PASS given
+    ACCESS_REGISTERED     // PASS, NICK and USER completed
+};
+
+// Case-insensitive, allocation-free mapping of a command token to its id:
+// a switch on length and leading letters, then one comparison.
+CommandId lookupCommand(const StringView& name);
+
+#endif // COMMANDTABLE_HPP
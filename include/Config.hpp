@@ -0,0 +1,56 @@
+#ifndef CONFIG_HPP
+#define CONFIG_HPP
+
+#include <string>
+#include <vector>
+
+// Optional tuning knobs, given after <port> <password> as --name=value.
+struct ServerConfig {
+    std::string backend; // Readiness backend: poll, epoll, epoll-et
+    int threads;         // Event-loop threads; more than 1 enables the core/reactor split
+    std::string logFile;       // "-" for stdout
+    std::string logLevel;      // debug, info, warn, error
+    std::string logCategories; // Comma-separated: server, conn, wire (or all)
+    long floodRate;        // Tokens per second; 0 disables flood control
+    long floodBurst;       // Bucket capacity in tokens
+    long floodCostLight;   // Per-line cost of PING, PASS, ...
+    long floodCostMessage; // Per-line cost of PRIVMSG
+    long floodCostState;   // Per-line cost of NICK, JOIN, MODE, ...
+    long floodMaxLines;    // Held-back lines before "Excess Flood"
+    long recvq;            // Bytes of unprocessed input before "RecvQ exceeded"
+    long sendq;            // Bytes of unsent output before "SendQ exceeded"
+    int adminPort;         // Loopback Prometheus endpoint; 0 disables it
+    int backlog;           // listen() queue length
+    int acceptBatch;       // Connections accepted per listener wakeup before other work runs
+    int deferAccept;       // TCP_DEFER_ACCEPT seconds: wake on the first bytes, not the handshake; 0 disables it
+    bool tcpNoDelay;       // TCP_NODELAY on accepted sockets
+    int sendBuffer;        // SO_SNDBUF/SO_RCVBUF for accepted sockets; 0 keeps the kernel's autotuning
+    int receiveBuffer;
+    int drainTimeout;      // Seconds to flush output on shutdown before closing anyway
+    std::string serverName;   // Unique on the network
+    std::string sid;          // TS6 server id: a digit and two digits or capitals, unique on the network
+    std::string linkPassword; // Shared by linked servers; empty refuses incoming links
+    std::vector<std::string> links; // host:port of servers to connect to, and reconnect while down
+    long linkSendq;           // --sendq for server links, which carry whole bursts
+    std::string channelDb;    // Snapshot path, with the journal beside it; empty keeps channels in memory only
+    long channelDbCompact;    // Journal bytes that trigger a new snapshot
+    long historyLines;        // Events kept per channel for CHATHISTORY; 0 disables history
+    long historyBytes;        // Per channel
+    long historyMemory;       // All channels together; the oldest events anywhere go first
+    int upgradeFd;         // Set on a process started by an upgrade: its end of the handoff socket
+    std::vector<std::string> command; // argv without --upgrade-fd, re-executed by an upgrade
+    std::string executable;   // Absolute path of this binary, found at startup: argv[0] may be a $PATH name or relative
+
+    ServerConfig();
+
+    // Parses argv[first..argc); throws std::runtime_error on bad options.
+    void parse(int argc, char** argv, int first);
+
+    // A digit, then two digits or capitals: --sid, and any peer's SID
+    static bool isValidSid(const std::string& sid);
+
+private:
+    void validate();
+};
+
+#endif // CONFIG_HPP
@@ -0,0 +1,48 @@
+#ifndef FLOODCONTROL_HPP
+#define FLOODCONTROL_HPP
+
+#include <cstddef>
+#include "CommandTable.hpp"
+
+struct ServerConfig;
+
+// Commands are charged by class: chatter is cheaper than state changes
+enum FloodClass {
+    FLOOD_LIGHT,   // PASS, USER, PING, PONG, QUIT, unknown commands
+    FLOOD_MESSAGE, // PRIVMSG
+    FLOOD_STATE,   // NICK, JOIN, PART, TOPIC, KICK, INVITE, MODE, STATS, CHATHISTORY, NAMES
+    FLOOD_CLASS_COUNT
+};
+
+FloodClass floodClassOf(CommandId id);
+
+// Limits shared by every connection, in whole tokens
+struct FloodPolicy {
+    long rate;                     // Tokens refilled per second; 0 disables flood control
+    long burst;                    // Bucket capacity
+    long cost[FLOOD_CLASS_COUNT];  // Tokens charged per line
+    size_t maxLines;               // Held-back lines before the client is dropped
+
+    explicit FloodPolicy(const ServerConfig& config);
+
+    bool enabled() const;
+    long costOfLine(const char* line, size_t length) const; // Tokens for a raw line
+};
+
+// Per-connection bucket, ircd "fake lag" style: a line may run while the
+// bucket is not in debt, and its cost is charged afterwards. Lines that
+// can't run yet stay in the input buffer until the bucket refills.
+class TokenBucket {
+public:
+    TokenBucket();
+
+    bool ready(const FloodPolicy& policy, long nowMs); // Refills first
+    void charge(long cost);
+    long waitMs(const FloodPolicy& policy) const;      // Until ready() turns true
+
+private:
+    long _tokens; // Thousandths of a token; negative while in debt
+    long _stamp;  // Last refill, or -1 before the first line
+};
+
+#endif // FLOODCONTROL_HPP
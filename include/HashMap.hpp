@@ -0,0 +1,124 @@
+#ifndef HASHMAP_HPP
+#define HASHMAP_HPP
+
+#include <vector>
+#include <cstddef>
+
+// Default hashing for pointer keys (Client*, Channel*, ...).
+struct PointerHash {
+    size_t operator()(const void* p) const {
+        size_t h = reinterpret_cast<size_t>(p);
+        h ^= h >> 17;
+        h *= 2654435761UL;
+        return h ^ (h >> 29);
+    }
+};
+
+template <typename T>
+struct DefaultEqual {
+    bool operator()(const T& a, const T& b) const { return a == b; }
+};
+
+// Open-addressing hash map with linear probing. Erase shifts the following
+// entries back instead of leaving tombstones, so lookups never degrade.
+// Capacity is a power of two and the load factor stays below 3/4.
+template <typename Key, typename Value, typename Hash = PointerHash, typename Equal = DefaultEqual<Key> >
+class HashMap {
+public:
+    HashMap() : _size(0) {}
+
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+    Value* find(const Key& key) {
+        if (_slots.empty()) return NULL;
+        size_t mask = _slots.size() - 1;
+        for (size_t i = _hash(key) & mask; _slots[i].used; i = (i + 1) & mask) {
+            if (_equal(_slots[i].key, key)) return &_slots[i].value;
+        }
+        return NULL;
+    }
+
+    const Value* find(const Key& key) const {
+        return const_cast<HashMap*>(this)->find(key);
+    }
+
+    // Returns false (and leaves the map untouched) if the key already exists
+    bool insert(const Key& key, const Value& value) {
+        if ((_size + 1) * 4 > _slots.size() * 3) grow();
+        size_t mask = _slots.size() - 1;
+        size_t i = _hash(key) & mask;
+        for (; _slots[i].used; i = (i + 1) & mask) {
+            if (_equal(_slots[i].key, key)) return false;
+        }
+        _slots[i].used = true;
+        _slots[i].key = key;
+        _slots[i].value = value;
+        ++_size;
+        return true;
+    }
+
+    bool erase(const Key& key) {
+        if (_slots.empty()) return false;
+        size_t mask = _slots.size() - 1;
+        size_t i = _hash(key) & mask;
+        for (; _slots[i].used; i = (i + 1) & mask) {
+            if (_equal(_slots[i].key, key)) break;
+        }
+        if (!_slots[i].used) return false;
+
+        // Backward-shift: move later entries of the cluster into the hole
+        // unless they already sit at or after their home slot.
+        size_t hole = i;
+        for (size_t j = (i + 1) & mask; _slots[j].used; j = (j + 1) & mask) {
+            size_t home = _hash(_slots[j].key) & mask;
+            if (((j - home) & mask) >= ((j - hole) & mask)) {
+                _slots[hole] = _slots[j];
+                hole = j;
+            }
+        }
+        _slots[hole] = Slot();
+        --_size;
+        return true;
+    }
+
+    void clear() {
+        _slots.clear();
+        _size = 0;
+    }
+
+    // Slot-level iteration: for (i = 0; i < capacity(); ++i) if (occupied(i)) ...
+    size_t capacity() const { return _slots.size(); }
+    bool occupied(size_t i) const { return _slots[i].used; }
+    const Key& keyAt(size_t i) const { return _slots[i].key; }
+    Value& valueAt(size_t i) { return _slots[i].value; }
+    const Value& valueAt(size_t i) const { return _slots[i].value; }
+
+private:
+    struct Slot {
+        Key key;
+        Value value;
+        bool used;
+        Slot() : key(), value(), used(false) {}
+    };
+
+    std::vector<Slot> _slots;
+    size_t _size;
+    Hash _hash;
+    Equal _equal;
+
+    void grow() {
+        std::vector<Slot> old;
+        old.swap(_slots);
+        _slots.resize(old.empty() ? 16 : old.size() * 2);
+        size_t mask = _slots.size() - 1;
+        for (size_t n = 0; n < old.size(); ++n) {
+            if (!old[n].used) continue;
+            size_t i = _hash(old[n].key) & mask;
+            while (_slots[i].used) i = (i + 1) & mask;
+            _slots[i] = old[n];
+        }
+    }
+};
+
+#endif // HASHMAP_HPP
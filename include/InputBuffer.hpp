@@ -0,0 +1,43 @@
+#ifndef INPUTBUFFER_HPP
+#define INPUTBUFFER_HPP
+
+#include <vector>
+#include <cstddef>
+
+// Receive buffer for one connection. recv() writes straight into it and
+// complete lines are handed out in place, NUL-terminated, with a read
+// cursor instead of erasing consumed bytes. Unread bytes are moved back to
+// the front only when the free space at the end runs short.
+class InputBuffer {
+public:
+    static const size_t MAX_LINE = 512; // Including CRLF (RFC 1459)
+
+    InputBuffer();
+    ~InputBuffer();
+
+    // Returns room for at least minSpace bytes at the write end
+    char* writePtr(size_t minSpace);
+    size_t writeSpace() const;
+    void commit(size_t n);
+
+    // Hands out the next complete line without its CR LF. The pointer stays
+    // valid until the next writePtr(). Lines longer than MAX_LINE are cut
+    // and the excess is discarded up to the next LF.
+    bool nextLine(char*& line, size_t& length);
+
+    size_t size() const;         // Unread bytes
+    const char* data() const;    // The first of them
+    size_t pendingLines() const; // Complete lines not handed out yet
+
+private:
+    std::vector<char> _data;
+    size_t _read;       // First unread byte
+    size_t _scan;       // Bytes before this are known to contain no LF
+    size_t _write;      // End of valid data
+    bool _discarding;   // Dropping the rest of an overlong line
+
+    InputBuffer(const InputBuffer&);
+    InputBuffer& operator=(const InputBuffer&);
+};
+
+#endif // INPUTBUFFER_HPP
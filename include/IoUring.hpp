@@ -0,0 +1,92 @@
+#ifndef IOURING_HPP
+#define IOURING_HPP
+
+#include <string>
+#include <sys/socket.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+struct IoCompletion {
+    unsigned long long userData;
+    int result; // Bytes, an accepted fd, or -errno
+    unsigned int flags;
+
+    bool more() const; // A multishot request stays armed after this one
+    bool hasBuffer() const;
+    unsigned int bufferId() const;
+};
+
+// Completion-based socket I/O for --backend=io_uring, on the raw syscalls
+// (no liburing). Requests are queued in the submission ring and reach the
+// kernel together on the next submitAndWait(), which is also the only
+// blocking call: one io_uring_enter() per event-loop turn covers every
+// send, re-arm and wait. Multishot receives land in a ring of provided
+// buffers that the kernel picks from; the caller copies the bytes out and
+// hands the buffer back with recycle().
+//
+// One ring per reactor, used by the reactor's thread only.
+class IoUring {
+public:
+    // Throws std::runtime_error when io_uring or a feature used below is
+    // missing (multishot receive needs Linux 6.0)
+    IoUring(unsigned int entries, unsigned int bufferCount, unsigned int bufferSize);
+    ~IoUring();
+
+    // Whether this kernel can run the io_uring backend; reason says why not
+    static bool supported(std::string& reason);
+
+    // Queued until the next submitAndWait()
+    void acceptMultishot(int fd, unsigned long long userData); // Non-blocking, close-on-exec sockets
+    void pollMultishot(int fd, unsigned long long userData);   // POLLIN
+    void recvMultishot(int fd, unsigned long long userData);   // Into the provided buffers
+    void sendmsg(int fd, const struct msghdr* msg, unsigned long long userData); // msg must outlive it
+    void cancel(unsigned long long target, unsigned long long userData);
+    void cancelAll(unsigned long long userData);
+
+    // Submits what is queued and waits up to timeoutMs (-1: no limit) for
+    // a completion; returns at once if one is already there
+    void submitAndWait(int timeoutMs);
+    bool nextCompletion(IoCompletion& completion);
+
+    const char* buffer(unsigned int id) const;
+    void recycle(unsigned int id);
+
+private:
+    int _fd;
+    void* _ring;      // SQ and CQ rings share one mapping
+    size_t _ringSize;
+    struct io_uring_sqe* _sqes;
+    size_t _sqesSize;
+    unsigned int* _sqHead;
+    unsigned int* _sqTail;
+    unsigned int _sqMask;
+    unsigned int _sqEntries;
+    unsigned int* _cqHead;
+    unsigned int* _cqTail;
+    unsigned int _cqMask;
+    struct io_uring_cqe* _cqes;
+    unsigned int _queued; // SQEs written since the last submit
+
+    // Provided buffers
+    struct io_uring_buf_ring* _bufRing;
+    size_t _bufRingSize;
+    char* _buffers;
+    unsigned int _bufferCount;
+    unsigned int _bufferSize;
+    unsigned short _bufTail;
+
+    void setupRings(unsigned int entries);
+    void setupBuffers();
+    struct io_uring_sqe* prepare(unsigned char opcode, int fd, unsigned long long userData);
+    void queue();
+    int enter(unsigned int toSubmit, unsigned int minComplete, unsigned int flags, int timeoutMs);
+    void release();
+
+    IoUring();
+    IoUring(const IoUring&);
+    IoUring& operator=(const IoUring&);
+};
+
+#endif // IOURING_HPP
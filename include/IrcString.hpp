@@ -0,0 +1,23 @@
+#ifndef IRCSTRING_HPP
+#define IRCSTRING_HPP
+
+#include <string>
+#include <cstddef>
+
+// RFC 1459 casemapping: A-Z and []\~ are the upper case forms of a-z and {}|^,
+// so "Nick[]" and "nick{}" name the same user.
+char ircToLower(char c);
+std::string ircToLower(const std::string& s);
+bool ircEquals(const std::string& a, const std::string& b);
+
+// Hash/equality functors for case-insensitive HashMap keys. They fold while
+// hashing/comparing, so lookups need no temporary string.
+struct IrcCaseHash {
+    size_t operator()(const std::string& s) const;
+};
+
+struct IrcCaseEqual {
+    bool operator()(const std::string& a, const std::string& b) const;
+};
+
+#endif // IRCSTRING_HPP
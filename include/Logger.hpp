@@ -0,0 +1,91 @@
+#ifndef LOGGER_HPP
+#define LOGGER_HPP
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <pthread.h>
+#include <sys/time.h>
+
+enum LogLevel {
+    LOG_DEBUG,
+    LOG_INFO,
+    LOG_WARN,
+    LOG_ERROR
+};
+
+enum LogCategory {
+    LOG_SERVER, // Startup, shutdown, internal errors
+    LOG_CONN,   // Connects and disconnects
+    LOG_WIRE,   // Every line in and out (off by default)
+    LOG_CATEGORY_COUNT
+};
+
+// Asynchronous logger. Producers (any thread) copy the record into a
+// bounded lock-free ring and return; a background thread formats records
+// and writes them to the log file in batches. A full ring drops the record
+// and counts it instead of stalling the event loop.
+class Logger {
+public:
+    static Logger& instance();
+
+    // path "-" means stdout. categories is a comma-separated list such as
+    // "server,conn,wire"; levels: debug, info, warn, error.
+    void configure(const std::string& path, const std::string& level, const std::string& categories);
+    void start();
+    void stop(); // Drains what is queued, then joins the writer thread
+
+    bool enabled(LogLevel level, LogCategory category) const;
+    void write(LogLevel level, LogCategory category, const std::string& text);
+    unsigned long dropped() const;
+
+private:
+    static const size_t RING_SIZE = 4096; // Records, power of two
+    static const size_t TEXT_MAX = 600;   // Longer texts are cut
+
+    struct Record {
+        volatile size_t sequence;
+        struct timeval time;
+        LogLevel level;
+        LogCategory category;
+        size_t length;
+        char text[TEXT_MAX];
+    };
+
+    std::vector<Record> _ring;
+    volatile size_t _enqueuePos;
+    size_t _dequeuePos;
+    volatile unsigned long _dropped;
+    unsigned long _droppedReported;
+
+    LogLevel _level;
+    bool _categories[LOG_CATEGORY_COUNT];
+    int _fd;
+    bool _ownsFd;
+
+    pthread_t _thread;
+    bool _threadStarted;
+    volatile int _running;
+
+    static void* threadMain(void* arg);
+    void drain();
+    bool popInto(std::string& out);
+
+    Logger();
+    ~Logger();
+    Logger(const Logger&);
+    Logger& operator=(const Logger&);
+};
+
+// Formats only when the level/category is enabled:
+//   LOG(LOG_INFO, LOG_CONN, "New connection from " << ip);
+#define LOG(level, category, expr)                                        \
+    do {                                                                  \
+        if (Logger::instance().enabled(level, category)) {                \
+            std::ostringstream logStream_;                                \
+            logStream_ << expr;                                           \
+            Logger::instance().write(level, category, logStream_.str());  \
+        }                                                                 \
+    } while (0)
+
+#endif // LOGGER_HPP
@@ -0,0 +1,20 @@
+#ifndef MEMORYACCOUNT_HPP
+#define MEMORYACCOUNT_HPP
+
+#include <cstddef>
+
+// Process-wide count of bytes held by connection buffers: input buffer
+// capacity plus queued output. Updated from every reactor thread.
+class MemoryAccount {
+public:
+    static void charge(size_t bytes);
+    static void release(size_t bytes);
+    static size_t used();
+
+private:
+    static volatile size_t _used;
+
+    MemoryAccount();
+};
+
+#endif // MEMORYACCOUNT_HPP
@@ -0,0 +1,54 @@
+#ifndef MESSAGEVIEW_HPP
+#define MESSAGEVIEW_HPP
+
+#include <string>
+#include <cstddef>
+
+// Non-owning view of bytes inside a client's input buffer. The parser
+// NUL-terminates every token in place, so c_str() is always valid.
+class StringView {
+public:
+    StringView();
+    StringView(const char* data, size_t length);
+
+    const char* data() const;
+    const char* c_str() const;
+    size_t length() const;
+    size_t size() const;
+    bool empty() const;
+    char operator[](size_t i) const;
+
+    std::string str() const;
+    bool equalsIgnoreCase(const char* literal) const; // ASCII, for command names
+
+private:
+    const char* _data;
+    size_t _length;
+};
+
+bool operator==(const StringView& a, const std::string& b);
+bool operator!=(const StringView& a, const std::string& b);
+
+// One parsed IRC line: [":" prefix " "] command {" " param} [" :" trailing].
+// All views point into the line that was handed to parseMessage().
+struct MessageView {
+    static const size_t MAX_PARAMS = 15; // RFC 1459 limit
+
+    StringView prefix;
+    StringView command;
+    StringView params[MAX_PARAMS];
+    size_t paramCount;
+
+    MessageView();
+
+    size_t size() const;
+    bool empty() const;
+    const StringView& operator[](size_t i) const;
+};
+
+// Tokenizes line[0..length) in place without allocating. The trailing
+// parameter keeps its spaces and colons. Returns false for a line with no
+// command.
+bool parseMessage(char* line, size_t length, MessageView& message);
+
+#endif // MESSAGEVIEW_HPP
@@ -0,0 +1,97 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <cstddef>
+#include "CommandTable.hpp"
+
+// Metric primitives. Each may be updated by one or more threads and read
+// by any other (STATS on the core, scrapes on the admin thread) without
+// locking; readers see a recent, not a consistent, snapshot.
+
+class Counter {
+public:
+    Counter();
+    void add(unsigned long n = 1);
+    unsigned long get() const;
+
+private:
+    volatile unsigned long _value;
+};
+
+class Gauge {
+public:
+    Gauge();
+    void set(unsigned long value);
+    unsigned long get() const;
+
+private:
+    volatile unsigned long _value;
+};
+
+// Fixed buckets, Prometheus style: bucket i counts values <= bound(i), the
+// extra last bucket counts everything above the highest bound.
+class Histogram {
+public:
+    static const size_t MAX_BOUNDS = 16;
+
+    Histogram(const unsigned long* bounds, size_t count);
+
+    void record(unsigned long value);
+
+    size_t boundCount() const;
+    unsigned long bound(size_t i) const;
+    unsigned long bucket(size_t i) const; // Not cumulative; i == boundCount() is the overflow
+    unsigned long count() const;
+    unsigned long sum() const;
+
+    // Upper bound of the bucket holding quantile q, or 0 if it falls in
+    // the overflow bucket (or nothing was recorded)
+    unsigned long quantileBound(double q) const;
+
+private:
+    const unsigned long* _bounds;
+    size_t _boundCount;
+    Counter _buckets[MAX_BOUNDS + 1];
+    Counter _count;
+    Counter _sum;
+};
+
+// Event-loop iteration time in microseconds
+extern const unsigned long LATENCY_BOUNDS_US[];
+extern const size_t LATENCY_BOUND_COUNT;
+// Recipients of one broadcast
+extern const unsigned long FANOUT_BOUNDS[];
+extern const size_t FANOUT_BOUND_COUNT;
+
+// Kept by the core thread (Server), which owns the IRC state
+struct ServerMetrics {
+    // Per command slot: one per CommandId, then unknown commands, then
+    // output the server sends on its own (QUITs for dropped clients, ...)
+    static const size_t SLOT_UNKNOWN = CMD_UNKNOWN;
+    static const size_t SLOT_NONE = CMD_COUNT + 1;
+    static const size_t SLOT_COUNT = CMD_COUNT + 2;
+
+    Gauge clients;
+    Gauge registered;
+    Gauge unregistered; // Set together with the two above, so a reader never subtracts across updates
+    Gauge channels;
+    Gauge links;       // Direct server links
+    Gauge servers;     // Other servers on the network
+    Gauge remoteUsers; // Users on them
+    Gauge historyEvents; // Kept for CHATHISTORY, all channels
+    Gauge historyBytes;
+
+    Counter messagesIn[SLOT_COUNT];
+    Counter bytesIn[SLOT_COUNT];
+    Counter messagesOut[SLOT_COUNT]; // Attributed to the command that caused them
+    Counter bytesOut[SLOT_COUNT];
+
+    Counter quits;  // Disconnects by QUIT
+    Counter closed; // Disconnects by the peer or a socket error
+    Histogram fanout;
+    Histogram coreLatency; // Threaded mode: one core loop iteration
+
+    ServerMetrics();
+};
+
+#endif // METRICS_HPP
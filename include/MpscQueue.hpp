@@ -0,0 +1,52 @@
+#ifndef MPSCQUEUE_HPP
+#define MPSCQUEUE_HPP
+
+// Intrusive node: queued objects derive from it.
+struct MpscNode {
+    MpscNode* volatile next;
+    MpscNode() : next(0) {}
+    virtual ~MpscNode() {}
+};
+
+// Lock-free multi-producer/single-consumer FIFO (Vyukov's intrusive queue).
+// push() is wait-free and may be called from any thread; pop() must only be
+// called by the owning thread. pop() can return NULL while a producer is
+// half-way through push(); that producer's wakeup covers the item.
+class MpscQueue {
+public:
+    MpscQueue();
+    ~MpscQueue();
+
+    void push(MpscNode* node);
+    MpscNode* pop();
+
+private:
+    MpscNode* volatile _head; // Producers swap themselves in here
+    MpscNode* _tail;          // Consumer side
+    MpscNode _stub;
+
+    MpscQueue(const MpscQueue&);
+    MpscQueue& operator=(const MpscQueue&);
+};
+
+// Wakes a thread blocked in poll(). notify() only touches the descriptor
+// when the consumer has consumed the previous wakeup.
+class Notifier {
+public:
+    Notifier();
+    ~Notifier();
+
+    int fd() const;   // Readable when notified
+    void notify();    // Any thread
+    void consume();   // Owner thread, before draining its queue
+
+private:
+    int _readFd;
+    int _writeFd;
+    volatile int _pending;
+
+    Notifier(const Notifier&);
+    Notifier& operator=(const Notifier&);
+};
+
+#endif // MPSCQUEUE_HPP
@@ -0,0 +1,37 @@
+#ifndef NETWORK_HPP
+#define NETWORK_HPP
+
+#include <string>
+#include <set>
+
+class Client;
+
+// Another server on the network, as this one sees it. Links form a
+// spanning tree, so every server is reached through exactly one of our
+// direct links; a second path to a known server is refused.
+struct RemoteServer {
+    std::string name;
+    std::string sid;
+    std::string description;
+    int hops;                // 1 for a direct link
+    Client* link;            // Connection it is reached through
+    RemoteServer* uplink;    // Server that introduced it; NULL for a direct link
+    std::set<Client*> users; // Its users, owned by the core
+
+    RemoteServer() : hops(1), link(NULL), uplink(NULL) {}
+};
+
+// How long a --link waits after a failed or dropped connection
+static const long LINK_RETRY_MS = 5000;
+
+// A --link to keep up: connected when down, retried after a failure
+struct LinkTarget {
+    std::string host;
+    int port;
+    Client* connection; // From connect() until the link drops; NULL while down
+    long nextAttemptMs; // Monotonic
+
+    LinkTarget() : port(0), connection(NULL), nextAttemptMs(0) {}
+};
+
+#endif // NETWORK_HPP
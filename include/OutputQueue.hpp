@@ -0,0 +1,44 @@
+#ifndef OUTPUTQUEUE_HPP
+#define OUTPUTQUEUE_HPP
+
+#include <deque>
+#include <string>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "Payload.hpp"
+
+// Pending outbound lines for one connection. Lines are queued by reference
+// (a broadcast shares one Payload between all recipients) and written with
+// writev(); a partial write leaves _offset pointing at the first unsent
+// byte of the front line so the next flush resumes there.
+class OutputQueue {
+public:
+    OutputQueue();
+    ~OutputQueue();
+
+    void push(const PayloadRef& line);
+    bool empty() const;
+    size_t bytes() const; // Unsent bytes still queued
+    void appendTo(std::string& out) const; // Those bytes, in order
+
+    // Writes as much as the socket accepts. Returns the number of bytes
+    // written, 0 if the socket would block, or -1 on a fatal error.
+    ssize_t flush(int fd);
+
+    // For writes that complete later (io_uring): describes up to max of the
+    // first unsent lines, each with a reference that keeps it alive even if
+    // the queue goes away meanwhile. Returns the count; consume() pops the
+    // bytes once they are known to be written.
+    size_t gather(struct iovec* iov, PayloadRef* lines, size_t max) const;
+    void consume(size_t bytes);
+
+private:
+    std::deque<PayloadRef> _lines;
+    size_t _offset;
+    size_t _bytes;
+
+    OutputQueue(const OutputQueue&);
+    OutputQueue& operator=(const OutputQueue&);
+};
+
+#endif // OUTPUTQUEUE_HPP
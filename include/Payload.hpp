@@ -0,0 +1,82 @@
+#ifndef PAYLOAD_HPP
+#define PAYLOAD_HPP
+
+#include <string>
+#include <cstddef>
+#include "MessageView.hpp"
+
+// The pieces of one outbound line (CRLF excluded), referenced rather than
+// copied: the line is sized once and written straight into its Payload
+// block. Pieces must outlive the builder, so build from named strings or
+// within the expression that sends the line.
+class LineBuilder {
+public:
+    LineBuilder();
+
+    LineBuilder& operator<<(const std::string& piece);
+    LineBuilder& operator<<(const StringView& piece);
+    LineBuilder& operator<<(const char* piece);
+
+    size_t length() const;
+    void copyTo(char* out) const;
+    std::string str() const; // For logging
+
+private:
+    static const size_t MAX_PIECES = 16;
+
+    const char* _pieces[MAX_PIECES];
+    size_t _lengths[MAX_PIECES];
+    size_t _count;
+    size_t _length;
+
+    LineBuilder& append(const char* data, size_t length);
+};
+
+// Immutable wire line (CRLF included) shared by every recipient of a
+// broadcast. Header and bytes live in a single allocation; the last
+// release() frees it.
+class Payload {
+public:
+    static Payload* create(const std::string& line);
+    static Payload* create(const LineBuilder& line);
+    static Payload* createRaw(const std::string& bytes); // Wire bytes as they are, CRLFs included
+
+    void retain();
+    void release();
+
+    const char* data() const;
+    size_t length() const;
+
+private:
+    int _refs;
+    size_t _length;
+
+    char* bytes();
+    static Payload* allocate(size_t length);
+
+    explicit Payload(size_t length);
+    ~Payload();
+
+    Payload();
+    Payload(const Payload&);
+    Payload& operator=(const Payload&);
+};
+
+// Owning handle: copying shares the payload instead of the bytes.
+class PayloadRef {
+public:
+    PayloadRef();
+    explicit PayloadRef(Payload* payload); // Adopts the creation reference
+    PayloadRef(const PayloadRef& other);
+    PayloadRef& operator=(const PayloadRef& other);
+    ~PayloadRef();
+
+    const char* data() const;
+    size_t length() const;
+    bool empty() const;
+
+private:
+    Payload* _payload;
+};
+
+#endif // PAYLOAD_HPP
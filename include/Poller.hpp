@@ -0,0 +1,87 @@
+#ifndef POLLER_HPP
+#define POLLER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <poll.h>
+#ifdef __linux__
+# include <sys/epoll.h>
+#endif
+
+// Readiness flags shared by every backend.
+enum PollerFlags {
+    POLLER_READ = 1,
+    POLLER_WRITE = 2,
+    POLLER_ERROR = 4
+};
+
+struct PollerEvent {
+    int fd;
+    unsigned int events;
+};
+
+// Readiness backend used by Server::mainLoop. wait() only reports the
+// descriptors that are actually ready, so the caller never walks idle ones.
+class Poller {
+public:
+    virtual ~Poller();
+
+    virtual void add(int fd, unsigned int events) = 0;
+    virtual void modify(int fd, unsigned int events) = 0;
+    virtual void remove(int fd) = 0;
+    virtual int wait(std::vector<PollerEvent>& ready, int timeoutMs) = 0;
+
+    // Edge-triggered backends only report transitions: the caller has to
+    // drain sockets until EAGAIN.
+    virtual bool isEdgeTriggered() const;
+    virtual const char* name() const = 0;
+
+    // "poll", "epoll" (level-triggered) or "epoll-et" (edge-triggered).
+    static Poller* create(const std::string& backend);
+};
+
+// Portable fallback: one pollfd per descriptor, O(connections) per wakeup.
+class PollPoller : public Poller {
+public:
+    PollPoller();
+    virtual ~PollPoller();
+
+    virtual void add(int fd, unsigned int events);
+    virtual void modify(int fd, unsigned int events);
+    virtual void remove(int fd);
+    virtual int wait(std::vector<PollerEvent>& ready, int timeoutMs);
+    virtual const char* name() const;
+
+private:
+    std::vector<struct pollfd> _pollfds;
+    std::map<int, size_t> _index; // fd -> position in _pollfds
+};
+
+#ifdef __linux__
+class EpollPoller : public Poller {
+public:
+    explicit EpollPoller(bool edgeTriggered);
+    virtual ~EpollPoller();
+
+    virtual void add(int fd, unsigned int events);
+    virtual void modify(int fd, unsigned int events);
+    virtual void remove(int fd);
+    virtual int wait(std::vector<PollerEvent>& ready, int timeoutMs);
+    virtual bool isEdgeTriggered() const;
+    virtual const char* name() const;
+
+private:
+    int _epfd;
+    bool _edgeTriggered;
+    std::vector<struct epoll_event> _events;
+
+    unsigned int toEpoll(unsigned int events) const;
+
+    EpollPoller();
+    EpollPoller(const EpollPoller&);
+    EpollPoller& operator=(const EpollPoller&);
+};
+#endif
+
+#endif // POLLER_HPP
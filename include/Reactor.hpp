@@ -0,0 +1,188 @@
+#ifndef REACTOR_HPP
+#define REACTOR_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <pthread.h>
+#include <netinet/in.h>
+#include "Poller.hpp"
+#include "Payload.hpp"
+#include "MpscQueue.hpp"
+#include "FloodControl.hpp"
+#include "Config.hpp"
+#include "Metrics.hpp"
+#include "IoUring.hpp"
+
+class Server;
+class Client;
+struct UringSend;
+
+// Reactor -> core thread: what happened on a connection
+struct InboundEvent {
+    enum Type { CONNECTED, LINE, DISCONNECTED };
+
+    Type type;
+    Client* client;
+    unsigned long clientId; // Lets the core drop events for a recycled Client*
+    int fd;
+    std::string line; // The line, or the reason for a server-side disconnect
+};
+
+struct InboundBatch : public MpscNode {
+    std::vector<InboundEvent> events;
+};
+
+// Core thread -> reactor: a line to queue, a close request (empty payload),
+// or a connection the core opened or found to be a server link
+struct OutboundItem {
+    enum Action { SEND, ATTACH, LINK };
+
+    Client* client;
+    PayloadRef payload;
+    Action action;
+
+    OutboundItem(Client* c, const PayloadRef& p) : client(c), payload(p), action(SEND) {}
+    OutboundItem(Client* c, Action a) : client(c), action(a) {}
+};
+
+struct OutboundBatch : public MpscNode {
+    std::vector<OutboundItem> items;
+};
+
+// Counters bumped by the reactor thread, readable from any thread
+struct ReactorStats {
+    Counter accepted;      // Connections accepted
+    Counter acceptFailed;  // accept() errors other than an empty queue (EMFILE, ENOBUFS, ...)
+    Counter throttled;     // Times a client ran out of flood tokens
+    Gauge throttledNow;    // Clients with lines held back right now
+    Counter excessFlood;   // Clients dropped for flooding
+    Counter recvqExceeded; // Clients dropped for unread input
+    Counter sendqExceeded; // Clients dropped for not reading
+    Histogram loopLatency; // One event-loop iteration, microseconds
+
+    ReactorStats();
+};
+
+// One event loop: a listening socket, the connections accepted on it and
+// their buffers. With a single reactor (the default) it runs on the main
+// thread and calls into Server directly. With --threads=N each reactor runs
+// its own thread and SO_REUSEPORT listener, and trades lines with the core
+// thread, which owns all IRC state, through lock-free MPSC queues.
+class Reactor {
+public:
+    Reactor(Server& server, int id, int listenFd, const ServerConfig& config);
+    ~Reactor();
+
+    void run();    // Event loop on the calling thread
+    void start();  // run() on a new thread
+    void stop();   // Any thread, signal handlers included; run() returns soon after
+    void join();
+    void resume(); // Clears a stop() so run() can be entered again
+
+    int getId() const;
+    const ReactorStats& getStats() const;
+    int getListenFd() const;
+
+    // Loop stopped, owner thread only: apply what the core posted and hand
+    // back what that caused (threaded shutdown and upgrade)
+    void settle();
+    // Shutdown: stop accepting, send every client an ERROR and give output
+    // until deadlineMs to reach the sockets. Returns connections cut short.
+    size_t drain(long deadlineMs);
+    // Upgrade: take over a connection restored from the old process
+    void adopt(Client* client);
+
+    // Owner thread only
+    void queueOutput(Client* client, const PayloadRef& payload);
+    void closeConnection(Client* client);
+    void attach(Client* client);         // A connection the core opened (an outgoing server link)
+    void markServerLink(Client* client); // No flood control; --link-sendq instead of --sendq
+
+    // Any thread: hand over output and close requests produced by the core
+    void post(OutboundBatch* batch);
+
+private:
+    Server& _server;
+    int _id;
+    int _listenFd;
+    Poller* _poller;
+    std::map<int, Client*> _connections;
+    std::vector<int> _pendingFlush; // Clients with replies queued this iteration
+    volatile int _running;
+    pthread_t _thread;
+    bool _threadStarted;
+
+    MpscQueue _inbox;
+    Notifier _notifier;
+    InboundBatch* _inbound; // Events collected for the core this iteration
+
+    FloodPolicy _flood;
+    std::vector<int> _throttled; // Clients whose next line waits for tokens
+    long _now;                   // Monotonic ms, refreshed after every wait
+    ReactorStats _stats;
+    size_t _recvqLimit; // Bytes of unprocessed input per connection
+    size_t _sendqLimit; // Bytes of queued output per connection
+    size_t _linkSendqLimit;
+
+    // Accept path
+    size_t _acceptBatch;  // accept() calls per turn of the loop
+    bool _acceptPending;  // The last turn hit _acceptBatch; more are likely queued
+    bool _acceptFailing;  // Logged the current run of accept() errors
+    bool _tcpNoDelay;
+    int _sendBuffer;      // 0: kernel default
+    int _receiveBuffer;
+
+    // --backend=io_uring; NULL on the readiness backends
+    IoUring* _uring;
+    bool _uringActive;    // Connections are on the ring, not in _poller
+    bool _uringStopping;  // Everything is being cancelled; nothing is re-armed
+    size_t _uringPending; // Requests still to post their final completion
+    std::vector<UringSend*> _spareSends;
+
+    void handleNewConnection();
+    int acceptConnection(struct sockaddr_in& address);
+    void reportAcceptError(int error);
+    void addConnection(int fd, const struct sockaddr_in& address);
+    void tuneConnection(int fd);
+    void watch(Client* client);
+    void unwatch(Client* client);
+    void handleClientData(Client* client);
+    bool handleInput(Client* client);
+    bool processBufferedLines(Client* client);
+    bool isFloodLimited(Client* client) const;
+    bool throttle(Client* client);
+    void serviceThrottled();
+    int nextTimeout() const;
+    void handleClientWrite(Client* client);
+    void flushPendingOutput();
+    bool flushClient(Client* client);
+    void drainClient(Client* client);
+    void drainInbox();
+
+    void runUring();
+    void startUring();
+    void stopUring();
+    void armAccept();
+    void armNotifier();
+    void armRecv(Client* client);
+    void sendUring(Client* client);
+    void handleCompletion(const IoCompletion& completion);
+    void handleUringAccept(const IoCompletion& completion);
+    void handleUringRecv(const IoCompletion& completion);
+    void handleUringSend(const IoCompletion& completion);
+
+    bool isConnected(int fd, Client* client) const;
+    void deliver(InboundEvent::Type type, Client* client, const char* line, size_t length);
+    void reportDisconnect(Client* client, const std::string& reason = std::string());
+    void dropConnection(Client* client, const std::string& reason);
+    void postInbound();
+
+    static void* threadMain(void* arg);
+
+    Reactor();
+    Reactor(const Reactor&);
+    Reactor& operator=(const Reactor&);
+};
+
+#endif // REACTOR_HPP
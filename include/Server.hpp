@@ -4,59 +4,260 @@
 #include <string>
 #include <vector>
 #include <map>
-#include <poll.h>
 #include "Client.hpp"
 #include "Channel.hpp"
+#include "Config.hpp"
+#include "Reactor.hpp"
+#include "MpscQueue.hpp"
+#include "HashMap.hpp"
+#include "IrcString.hpp"
+#include "MessageView.hpp"
+#include "CommandTable.hpp"
+#include "Metrics.hpp"
+#include "Network.hpp"
+#include "ChannelStore.hpp"
+
+class AdminListener;
 
 class Server {
 public:
-    Server(int port, const std::string& password);
+    Server(int port, const std::string& password, const ServerConfig& config);
     ~Server();
 
     void run();
 
+    // How run() should end; set from signal handlers, so async-signal-safe
+    enum StopMode {
+        STOP_NONE,
+        STOP_DRAIN,  // Flush output to every client, then close (SIGTERM, SIGINT)
+        STOP_UPGRADE // Hand every connection to a newly exec'd binary (SIGUSR2)
+    };
+    void requestStop(StopMode mode);
+
 private:
     // Server Info
     int _port;
     std::string _password;
-    int _serverSocket;
     std::string _serverName;
     time_t _startTime;
+    ServerConfig _config;
 
     // Client/Channel Management
     std::map<int, Client*> _clients;
     std::map<std::string, Channel*> _channels;
-    std::vector<struct pollfd> _pollfds;
+    HashMap<std::string, Client*, IrcCaseHash, IrcCaseEqual> _nickIndex; // Keyed by nick, RFC 1459 case-insensitive
+
+    // --channel-db: every channel's settings go to disk as they change.
+    // Those of channels that existed when the server last stopped wait
+    // here until each channel is created again.
+    ChannelStore _channelStore;
+    std::map<std::string, ChannelSettings> _savedChannels;
+
+    // Network: other servers and their users (ServerLink.cpp). Remote users
+    // are Clients without a connection, members of channels like any other.
+    std::map<std::string, RemoteServer*> _servers; // By SID
+    HashMap<std::string, Client*, IrcCaseHash, IrcCaseEqual> _uidIndex; // Every registered user, local or remote
+    std::vector<Client*> _links;          // Established direct links
+    std::vector<LinkTarget> _linkTargets; // --link
+    unsigned long _nextUid;
+    unsigned long _nextBatch; // BATCH references for CHATHISTORY replies
+
+    // Event Loops: one reactor per I/O thread. With more than one, this
+    // thread becomes the core that owns all IRC state and trades batches
+    // with the reactors through lock-free queues.
+    std::vector<Reactor*> _reactors;
+    bool _threaded;
+    MpscQueue _inbox;                     // InboundBatch from the reactors
+    Notifier _notifier;
+    std::vector<OutboundBatch*> _outbound; // Per reactor, posted after each batch
+
+    // Metrics: updated on the core thread, read by STATS and the admin port
+    ServerMetrics _metrics;
+    size_t _outputSlot;        // Metrics slot charged for output right now
+    unsigned long _registered; // Clients that completed registration
+    AdminListener* _admin;     // Optional Prometheus endpoint
+
+    // Shutdown
+    volatile int _stopMode;         // StopMode
+    volatile size_t _reactorsReady; // Reactors a signal handler may stop()
 
     // Core Loop
     void setup();
+    int createListener(bool reusePort);
+    void startListening(int listenFd);
+    void startAdmin();
     void mainLoop();
-    void handleNewConnection();
-    void handleClientData(int clientFd);
-    void removeClient(int clientFd);
+    void runLoops();
+    void removeClient(int clientFd, const std::string& reason);
+    void detachClient(Client* client);
+    void partChannel(Channel* channel, Client* client);
+    void releaseClient(Client* client);
+    void postToReactor(Client* client, OutboundItem::Action action);
+
+    // Called by the reactors (directly, or through the core's inbox)
+    friend class Reactor;
+    bool isThreaded() const;
+    void onConnect(Client* client);
+    void onLine(Client* client, char* line, size_t length);
+    void onDisconnect(Client* client, const std::string& reason);
+    void postInbound(InboundBatch* batch);
+    void processInbound(InboundBatch* batch);
+    void postOutbound();
+    long timerDelayMs() const; // Until runTimers() has work; -1 for none
+    void runTimers();
+
+    // Metrics
+    friend class AdminListener;
+    void updateGauges();
+    std::string renderMetrics() const; // Any thread
+    std::vector<std::string> describeRuntime() const;
+
+    // Shutdown and Upgrade (ServerUpgrade.cpp)
+    void settle();
+    void drain();
+    bool handOff();
+    size_t receiveUpgrade(std::vector<int>& fds, std::string& image);
+    void restoreState(const std::vector<int>& fds, const std::string& image);
 
     // Command Processing
-    void processCommand(Client* client, const std::string& message);
+    void processCommand(Client* client, CommandId id, const MessageView& message);
+    void registerClient(Client* client);
+    void sendIsupport(Client* client);
+
+    // Dispatch table, indexed by CommandId. Access and parameter count are
+    // checked once in processCommand before the handler runs.
+    typedef void (Server::*CommandHandler)(Client*, const MessageView&);
+    struct CommandSpec {
+        const char* name;
+        CommandHandler handler;
+        size_t minParams;
+        CommandAccess access;
+    };
+    static const CommandSpec _commandTable[CMD_COUNT];
+    static const size_t MAX_TARGETS = 20; // PRIVMSG recipients per line, advertised as TARGMAX
+    static const size_t NICKLEN = 30;     // Advertised as NICKLEN
+    static bool isValidNick(const std::string& nick);
 
     // Command Handlers
-    void cmdPass(Client* client, const std::vector<std::string>& args);
-    void cmdNick(Client* client, const std::vector<std::string>& args);
-    void cmdUser(Client* client, const std::vector<std::string>& args);
-    void cmdPrivmsg(Client* client, const std::vector<std::string>& args);
-    void cmdJoin(Client* client, const std::vector<std::string>& args);
-    void cmdPart(Client* client, const std::vector<std::string>& args);
-    void cmdTopic(Client* client, const std::vector<std::string>& args);
-    void cmdKick(Client* client, const std::vector<std::string>& args);
-    void cmdInvite(Client* client, const std::vector<std::string>& args);
-    void cmdMode(Client* client, const std::vector<std::string>& args);
-    void cmdQuit(Client* client, const std::vector<std::string>& args);
+    void cmdPass(Client* client, const MessageView& args);
+    void cmdNick(Client* client, const MessageView& args);
+    void cmdUser(Client* client, const MessageView& args);
+    void cmdPrivmsg(Client* client, const MessageView& args);
+    void cmdJoin(Client* client, const MessageView& args);
+    void joinChannel(Client* client, const std::string& channelName, const std::string& key);
+    void cmdPart(Client* client, const MessageView& args);
+    void cmdTopic(Client* client, const MessageView& args);
+    void cmdKick(Client* client, const MessageView& args);
+    void cmdInvite(Client* client, const MessageView& args);
+    void cmdMode(Client* client, const MessageView& args);
+    void cmdQuit(Client* client, const MessageView& args);
+    void cmdPing(Client* client, const MessageView& args);
+    void cmdPong(Client* client, const MessageView& args);
+    void cmdStats(Client* client, const MessageView& args);
+    void cmdChathistory(Client* client, const MessageView& args);
+    void cmdNames(Client* client, const MessageView& args);
+    void cmdServer(Client* client, const MessageView& args);
+    void cmdError(Client* client, const MessageView& args);
+
+    // Channel modes as applied, for the MODE line and the other servers
+    struct ModeChange {
+        std::string modes;      // "+o-t"
+        std::string params;     // " nick", with a leading space
+        std::string linkParams; // The same with UIDs for nicks
+    };
+    void applyChannelModes(Channel* channel, const MessageView& args, size_t first, bool byUid, ModeChange& change);
+
+    // Channel database
+    void openChannelStore();
+    void saveChannel(Channel* channel);
+    void forgetChannel(const std::string& name);
+    void reviveChannel(Channel* channel);
+    bool revivalAdmits(Client* client, const std::string& name, const std::string& key);
+
+    // Channel names (RPL_NAMREPLY)
+    void sendNames(Client* client, Channel* channel);
+    void renamedMember(Client* client);
+
+    // --- Server Links (ServerLink.cpp) ---
+    // Who a server-to-server line comes from: a remote user and its
+    // server, or just a server
+    struct LinkSource {
+        Client* user;
+        RemoteServer* server;
+    };
+    typedef void (Server::*LinkHandler)(Client*, const LinkSource&, const MessageView&);
+    struct LinkSpec {
+        LinkHandler handler; // NULL: ignored on links
+        size_t minParams;
+        bool userSource;     // Dropped unless it comes from a known remote user
+    };
+    static const LinkSpec _linkTable[CMD_COUNT];
+
+    // Connections
+    void connectLink(LinkTarget& target);
+    LinkTarget* findLinkTarget(Client* connection);
+    void startHandshake(Client* connection);
+    void establishLink(Client* link, const std::string& name, const std::string& sid, const std::string& description);
+    void sendBurst(Client* link);
+    void closeLink(Client* connection, const std::string& reason);
+    void closeLinks(const std::string& reason);
+    void splitLink(Client* link, const std::string& reason);
+    void removeServer(RemoteServer* server);
+    void removeRemoteUser(Client* user);
+    void clearNetwork();
+
+    // Identity and routing
+    std::string nextUid();
+    std::string uidLine(Client* user) const;
+    void introduceUser(Client* client);
+    void announceNick(Client* client);
+    void announceJoin(Client* client, Channel* channel, bool created);
+    void announceMode(Client* client, Channel* channel, const ModeChange& change);
+    void killUser(Client* user, const std::string& reason, Client* except);
+    bool resolveCollision(Client* holder, time_t ts);
+    bool adoptChannelTs(Channel* channel, time_t ts);
+    void sendToLinks(const LineBuilder& line, Client* except = NULL);
+    void sendToServer(RemoteServer* server, const LineBuilder& line);
+    void relayToChannel(Channel* channel, const LineBuilder& line, Client* except = NULL);
+    void forward(Client* link, const MessageView& message);
+    RemoteServer* findServer(const std::string& sid);
+    RemoteServer* findServerByName(const std::string& name);
+    Client* findClientByUid(const std::string& uid);
+
+    // Lines from established links
+    void processLinkCommand(Client* link, CommandId id, const MessageView& message);
+    void linkNick(Client* link, const LinkSource& source, const MessageView& args);
+    void linkQuit(Client* link, const LinkSource& source, const MessageView& args);
+    void linkPing(Client* link, const LinkSource& source, const MessageView& args);
+    void linkPrivmsg(Client* link, const LinkSource& source, const MessageView& args);
+    void linkJoin(Client* link, const LinkSource& source, const MessageView& args);
+    void linkPart(Client* link, const LinkSource& source, const MessageView& args);
+    void linkTopic(Client* link, const LinkSource& source, const MessageView& args);
+    void linkKick(Client* link, const LinkSource& source, const MessageView& args);
+    void linkInvite(Client* link, const LinkSource& source, const MessageView& args);
+    void linkSid(Client* link, const LinkSource& source, const MessageView& args);
+    void linkUid(Client* link, const LinkSource& source, const MessageView& args);
+    void linkSjoin(Client* link, const LinkSource& source, const MessageView& args);
+    void linkTmode(Client* link, const LinkSource& source, const MessageView& args);
+    void linkTb(Client* link, const LinkSource& source, const MessageView& args);
+    void linkEob(Client* link, const LinkSource& source, const MessageView& args);
+    void linkSquit(Client* link, const LinkSource& source, const MessageView& args);
+    void linkKill(Client* link, const LinkSource& source, const MessageView& args);
+    void linkError(Client* link, const LinkSource& source, const MessageView& args);
 
 
     // Utility
-    void sendReply(Client* client, const std::string& reply);
+    void sendReply(Client* client, const LineBuilder& reply);
+    void sendPayload(Client* client, const PayloadRef& payload);
+    PayloadRef broadcast(Channel* channel, const LineBuilder& message, Client* except = NULL);
+    void broadcastQuit(Client* client, const std::string& reason);
+    void broadcastNick(Client* client, const std::string& nick);
     void sendNumericReply(Client* client, const std::string& code, const std::string& message);
     Client* findClientByNick(const std::string& nick);
 
+    // Microbenchmarks (make microbench) drive the command path without sockets
+    friend class MicroBench;
+
     // Private constructor/assignment
     Server();
     Server(const Server&);
@@ -0,0 +1,58 @@
+#ifndef SLABPOOL_HPP
+#define SLABPOOL_HPP
+
+#include <cstddef>
+#include <vector>
+
+// Fixed-size blocks carved out of large slabs and recycled through a free
+// list instead of going back to the heap. Slabs are kept for the life of
+// the process, so reconnect storms reuse the same memory rather than
+// fragmenting malloc's arenas. Any thread may allocate or free; a short
+// spinlock guards the free list.
+class SlabPool {
+public:
+    SlabPool(const char* name, size_t blockSize, size_t slabBytes = 64 * 1024);
+    ~SlabPool();
+
+    void* allocate();
+    void deallocate(void* block);
+
+    const char* name() const;
+    size_t blockSize() const;
+    size_t blocksInUse() const;    // Any thread
+    size_t blocksReserved() const; // Any thread
+
+    // Every pool created so far, for STATS and the metrics endpoint
+    static size_t poolCount();
+    static const SlabPool* pool(size_t index); // NULL while still registering
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    static const size_t MAX_POOLS = 16;
+    static const SlabPool* volatile _registry[MAX_POOLS];
+    static volatile size_t _registered;
+
+    const char* _name;
+    size_t _blockSize;
+    size_t _blocksPerSlab;
+    FreeBlock* _free;          // Blocks handed back
+    char* _carve;              // Never-used tail of the newest slab
+    char* _carveEnd;
+    std::vector<char*> _slabs;
+    volatile size_t _inUse;
+    volatile size_t _reserved;
+    bool _locked;
+
+    void lock();
+    void unlock();
+    void grow();
+
+    SlabPool();
+    SlabPool(const SlabPool&);
+    SlabPool& operator=(const SlabPool&);
+};
+
+#endif // SLABPOOL_HPP
@@ -0,0 +1,63 @@
+#ifndef UPGRADE_HPP
+#define UPGRADE_HPP
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// Binary upgrade plumbing. The running server execs the new binary with
+// one end of a SOCK_SEQPACKET socketpair, then sends its listening and
+// client sockets over it (SCM_RIGHTS) together with a serialized image of
+// the IRC state. The new process answers with one byte once it is ready.
+
+// Flat binary encoding of the state image, also used by the channel
+// database
+class StateWriter {
+public:
+    void putNumber(unsigned long value); // 8 bytes, little-endian
+    void putString(const std::string& value);
+    const std::string& data() const;
+
+private:
+    std::string _data;
+};
+
+// Throws std::runtime_error when the image is cut short
+class StateReader {
+public:
+    explicit StateReader(const std::string& data);
+    StateReader(const char* data, size_t length); // Must outlive the reader
+
+    unsigned long getNumber();
+    std::string getString();
+    bool atEnd() const;
+
+private:
+    const char* _data;
+    size_t _length;
+    size_t _pos;
+
+    void need(size_t bytes) const;
+};
+
+class Upgrade {
+public:
+    // Runs path with command as its argv and --upgrade-fd=N appended.
+    // Returns the child's pid and sets sock to the parent's end of the
+    // handoff socket.
+    static pid_t spawn(const std::string& path, const std::vector<std::string>& command, int& sock);
+
+    // Old process: sockets first, then the image. Throws on I/O errors.
+    static void sendState(int sock, const std::vector<int>& fds, const std::string& image);
+    // New process: the counterpart of sendState
+    static void receiveState(int sock, std::vector<int>& fds, std::string& image);
+
+    // The new process is up; waitReady returns false on EOF or timeout
+    static void signalReady(int sock);
+    static bool waitReady(int sock, int timeoutMs);
+
+private:
+    Upgrade();
+};
+
+#endif // UPGRADE_HPP
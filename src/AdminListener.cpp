@@ -0,0 +1,121 @@
+#include "AdminListener.hpp"
+#include "Server.hpp"
+#include "Logger.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <sstream>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <poll.h>
+
+// A scrape that doesn't send its request within this long is dropped
+static const int REQUEST_TIMEOUT_SEC = 2;
+static const size_t MAX_REQUEST = 4096;
+
+AdminListener::AdminListener(Server& server, int port)
+    : _server(server), _listenFd(-1), _running(0), _threadStarted(false) {
+    _listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (_listenFd < 0) throw std::runtime_error("Failed to create admin socket");
+
+    int opt = 1;
+    setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    if (bind(_listenFd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(_listenFd, 8) < 0) {
+        close(_listenFd);
+        throw std::runtime_error("Failed to bind admin port");
+    }
+}
+
+AdminListener::~AdminListener() {
+    if (_threadStarted) {
+        __atomic_store_n(&_running, 0, __ATOMIC_SEQ_CST);
+        _stop.notify();
+        pthread_join(_thread, NULL);
+    }
+    close(_listenFd);
+}
+
+void AdminListener::start() {
+    __atomic_store_n(&_running, 1, __ATOMIC_SEQ_CST);
+    if (pthread_create(&_thread, NULL, &AdminListener::threadMain, this) != 0)
+        throw std::runtime_error("Failed to start admin thread");
+    _threadStarted = true;
+}
+
+void* AdminListener::threadMain(void* arg) {
+    static_cast<AdminListener*>(arg)->serve();
+    return NULL;
+}
+
+void AdminListener::serve() {
+    struct pollfd fds[2];
+    fds[0].fd = _listenFd;
+    fds[0].events = POLLIN;
+    fds[1].fd = _stop.fd();
+    fds[1].events = POLLIN;
+
+    while (__atomic_load_n(&_running, __ATOMIC_SEQ_CST)) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            LOG(LOG_ERROR, LOG_SERVER, "Admin listener stopped: poll failed");
+            return;
+        }
+        if (!(fds[0].revents & POLLIN)) continue;
+
+        int fd = accept(_listenFd, NULL, NULL);
+        if (fd < 0) continue;
+        handleRequest(fd);
+        close(fd);
+    }
+}
+
+// Minimal HTTP/1.0: read the request head, answer GET /metrics, close.
+void AdminListener::handleRequest(int fd) {
+    struct timeval timeout;
+    timeout.tv_sec = REQUEST_TIMEOUT_SEC;
+    timeout.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.length() < MAX_REQUEST) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) return;
+        request.append(buffer, n);
+    }
+
+    std::string status = "200 OK";
+    std::string body;
+    if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 6, "GET / ") == 0) {
+        body = _server.renderMetrics();
+    } else {
+        status = "404 Not Found";
+        body = "Not found\n";
+    }
+
+    std::ostringstream response;
+    response << "HTTP/1.0 " << status << "\r\n"
+             << "Content-Type: text/plain; version=0.0.4\r\n"
+             << "Content-Length: " << body.length() << "\r\n"
+             << "Connection: close\r\n\r\n"
+             << body;
+    std::string data = response.str();
+
+    size_t sent = 0;
+    while (sent < data.length()) {
+        ssize_t n = send(fd, data.data() + sent, data.length() - sent, 0);
+        if (n <= 0) return;
+        sent += n;
+    }
+}
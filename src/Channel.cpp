@@ -1,69 +1,132 @@
 #include "Channel.hpp"
-#include <algorithm> // for std::find
+#include "SlabPool.hpp"
+
+static SlabPool& channelPool() {
+    static SlabPool* pool = new SlabPool("channel", sizeof(Channel));
+    return *pool;
+}
+
+void* Channel::operator new(size_t size) {
+    if (size != sizeof(Channel)) return ::operator new(size);
+    return channelPool().allocate();
+}
+
+void Channel::operator delete(void* block, size_t size) {
+    if (size != sizeof(Channel)) ::operator delete(block);
+    else channelPool().deallocate(block);
+}
 
 Channel::Channel(const std::string& name, Client* creator)
     : _name(name),
       _topic(""),
       _key(""),
+      _topicTime(0),
+      _createdAt(time(NULL)),
+      _namesValid(false),
       _inviteOnly(false),
       _topicRestricted(true),
       _userLimit(0) {
-    _clients.push_back(creator);
-    _operators.push_back(creator);
+    addClient(creator);
+    addOperator(creator);
 }
 
-Channel::~Channel() {}
+Channel::~Channel() {
+    // Don't leave clients pointing at a deleted channel
+    for (size_t i = 0; i < _table.capacity(); ++i) {
+        if (!_table.occupied(i)) continue;
+        Client* client = _table.keyAt(i);
+        client->removeChannel(this);
+        client->removeInvite(this);
+    }
+}
 
 // --- Basic Info ---
 const std::string& Channel::getName() const { return _name; }
 const std::string& Channel::getTopic() const { return _topic; }
-void Channel::setTopic(const std::string& topic) { _topic = topic; }
+time_t Channel::getTopicTime() const { return _topicTime; }
+time_t Channel::getCreatedAt() const { return _createdAt; }
+void Channel::setCreatedAt(time_t ts) { _createdAt = ts; }
+
+void Channel::setTopic(const std::string& topic, time_t when) {
+    _topic = topic;
+    _topicTime = when;
+}
 
 // --- Member Management ---
 bool Channel::addClient(Client* client) {
-    if (isClientInChannel(client)) {
+    MemberEntry* entry = _table.find(client);
+    if (!entry) {
+        _table.insert(client, MemberEntry());
+        entry = _table.find(client);
+    }
+    if (entry->flags & MEMBER_JOINED) {
         return false; // Already in channel
     }
-    _clients.push_back(client);
+    entry->flags |= MEMBER_JOINED;
+    entry->index = _members.size();
+    _members.push_back(client);
+    client->addChannel(this);
+    if (_namesValid) appendName(client); // Joins come last in member order too
     return true;
 }
 
 void Channel::removeClient(Client* client) {
-    removeOperator(client); // Ensure they are removed from operator list as well
-    removeInvite(client);   // And from invited list
+    // Drops operator status and any pending invite as well
+    clearFlags(client, MEMBER_JOINED | MEMBER_OPERATOR | MEMBER_INVITED);
+}
 
-    std::vector<Client*>::iterator it = std::find(_clients.begin(), _clients.end(), client);
-    if (it != _clients.end()) {
-        _clients.erase(it);
-    }
+bool Channel::isClientInChannel(Client* client) const {
+    return hasFlag(client, MEMBER_JOINED);
 }
 
+const std::vector<Client*>& Channel::getMembers() const { return _members; }
+size_t Channel::getMemberCount() const { return _members.size(); }
 
-bool Channel::isClientInChannel(Client* client) const {
-    return std::find(_clients.begin(), _clients.end(), client) != _clients.end();
+bool Channel::hasFlag(Client* client, unsigned int flag) const {
+    const MemberEntry* entry = _table.find(client);
+    return entry && (entry->flags & flag);
 }
 
-std::vector<Client*> Channel::getClients() const {
-    return _clients;
+void Channel::clearFlags(Client* client, unsigned int flags) {
+    MemberEntry* entry = _table.find(client);
+    if (!entry) return;
+
+    if (flags & entry->flags & (MEMBER_JOINED | MEMBER_OPERATOR)) {
+        forgetNames(); // Removals reorder the members
+    }
+    if ((flags & MEMBER_JOINED) && (entry->flags & MEMBER_JOINED)) {
+        // Swap-remove from the dense list and fix the moved member's index
+        Client* last = _members.back();
+        _members[entry->index] = last;
+        _table.find(last)->index = entry->index;
+        _members.pop_back();
+        client->removeChannel(this);
+    }
+    if (flags & entry->flags & MEMBER_INVITED) {
+        client->removeInvite(this);
+    }
+    entry->flags &= ~flags;
+    if (entry->flags == 0) {
+        _table.erase(client);
+    }
 }
 
 
 // --- Operator Management ---
 bool Channel::isOperator(Client* client) const {
-    return std::find(_operators.begin(), _operators.end(), client) != _operators.end();
+    return hasFlag(client, MEMBER_OPERATOR);
 }
 
 void Channel::addOperator(Client* client) {
-    if (isClientInChannel(client) && !isOperator(client)) {
-        _operators.push_back(client);
+    MemberEntry* entry = _table.find(client);
+    if (entry && (entry->flags & MEMBER_JOINED) && !(entry->flags & MEMBER_OPERATOR)) {
+        entry->flags |= MEMBER_OPERATOR;
+        forgetNames();
     }
 }
 
 void Channel::removeOperator(Client* client) {
-    std::vector<Client*>::iterator it = std::find(_operators.begin(), _operators.end(), client);
-    if (it != _operators.end()) {
-        _operators.erase(it);
-    }
+    clearFlags(client, MEMBER_OPERATOR);
 }
 
 // --- Mode Management ---
@@ -101,18 +164,42 @@ std::string Channel::getModesString() const {
 
 // --- Invite Management ---
 void Channel::addInvite(Client* client) {
-    if (!isInvited(client)) {
-        _invitedUsers.push_back(client);
+    MemberEntry* entry = _table.find(client);
+    if (!entry) {
+        _table.insert(client, MemberEntry());
+        entry = _table.find(client);
     }
+    entry->flags |= MEMBER_INVITED;
+    client->addInvite(this);
 }
 
 bool Channel::isInvited(Client* client) {
-    return std::find(_invitedUsers.begin(), _invitedUsers.end(), client) != _invitedUsers.end();
+    return hasFlag(client, MEMBER_INVITED);
 }
 
 void Channel::removeInvite(Client* client) {
-    std::vector<Client*>::iterator it = std::find(_invitedUsers.begin(), _invitedUsers.end(), client);
-    if (it != _invitedUsers.end()) {
-        _invitedUsers.erase(it);
+    clearFlags(client, MEMBER_INVITED);
+}
+
+// --- Names ---
+const std::string& Channel::getNames() {
+    if (!_namesValid) {
+        _names.clear();
+        for (size_t i = 0; i < _members.size(); ++i) {
+            appendName(_members[i]);
+        }
+        _namesValid = true;
     }
+    return _names;
+}
+
+void Channel::forgetNames() { _namesValid = false; }
+
+void Channel::appendName(Client* client) {
+    if (!_names.empty()) _names += ' ';
+    if (isOperator(client)) _names += '@';
+    _names += client->getNickname();
 }
+
+// --- History ---
+ChannelHistory& Channel::getHistory() { return _history; }
@@ -0,0 +1,131 @@
+#include "ChannelHistory.hpp"
+#include <ctime>
+#include <sys/time.h>
+
+size_t ChannelHistory::_lineLimit = 0;
+size_t ChannelHistory::_byteLimit = 0;
+size_t ChannelHistory::_memoryLimit = 0;
+size_t ChannelHistory::_memoryUsed = 0;
+size_t ChannelHistory::_events = 0;
+unsigned long ChannelHistory::_nextMsgid = 0;
+long long ChannelHistory::_lastTimeMs = 0;
+HistoryEvent* ChannelHistory::_oldest = NULL;
+HistoryEvent* ChannelHistory::_newest = NULL;
+
+static const size_t INITIAL_RING = 8;
+
+static size_t costOf(const HistoryEvent* event) {
+    return sizeof(HistoryEvent) + event->line.length();
+}
+
+void ChannelHistory::configure(size_t lines, size_t bytes, size_t memory) {
+    _lineLimit = lines;
+    _byteLimit = bytes;
+    _memoryLimit = memory;
+    // Ids carry on from the last run's, so a client's reference from
+    // before a restart never names a different message
+    _nextMsgid = static_cast<unsigned long>(time(NULL)) * 1000000UL;
+}
+
+bool ChannelHistory::enabled() { return _lineLimit > 0; }
+size_t ChannelHistory::memoryUsed() { return _memoryUsed; }
+size_t ChannelHistory::eventCount() { return _events; }
+
+ChannelHistory::ChannelHistory() : _head(0), _count(0), _bytes(0) {}
+
+ChannelHistory::~ChannelHistory() {
+    while (_count > 0) {
+        dropOldest();
+    }
+}
+
+void ChannelHistory::record(const PayloadRef& line) {
+    if (!enabled()) return;
+    if (_count == _lineLimit) dropOldest();
+    if (_count == _ring.size()) grow();
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    HistoryEvent* event = new HistoryEvent();
+    event->msgid = _nextMsgid++;
+    event->timeMs = now.tv_sec * 1000LL + now.tv_usec / 1000;
+    if (event->timeMs < _lastTimeMs) event->timeMs = _lastTimeMs;
+    _lastTimeMs = event->timeMs;
+    event->line = line;
+    event->owner = this;
+    event->older = _newest;
+    event->newer = NULL;
+    if (_newest) _newest->newer = event;
+    else _oldest = event;
+    _newest = event;
+
+    _ring[(_head + _count) % _ring.size()] = event;
+    ++_count;
+    size_t cost = costOf(event);
+    _bytes += cost;
+    _memoryUsed += cost;
+    ++_events;
+
+    while (_count > 1 && _bytes > _byteLimit) {
+        dropOldest();
+    }
+    while (_memoryUsed > _memoryLimit && _oldest) {
+        _oldest->owner->dropOldest(); // Always that channel's oldest too
+    }
+}
+
+void ChannelHistory::dropOldest() {
+    HistoryEvent* event = _ring[_head];
+    _ring[_head] = NULL;
+    _head = (_head + 1) % _ring.size();
+    --_count;
+
+    if (event->older) event->older->newer = event->newer;
+    else _oldest = event->newer;
+    if (event->newer) event->newer->older = event->older;
+    else _newest = event->older;
+
+    size_t cost = costOf(event);
+    _bytes -= cost;
+    _memoryUsed -= cost;
+    --_events;
+    delete event;
+}
+
+// Doubles the ring up to the line limit, oldest event first again
+void ChannelHistory::grow() {
+    size_t capacity = _ring.empty() ? INITIAL_RING : _ring.size() * 2;
+    if (capacity > _lineLimit) capacity = _lineLimit;
+    std::vector<HistoryEvent*> ring(capacity, static_cast<HistoryEvent*>(NULL));
+    for (size_t i = 0; i < _count; ++i) {
+        ring[i] = _ring[(_head + i) % _ring.size()];
+    }
+    _ring.swap(ring);
+    _head = 0;
+}
+
+size_t ChannelHistory::size() const { return _count; }
+
+const HistoryEvent& ChannelHistory::at(size_t index) const {
+    return *_ring[(_head + index) % _ring.size()];
+}
+
+size_t ChannelHistory::firstFrom(unsigned long msgid) const {
+    size_t low = 0, high = _count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (at(mid).msgid < msgid) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+size_t ChannelHistory::firstAt(long long timeMs) const {
+    size_t low = 0, high = _count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (at(mid).timeMs < timeMs) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
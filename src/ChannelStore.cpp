@@ -0,0 +1,315 @@
+#include "ChannelStore.hpp"
+#include "Upgrade.hpp"
+#include "Logger.hpp"
+#include "Clock.hpp"
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// First bytes of both files; bump the number when the layout changes
+static const char MAGIC[] = "ircchan1";
+static const size_t MAGIC_LENGTH = 8;
+// Record frame: payload length and checksum, 4 bytes each, little-endian
+static const size_t FRAME_HEADER = 8;
+static const size_t RECORD_MAX = 1 << 20;
+
+enum RecordType {
+    RECORD_SAVE = 1,
+    RECORD_FORGET = 2
+};
+
+// FNV-1a: catches a torn or half-written tail, not tampering
+static unsigned int checksum(const char* data, size_t length) {
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+    }
+    return hash;
+}
+
+static void putWord(std::string& out, unsigned int value) {
+    for (int i = 0; i < 4; ++i) {
+        out += static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+}
+
+static unsigned int getWord(const char* data) {
+    unsigned int value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= static_cast<unsigned int>(static_cast<unsigned char>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+static std::string frame(const std::string& payload) {
+    std::string out;
+    out.reserve(FRAME_HEADER + payload.length());
+    putWord(out, payload.length());
+    putWord(out, checksum(payload.data(), payload.length()));
+    out += payload;
+    return out;
+}
+
+static bool writeAll(int fd, const std::string& data) {
+    size_t done = 0;
+    while (done < data.length()) {
+        ssize_t written = write(fd, data.data() + done, data.length() - done);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        done += written;
+    }
+    return true;
+}
+
+// Applies the records of a mapped file to channels (settings) or latest
+// (records as stored), whichever is given. Returns how many bytes of it are
+// whole records; the rest is a torn tail.
+//
+// A snapshot is sorted by name, so each insert lands at the end of the map
+// and the hint makes it constant time.
+static size_t replay(const char* data, size_t length, std::map<std::string, ChannelSettings>* channels,
+                     std::map<std::string, std::string>* latest) {
+    size_t pos = MAGIC_LENGTH;
+    while (length - pos >= FRAME_HEADER) {
+        size_t size = getWord(data + pos);
+        const char* payload = data + pos + FRAME_HEADER;
+        if (size > RECORD_MAX || length - pos - FRAME_HEADER < size) break;
+        if (getWord(data + pos + 4) != checksum(payload, size)) break;
+
+        StateReader record(payload, size);
+        unsigned long type = record.getNumber();
+        std::string name = record.getString();
+        if (type == RECORD_SAVE && channels) {
+            ChannelSettings& settings = channels->insert(channels->end(), std::make_pair(name, ChannelSettings()))->second;
+            settings.name = name;
+            settings.createdAt = record.getNumber();
+            settings.topic = record.getString();
+            settings.topicTime = record.getNumber();
+            settings.key = record.getString();
+            settings.inviteOnly = record.getNumber() != 0;
+            settings.topicRestricted = record.getNumber() != 0;
+            settings.userLimit = static_cast<int>(record.getNumber());
+        } else if (type == RECORD_SAVE) {
+            latest->insert(latest->end(), std::make_pair(name, std::string()))->second.assign(data + pos, FRAME_HEADER + size);
+        } else if (channels) {
+            channels->erase(name);
+        } else {
+            latest->erase(name);
+        }
+        pos += FRAME_HEADER + size;
+    }
+    return pos;
+}
+
+// Replays path; returns the length of the valid part, or 0 for an empty
+// file
+static size_t load(const std::string& path, int fd, std::map<std::string, ChannelSettings>* channels,
+                   std::map<std::string, std::string>* latest, size_t& length) {
+    struct stat info;
+    if (fstat(fd, &info) < 0) throw std::runtime_error("Failed to stat " + path + ": " + strerror(errno));
+    length = info.st_size;
+    if (length == 0) return 0;
+
+    void* map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) throw std::runtime_error("Failed to map " + path + ": " + strerror(errno));
+    const char* data = static_cast<const char*>(map);
+    size_t valid = 0;
+    // Shorter than the magic: a crash while the file was being started
+    bool known = std::memcmp(data, MAGIC, std::min(length, MAGIC_LENGTH)) == 0;
+    if (known && length >= MAGIC_LENGTH) valid = replay(data, length, channels, latest);
+    munmap(map, length);
+    if (!known) throw std::runtime_error(path + " is not a channel database");
+    return valid;
+}
+
+ChannelStore::ChannelStore()
+    : _compactBytes(0), _journalFd(-1), _journalBytes(0), _latestComplete(false), _threadStarted(false), _running(0) {}
+
+ChannelStore::~ChannelStore() {
+    close();
+}
+
+bool ChannelStore::isOpen() const { return _journalFd >= 0; }
+
+void ChannelStore::open(const std::string& path, size_t compactBytes, std::map<std::string, ChannelSettings>& channels) {
+    long started = monotonicMs();
+    _path = path;
+    _compactBytes = compactBytes;
+
+    size_t length;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        try {
+            size_t valid = load(path, fd, &channels, NULL, length);
+            if (valid != length) LOG(LOG_WARN, LOG_SERVER, path << " has trailing garbage; ignored");
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+        ::close(fd);
+    } else if (errno != ENOENT) {
+        throw std::runtime_error("Failed to open " + path + ": " + strerror(errno));
+    }
+
+    std::string journal = path + ".journal";
+    _journalFd = ::open(journal.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (_journalFd < 0) throw std::runtime_error("Failed to open " + journal + ": " + strerror(errno));
+    _journalBytes = load(journal, _journalFd, &channels, NULL, length);
+    if (_journalBytes == 0) {
+        if (ftruncate(_journalFd, 0) < 0 || !writeAll(_journalFd, std::string(MAGIC, MAGIC_LENGTH)))
+            throw std::runtime_error("Failed to write " + journal + ": " + strerror(errno));
+        _journalBytes = MAGIC_LENGTH;
+    } else if (_journalBytes != length) {
+        LOG(LOG_WARN, LOG_SERVER, journal << " ends in a partial record; truncated");
+        if (ftruncate(_journalFd, _journalBytes) < 0)
+            throw std::runtime_error("Failed to truncate " + journal + ": " + strerror(errno));
+    }
+    LOG(LOG_INFO, LOG_SERVER, "Loaded " << channels.size() << " channels from " << path << " in "
+        << monotonicMs() - started << " ms");
+
+    __atomic_store_n(&_running, 1, __ATOMIC_SEQ_CST);
+    if (pthread_create(&_thread, NULL, &ChannelStore::threadMain, this) != 0)
+        throw std::runtime_error("Failed to start channel database thread");
+    _threadStarted = true;
+}
+
+void ChannelStore::close() {
+    if (_threadStarted) {
+        __atomic_store_n(&_running, 0, __ATOMIC_SEQ_CST);
+        _notifier.notify();
+        pthread_join(_thread, NULL);
+        _threadStarted = false;
+    }
+    if (_journalFd >= 0) {
+        writeQueued();
+        ::close(_journalFd);
+        _journalFd = -1;
+    }
+    _latest.clear();
+    _latestComplete = false;
+}
+
+// --- Core Side ---
+void ChannelStore::save(const ChannelSettings& settings) {
+    StateWriter payload;
+    payload.putNumber(RECORD_SAVE);
+    payload.putString(settings.name);
+    payload.putNumber(settings.createdAt);
+    payload.putString(settings.topic);
+    payload.putNumber(settings.topicTime);
+    payload.putString(settings.key);
+    payload.putNumber(settings.inviteOnly);
+    payload.putNumber(settings.topicRestricted);
+    payload.putNumber(settings.userLimit);
+
+    Record* record = new Record();
+    record->name = settings.name;
+    record->payload = frame(payload.data());
+    record->removal = false;
+    push(record);
+}
+
+void ChannelStore::forget(const std::string& name) {
+    StateWriter payload;
+    payload.putNumber(RECORD_FORGET);
+    payload.putString(name);
+
+    Record* record = new Record();
+    record->name = name;
+    record->payload = frame(payload.data());
+    record->removal = true;
+    push(record);
+}
+
+void ChannelStore::push(Record* record) {
+    _queue.push(record);
+    _notifier.notify();
+}
+
+// --- Writer Thread ---
+// The copy of the records kept for compaction is built here rather than in
+// open(), so a restart is not kept waiting for it. If it cannot be built
+// whole, the journal just keeps growing: a snapshot written from part of
+// the records would lose the rest for good once the journal is emptied.
+void ChannelStore::loadLatest() {
+    size_t length;
+    int fd = ::open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+    try {
+        if (fd < 0 && errno != ENOENT) throw std::runtime_error("Failed to open " + _path + ": " + strerror(errno));
+        if (fd >= 0) load(_path, fd, NULL, &_latest, length);
+        load(_path + ".journal", _journalFd, NULL, &_latest, length);
+        _latestComplete = true;
+    } catch (const std::exception& e) {
+        LOG(LOG_ERROR, LOG_SERVER, "Channel database: " << e.what() << "; compaction disabled until restart");
+    }
+    if (fd >= 0) ::close(fd);
+}
+
+void* ChannelStore::threadMain(void* arg) {
+    ChannelStore* store = static_cast<ChannelStore*>(arg);
+    store->loadLatest();
+    struct pollfd wakeup;
+    wakeup.fd = store->_notifier.fd();
+    wakeup.events = POLLIN;
+    while (__atomic_load_n(&store->_running, __ATOMIC_SEQ_CST)) {
+        if (poll(&wakeup, 1, -1) < 0 && errno != EINTR) break;
+        store->_notifier.consume();
+        store->writeQueued();
+    }
+    return NULL;
+}
+
+// One write and one fdatasync for whatever the core queued meanwhile
+void ChannelStore::writeQueued() {
+    std::string batch;
+    while (MpscNode* node = _queue.pop()) {
+        Record* record = static_cast<Record*>(node);
+        batch += record->payload;
+        if (record->removal) _latest.erase(record->name);
+        else _latest[record->name].swap(record->payload);
+        delete record;
+    }
+    if (batch.empty()) return;
+
+    if (!writeAll(_journalFd, batch) || fdatasync(_journalFd) < 0) {
+        LOG(LOG_ERROR, LOG_SERVER, "Channel database: writing " << _path << ".journal: " << strerror(errno));
+        return;
+    }
+    _journalBytes += batch.length();
+    if (_journalBytes >= _compactBytes && _latestComplete) compact();
+}
+
+// The snapshot is replaced whole by rename(), so a crash leaves either the
+// old one or the new one. A crash before the journal is emptied replays
+// records the new snapshot already holds, which changes nothing.
+void ChannelStore::compact() {
+    long started = monotonicMs();
+    std::string snapshot(MAGIC, MAGIC_LENGTH);
+    for (std::map<std::string, std::string>::iterator it = _latest.begin(); it != _latest.end(); ++it) {
+        snapshot += it->second;
+    }
+
+    std::string temporary = _path + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool written = fd >= 0 && writeAll(fd, snapshot) && fsync(fd) == 0;
+    if (fd >= 0) ::close(fd);
+    if (!written || std::rename(temporary.c_str(), _path.c_str()) < 0) {
+        LOG(LOG_ERROR, LOG_SERVER, "Channel database: writing " << _path << ": " << strerror(errno));
+        unlink(temporary.c_str());
+        return;
+    }
+    if (ftruncate(_journalFd, MAGIC_LENGTH) < 0 || fdatasync(_journalFd) < 0) {
+        LOG(LOG_ERROR, LOG_SERVER, "Channel database: emptying " << _path << ".journal: " << strerror(errno));
+        return;
+    }
+    _journalBytes = MAGIC_LENGTH;
+    LOG(LOG_INFO, LOG_SERVER, "Channel database: snapshot of " << _latest.size() << " channels written in "
+        << monotonicMs() - started << " ms");
+}
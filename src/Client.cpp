@@ -1,28 +1,114 @@
 #include "Client.hpp"
+#include "SlabPool.hpp"
 
-Client::Client(int fd, const std::string& hostname)
+static unsigned long nextClientId = 0;
+
+// Never destroyed: reactors may still free clients while the process exits
+static SlabPool& clientPool() {
+    static SlabPool* pool = new SlabPool("client", sizeof(Client));
+    return *pool;
+}
+
+void* Client::operator new(size_t size) {
+    if (size != sizeof(Client)) return ::operator new(size);
+    return clientPool().allocate();
+}
+
+void Client::operator delete(void* block, size_t size) {
+    if (size != sizeof(Client)) ::operator delete(block);
+    else clientPool().deallocate(block);
+}
+
+Client::Client(int fd, const std::string& hostname, Reactor* reactor)
     : _fd(fd),
+      _id(__atomic_add_fetch(&nextClientId, 1, __ATOMIC_RELAXED)),
+      _reactor(reactor),
       _hostname(hostname),
       _registrationState(PASS_NEEDED),
-      _authenticated(false) {}
+      _authenticated(false),
+      _writeArmed(false),
+      _flushPending(false),
+      _closing(false),
+      _throttled(false),
+      _sendqExceeded(false),
+      _nickTs(0),
+      _server(NULL),
+      _peer(NULL),
+      _serverLink(false) {
+    updatePrefix();
+}
 
 Client::~Client() {}
 
 // --- Getters ---
 int Client::getFd() const { return _fd; }
+unsigned long Client::getId() const { return _id; }
+Reactor* Client::getReactor() const { return _reactor; }
 const std::string& Client::getNickname() const { return _nickname; }
 const std::string& Client::getUsername() const { return _username; }
+const std::string& Client::getRealname() const { return _realname; }
 const std::string& Client::getHostname() const { return _hostname; }
+const std::string& Client::getPrefix() const { return _prefix; }
 RegistrationState Client::getRegistrationState() const { return _registrationState; }
-const std::string& Client::getBuffer() const { return _buffer; }
-std::string& Client::getBufferRef() { return _buffer; }
+InputBuffer& Client::getInput() { return _input; }
 bool Client::isAuthenticated() const { return _authenticated; }
+OutputQueue& Client::getOutput() { return _output; }
+bool Client::isWriteArmed() const { return _writeArmed; }
+bool Client::isFlushPending() const { return _flushPending; }
+bool Client::isClosing() const { return _closing; }
+TokenBucket& Client::getFloodBucket() { return _floodBucket; }
+bool Client::isThrottled() const { return _throttled; }
+bool Client::isSendqExceeded() const { return _sendqExceeded; }
+const std::set<Channel*>& Client::getChannels() const { return _channels; }
+const std::set<Channel*>& Client::getInvites() const { return _invites; }
+const std::string& Client::getUid() const { return _uid; }
+time_t Client::getNickTs() const { return _nickTs; }
+RemoteServer* Client::getServer() const { return _server; }
+bool Client::isRemote() const { return _server != NULL; }
+RemoteServer* Client::getPeer() const { return _peer; }
+const std::string& Client::getLinkSid() const { return _linkSid; }
+bool Client::isServerLink() const { return _serverLink; }
 
 
 // --- Setters ---
-void Client::setNickname(const std::string& nickname) { _nickname = nickname; }
-void Client::setUsername(const std::string& username) { _username = username; }
+void Client::setNickname(const std::string& nickname) {
+    _nickname = nickname;
+    updatePrefix();
+}
+
+void Client::setUsername(const std::string& username) {
+    _username = username;
+    updatePrefix();
+}
+void Client::setRealname(const std::string& realname) { _realname = realname; }
 void Client::setRegistrationState(RegistrationState state) { _registrationState = state; }
-void Client::appendToBuffer(const char* data, size_t size) { _buffer.append(data, size); }
-void Client::clearBuffer(size_t len) { _buffer.erase(0, len); }
-void Client::setAuthenticated(bool auth) { _authenticated = auth; }
\ No newline at end of file
+void Client::setAuthenticated(bool auth) { _authenticated = auth; }
+void Client::setWriteArmed(bool armed) { _writeArmed = armed; }
+void Client::setFlushPending(bool pending) { _flushPending = pending; }
+void Client::setClosing(bool closing) { _closing = closing; }
+void Client::setThrottled(bool throttled) { _throttled = throttled; }
+void Client::setSendqExceeded(bool exceeded) { _sendqExceeded = exceeded; }
+void Client::setUid(const std::string& uid) { _uid = uid; }
+void Client::setNickTs(time_t ts) { _nickTs = ts; }
+void Client::setServer(RemoteServer* server) { _server = server; }
+void Client::setPeer(RemoteServer* peer) { _peer = peer; }
+void Client::setLinkSid(const std::string& sid) { _linkSid = sid; }
+void Client::setServerLink(bool link) { _serverLink = link; }
+
+// Rebuilt only when the nick or username changes, not per message
+void Client::updatePrefix() {
+    _prefix.clear();
+    _prefix.reserve(3 + _nickname.length() + _username.length() + _hostname.length());
+    _prefix += ':';
+    _prefix += _nickname;
+    _prefix += '!';
+    _prefix += _username;
+    _prefix += '@';
+    _prefix += _hostname;
+}
+
+// --- Channel Membership ---
+void Client::addChannel(Channel* channel) { _channels.insert(channel); }
+void Client::removeChannel(Channel* channel) { _channels.erase(channel); }
+void Client::addInvite(Channel* channel) { _invites.insert(channel); }
+void Client::removeInvite(Channel* channel) { _invites.erase(channel); }
\ No newline at end of file
@@ -0,0 +1,71 @@
+#include "CommandTable.hpp"
+
+static char toUpper(char c) {
+    return (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c;
+}
+
+static CommandId match(const StringView& name, const char* literal, CommandId id) {
+    return name.equalsIgnoreCase(literal) ? id : CMD_UNKNOWN;
+}
+
+CommandId lookupCommand(const StringView& name) {
+    if (name.length() < 2) return CMD_UNKNOWN;
+
+    char first = toUpper(name[0]);
+    switch (name.length()) {
+        case 2:
+            return match(name, "TB", CMD_TB);
+        case 3:
+            switch (first) {
+                case 'S': return match(name, "SID", CMD_SID);
+                case 'U': return match(name, "UID", CMD_UID);
+                case 'E': return match(name, "EOB", CMD_EOB);
+            }
+            break;
+        case 4:
+            switch (first) {
+                case 'J': return match(name, "JOIN", CMD_JOIN);
+                case 'K': return toUpper(name[2]) == 'C' ? match(name, "KICK", CMD_KICK)
+                                                         : match(name, "KILL", CMD_KILL);
+                case 'M': return match(name, "MODE", CMD_MODE);
+                case 'N': return match(name, "NICK", CMD_NICK);
+                case 'Q': return match(name, "QUIT", CMD_QUIT);
+                case 'U': return match(name, "USER", CMD_USER);
+                case 'P':
+                    switch (toUpper(name[1])) {
+                        case 'A': return toUpper(name[2]) == 'S' ? match(name, "PASS", CMD_PASS)
+                                                                 : match(name, "PART", CMD_PART);
+                        case 'I': return match(name, "PING", CMD_PING);
+                        case 'O': return match(name, "PONG", CMD_PONG);
+                    }
+                    break;
+            }
+            break;
+        case 5:
+            switch (first) {
+                case 'T': return toUpper(name[1]) == 'O' ? match(name, "TOPIC", CMD_TOPIC)
+                                                         : match(name, "TMODE", CMD_TMODE);
+                case 'E': return match(name, "ERROR", CMD_ERROR);
+                case 'N': return match(name, "NAMES", CMD_NAMES);
+                case 'S':
+                    switch (toUpper(name[1])) {
+                        case 'T': return match(name, "STATS", CMD_STATS);
+                        case 'J': return match(name, "SJOIN", CMD_SJOIN);
+                        case 'Q': return match(name, "SQUIT", CMD_SQUIT);
+                    }
+                    break;
+            }
+            break;
+        case 6:
+            if (first == 'I') return match(name, "INVITE", CMD_INVITE);
+            if (first == 'S') return match(name, "SERVER", CMD_SERVER);
+            break;
+        case 7:
+            if (first == 'P') return match(name, "PRIVMSG", CMD_PRIVMSG);
+            break;
+        case 11:
+            if (first == 'C') return match(name, "CHATHISTORY", CMD_CHATHISTORY);
+            break;
+    }
+    return CMD_UNKNOWN;
+}
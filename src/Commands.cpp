@@ -3,13 +3,16 @@
 
 // --- Command Handlers ---
 
-void Server::cmdPass(Client* client, const std::vector<std::string>& args) {
+void Server::cmdPass(Client* client, const MessageView& args) {
     if (client->isAuthenticated()) {
         sendNumericReply(client, "462", ":You may not reregister");
         return;
     }
-    if (args.empty()) {
-        sendNumericReply(client, "461", "PASS :Not enough parameters");
+    // A server: PASS <password> TS 6 :<SID>, checked when SERVER follows
+    if (args.size() >= 4 && args[1] == "TS") {
+        if (!_config.linkPassword.empty() && args[0] == _config.linkPassword) {
+            client->setLinkSid(args[3].str());
+        }
         return;
     }
     if (args[0] == _password) {
@@ -22,98 +25,141 @@ void Server::cmdPass(Client* client, const std::vector<std::string>& args) {
     }
 }
 
-void Server::cmdNick(Client* client, const std::vector<std::string>& args) {
-    if (!client->isAuthenticated()) {
-        sendNumericReply(client, "451", ":You have not registered (PASSWORD required)");
-        return;
-    }
+// A nick travels as a middle parameter between servers and must not
+// read as a channel, a target list or a mask
+bool Server::isValidNick(const std::string& nick) {
+    if (nick.empty() || nick.length() > NICKLEN) return false;
+    if (nick[0] == ':' || nick[0] == '#' || nick[0] == '&' || (nick[0] >= '0' && nick[0] <= '9')) return false;
+    return nick.find_first_of(" ,*?!@") == std::string::npos;
+}
+
+void Server::cmdNick(Client* client, const MessageView& args) {
     if (args.empty() || args[0].empty()) {
         sendNumericReply(client, "431", ":No nickname given");
         return;
     }
-    const std::string& newNick = args[0];
-    if (findClientByNick(newNick)) {
+    const std::string newNick = args[0].str();
+    if (!isValidNick(newNick)) {
+        sendNumericReply(client, "432", newNick + " :Erroneous nickname");
+        return;
+    }
+    Client* holder = findClientByNick(newNick);
+    if (holder && holder != client) {
         sendNumericReply(client, "433", newNick + " :Nickname is already in use");
         return;
     }
-    // Add more validation for nickname characters if needed
-
+    if (client->getRegistrationState() == REGISTERED) {
+        broadcastNick(client, newNick);
+    }
+    if (!client->getNickname().empty()) {
+        _nickIndex.erase(client->getNickname());
+    }
     client->setNickname(newNick);
+    client->setNickTs(time(NULL));
+    renamedMember(client);
+    _nickIndex.insert(newNick, client);
+    if (client->getRegistrationState() == REGISTERED) {
+        announceNick(client);
+    }
     // Check for registration completion
     if (client->getRegistrationState() == NICK_USER_NEEDED && !client->getUsername().empty()) {
-         client->setRegistrationState(REGISTERED);
-         sendNumericReply(client, "001", ":Welcome to the IRC Network " + client->getNickname());
+        registerClient(client);
     }
 }
 
 
-void Server::cmdUser(Client* client, const std::vector<std::string>& args) {
-    if (!client->isAuthenticated()) {
-        sendNumericReply(client, "451", ":You have not registered (PASSWORD required)");
-        return;
-    }
+void Server::cmdUser(Client* client, const MessageView& args) {
      if (client->getRegistrationState() == REGISTERED) {
         sendNumericReply(client, "462", ":You may not reregister");
         return;
     }
-    if (args.size() < 4) {
-        sendNumericReply(client, "461", "USER :Not enough parameters");
-        return;
-    }
 
-    client->setUsername(args[0]);
-    
+    client->setUsername(args[0].str());
+    client->setRealname(args[3].str());
+
     if (client->getRegistrationState() == NICK_USER_NEEDED && !client->getNickname().empty()) {
-        client->setRegistrationState(REGISTERED);
-        sendNumericReply(client, "001", ":Welcome to the IRC Network " + client->getNickname());
+        registerClient(client);
     }
 }
 
-void Server::cmdPrivmsg(Client* client, const std::vector<std::string>& args) {
-    if (args.size() < 2) {
-        sendNumericReply(client, "461", "PRIVMSG :Not enough parameters");
+// NICK and USER both given: the client is in
+void Server::registerClient(Client* client) {
+    client->setRegistrationState(REGISTERED);
+    ++_registered;
+    introduceUser(client);
+    sendNumericReply(client, "001", ":Welcome to the IRC Network " + client->getNickname());
+    sendIsupport(client);
+}
+
+// RPL_ISUPPORT: what the client may rely on. JOIN takes any number of
+// channels the line has room for.
+void Server::sendIsupport(Client* client) {
+    std::ostringstream tokens;
+    tokens << "CHANTYPES=# PREFIX=(o)@ CHANMODES=,k,l,it TARGMAX=JOIN:,NAMES:,PRIVMSG:" << MAX_TARGETS << " NICKLEN=" << NICKLEN;
+    if (ChannelHistory::enabled()) tokens << " CHATHISTORY=" << ChannelHistory::REPLY_MAX;
+    sendNumericReply(client, "005", tokens.str() + " :are supported by this server");
+}
+
+void Server::cmdPrivmsg(Client* client, const MessageView& args) {
+    if (args[1].empty()) {
+        sendNumericReply(client, "412", ":No text to send");
         return;
     }
 
-    const std::string& target = args[0];
-    const std::string& message = args[1];
-    
-    std::string full_message = ":" + client->getNickname() + "!" + client->getUsername() + "@" + client->getHostname() + " PRIVMSG " + target + " :" + message;
-
-    if (target[0] == '#') { // To a channel
-        std::map<std::string, Channel*>::iterator it = _channels.find(target);
-        if (it != _channels.end()) {
-            if(it->second->isClientInChannel(client))
-            {
-                std::vector<Client*> clients = it->second->getClients();
-                for (size_t i = 0; i < clients.size(); ++i) {
-                    if (clients[i] != client) {
-                        sendReply(clients[i], full_message);
-                    }
+    std::vector<std::string> targets = split(args[0].str(), ',');
+    if (targets.size() > MAX_TARGETS) {
+        sendNumericReply(client, "407", targets[MAX_TARGETS] + " :Too many recipients");
+        targets.resize(MAX_TARGETS);
+    }
+    // Every target's line is the same pieces around its name
+    const std::string& prefix = client->getPrefix();
+    const StringView& text = args[1];
+
+    for (size_t i = 0; i < targets.size(); ++i) {
+        const std::string& target = targets[i];
+        if (target.empty()) continue;
+        LineBuilder full_message;
+        full_message << prefix << " PRIVMSG " << target << " :" << text;
+
+        if (target[0] == '#') { // To a channel
+            std::map<std::string, Channel*>::iterator it = _channels.find(target);
+            if (it != _channels.end()) {
+                if(it->second->isClientInChannel(client))
+                {
+                    it->second->getHistory().record(broadcast(it->second, full_message, client));
+                    relayToChannel(it->second, LineBuilder() << ":" << client->getUid() << " PRIVMSG " << target << " :" << text);
+                } else {
+                     sendNumericReply(client, "404", target + " :Cannot send to channel");
                 }
             } else {
-                 sendNumericReply(client, "404", target + " :Cannot send to channel");
+                sendNumericReply(client, "403", target + " :No such channel");
+            }
+        } else { // To a user
+            Client* destClient = findClientByNick(target);
+            if (destClient && destClient->isRemote()) {
+                sendToServer(destClient->getServer(), LineBuilder() << ":" << client->getUid() << " PRIVMSG "
+                    << destClient->getUid() << " :" << text);
+            } else if (destClient) {
+                sendReply(destClient, full_message);
+            } else {
+                sendNumericReply(client, "401", target + " :No such nick/channel");
             }
-        } else {
-            sendNumericReply(client, "403", target + " :No such channel");
-        }
-    } else { // To a user
-        Client* destClient = findClientByNick(target);
-        if (destClient) {
-            sendReply(destClient, full_message);
-        } else {
-            sendNumericReply(client, "401", target + " :No such nick/channel");
         }
     }
 }
 
-void Server::cmdJoin(Client* client, const std::vector<std::string>& args) {
-    if (args.empty()) {
-        sendNumericReply(client, "461", "JOIN :Not enough parameters");
-        return;
+// JOIN <#a,#b,...> [<key,key,...>]: keys go to the channels in order
+void Server::cmdJoin(Client* client, const MessageView& args) {
+    std::vector<std::string> channels = split(args[0].str(), ',');
+    std::vector<std::string> keys;
+    if (args.size() > 1) keys = split(args[1].str(), ',');
+    for (size_t i = 0; i < channels.size(); ++i) {
+        if (channels[i].empty()) continue;
+        joinChannel(client, channels[i], i < keys.size() ? keys[i] : std::string());
     }
-    const std::string& channelName = args[0];
+}
 
+void Server::joinChannel(Client* client, const std::string& channelName, const std::string& key) {
     if (channelName[0] != '#') {
         sendNumericReply(client, "403", channelName + " :No such channel");
         return;
@@ -123,8 +169,10 @@ void Server::cmdJoin(Client* client, const std::vector<std::string>& args) {
     bool isNewChannel = false;
     std::map<std::string, Channel*>::iterator it = _channels.find(channelName);
     if (it == _channels.end()) {
+        if (!revivalAdmits(client, channelName, key)) return;
         channel = new Channel(channelName, client);
         _channels[channelName] = channel;
+        reviveChannel(channel);
         isNewChannel = true;
     } else {
         channel = it->second;
@@ -132,24 +180,25 @@ void Server::cmdJoin(Client* client, const std::vector<std::string>& args) {
 
     // Mode checks for existing channels
     if (!isNewChannel) {
+        if (channel->isClientInChannel(client)) return; // Already there, as after "JOIN #a,#a"
         if (channel->getMode('i')) {
             if (!channel->isInvited(client)) {
                 sendNumericReply(client, "473", channelName + " :Cannot join channel (+i)");
                 return;
             }
         }
-        if (channel->getMode('k') && (args.size() < 2 || args[1] != channel->getKey())) {
+        if (channel->getMode('k') && key != channel->getKey()) {
              sendNumericReply(client, "475", channelName + " :Cannot join channel (+k)");
             return;
         }
-        if (channel->getMode('l') && (int)channel->getClients().size() >= channel->getUserLimit()) {
+        if (channel->getMode('l') && (int)channel->getMemberCount() >= channel->getUserLimit()) {
             sendNumericReply(client, "471", channelName + " :Cannot join channel (+l)");
             return;
         }
 
         if (!channel->addClient(client)) {
             // This case should ideally not be hit frequently now, but good to keep for robustness
-            std::cerr << "Error: Client " << client->getNickname() << " failed to add to existing channel " << channelName << std::endl;
+            LOG(LOG_ERROR, LOG_SERVER, "Client " << client->getNickname() << " failed to add to existing channel " << channelName);
             return;
         }
     }
@@ -157,11 +206,8 @@ void Server::cmdJoin(Client* client, const std::vector<std::string>& args) {
     // removeInvite must be called regardless of new/existing channel
     channel->removeInvite(client); 
     
-    std::string join_msg = ":" + client->getNickname() + "!" + client->getUsername() + "@" + client->getHostname() + " JOIN :" + channelName;
-    std::vector<Client*> clients = channel->getClients();
-    for (size_t i = 0; i < clients.size(); ++i) {
-       sendReply(clients[i], join_msg);
-    }
+    channel->getHistory().record(broadcast(channel, LineBuilder() << client->getPrefix() << " JOIN :" << channelName));
+    announceJoin(client, channel, isNewChannel);
 
     if (!channel->getTopic().empty()) {
         sendNumericReply(client, "332", channelName + " :" + channel->getTopic());
@@ -169,23 +215,29 @@ void Server::cmdJoin(Client* client, const std::vector<std::string>& args) {
         sendNumericReply(client, "331", channelName + " :No topic is set");
     }
 
-    std::string names_list;
-    for (size_t i = 0; i < clients.size(); ++i) {
-        if(channel->isOperator(clients[i])) names_list += "@";
-        names_list += clients[i]->getNickname();
-        if (i < clients.size() - 1) names_list += " ";
-    }
-    sendNumericReply(client, "353", "= " + channelName + " :" + names_list);
-    sendNumericReply(client, "366", channelName + " :End of /NAMES list");
+    sendNames(client, channel);
 }
 
-void Server::cmdPart(Client* client, const std::vector<std::string>& args) {
-    if (args.empty()) {
-        sendNumericReply(client, "461", "PART :Not enough parameters");
+// NAMES [<#chan>{,<#chan>}]. Every channel is public here, so members and
+// outsiders get the same list. Without channels: just the end of the list,
+// rather than every user on the server.
+void Server::cmdNames(Client* client, const MessageView& args) {
+    if (args.empty() || args[0].empty()) {
+        sendNumericReply(client, "366", "* :End of /NAMES list");
         return;
     }
-    const std::string& channelName = args[0];
-    std::string reason = args.size() > 1 ? args[1] : "Leaving";
+    std::vector<std::string> channels = split(args[0].str(), ',');
+    for (size_t i = 0; i < channels.size(); ++i) {
+        if (channels[i].empty()) continue;
+        std::map<std::string, Channel*>::iterator it = _channels.find(channels[i]);
+        if (it != _channels.end()) sendNames(client, it->second);
+        else sendNumericReply(client, "366", channels[i] + " :End of /NAMES list");
+    }
+}
+
+void Server::cmdPart(Client* client, const MessageView& args) {
+    const std::string channelName = args[0].str();
+    std::string reason = args.size() > 1 ? args[1].str() : "Leaving";
 
     std::map<std::string, Channel*>::iterator it = _channels.find(channelName);
     if (it == _channels.end()) {
@@ -199,27 +251,16 @@ void Server::cmdPart(Client* client, const std::vector<std::string>& args) {
         return;
     }
 
-    std::string part_msg = ":" + client->getNickname() + "!" + client->getUsername() + "@" + client->getHostname() + " PART " + channelName + " :" + reason;
-    std::vector<Client*> clients = channel->getClients();
-     for (size_t i = 0; i < clients.size(); ++i) {
-       sendReply(clients[i], part_msg);
-    }
-
-    channel->removeClient(client);
+    channel->getHistory().record(broadcast(channel, LineBuilder() << client->getPrefix() << " PART " << channelName
+        << " :" << reason));
+    sendToLinks(LineBuilder() << ":" << client->getUid() << " PART " << channelName << " :" << reason);
 
-    if (channel->getClients().empty()) {
-        _channels.erase(it);
-        delete channel;
-    }
+    partChannel(channel, client);
 }
 
 
-void Server::cmdTopic(Client* client, const std::vector<std::string>& args) {
-    if (args.empty()) {
-        sendNumericReply(client, "461", "TOPIC :Not enough parameters");
-        return;
-    }
-    const std::string& channelName = args[0];
+void Server::cmdTopic(Client* client, const MessageView& args) {
+    const std::string channelName = args[0].str();
 
     std::map<std::string, Channel*>::iterator it = _channels.find(channelName);
     if (it == _channels.end()) {
@@ -244,25 +285,20 @@ void Server::cmdTopic(Client* client, const std::vector<std::string>& args) {
             sendNumericReply(client, "482", channelName + " :You're not channel operator");
             return;
         }
-        const std::string& newTopic = args[1];
+        const std::string newTopic = args[1].str();
         channel->setTopic(newTopic);
+        saveChannel(channel);
         
-        std::string topic_msg = ":" + client->getNickname() + "!" + client->getUsername() + "@" + client->getHostname() + " TOPIC " + channelName + " :" + newTopic;
-        std::vector<Client*> clients = channel->getClients();
-        for (size_t i = 0; i < clients.size(); ++i) {
-            sendReply(clients[i], topic_msg);
-        }
+        channel->getHistory().record(broadcast(channel, LineBuilder() << client->getPrefix() << " TOPIC " << channelName
+            << " :" << newTopic));
+        sendToLinks(LineBuilder() << ":" << client->getUid() << " TOPIC " << channelName << " :" << newTopic);
     }
 }
 
-void Server::cmdKick(Client* client, const std::vector<std::string>& args) {
-    if (args.size() < 2) {
-        sendNumericReply(client, "461", "KICK :Not enough parameters");
-        return;
-    }
-    const std::string& channelName = args[0];
-    const std::string& targetNick = args[1];
-    std::string reason = args.size() > 2 ? args[2] : "Kicked";
+void Server::cmdKick(Client* client, const MessageView& args) {
+    const std::string channelName = args[0].str();
+    const std::string targetNick = args[1].str();
+    std::string reason = args.size() > 2 ? args[2].str() : "Kicked";
 
     std::map<std::string, Channel*>::iterator it = _channels.find(channelName);
     if (it == _channels.end()) {
@@ -282,27 +318,17 @@ void Server::cmdKick(Client* client, const std::vector<std::string>& args) {
         return;
     }
 
-    std::string kick_msg = ":" + client->getNickname() + "!" + client->getUsername() + "@" + client->getHostname() + " KICK " + channelName + " " + targetNick + " :" + reason;
-    std::vector<Client*> clients = channel->getClients();
-    for (size_t i = 0; i < clients.size(); ++i) {
-        sendReply(clients[i], kick_msg);
-    }
-
-    channel->removeClient(targetClient);
+    channel->getHistory().record(broadcast(channel, LineBuilder() << client->getPrefix() << " KICK " << channelName << " "
+        << targetNick << " :" << reason));
+    sendToLinks(LineBuilder() << ":" << client->getUid() << " KICK " << channelName << " " << targetClient->getUid()
+        << " :" << reason);
 
-    if (channel->getClients().empty()) {
-        _channels.erase(it);
-        delete channel;
-    }
+    partChannel(channel, targetClient);
 }
 
-void Server::cmdInvite(Client* client, const std::vector<std::string>& args) {
-    if (args.size() < 2) {
-        sendNumericReply(client, "461", "INVITE :Not enough parameters");
-        return;
-    }
-    const std::string& targetNick = args[0];
-    const std::string& channelName = args[1];
+void Server::cmdInvite(Client* client, const MessageView& args) {
+    const std::string targetNick = args[0].str();
+    const std::string channelName = args[1].str();
 
     Client* targetClient = findClientByNick(targetNick);
     if (!targetClient) {
@@ -329,16 +355,16 @@ void Server::cmdInvite(Client* client, const std::vector<std::string>& args) {
     channel->addInvite(targetClient);
     
     sendNumericReply(client, "341", channelName + " " + targetNick);
-    std::string invite_msg = ":" + client->getNickname() + "!" + client->getUsername() + "@" + client->getHostname() + " INVITE " + targetNick + " :" + channelName;
-    sendReply(targetClient, invite_msg);
+    if (targetClient->isRemote()) {
+        sendToServer(targetClient->getServer(), LineBuilder() << ":" << client->getUid() << " INVITE "
+            << targetClient->getUid() << " " << channelName);
+    } else {
+        sendReply(targetClient, LineBuilder() << client->getPrefix() << " INVITE " << targetNick << " :" << channelName);
+    }
 }
 
-void Server::cmdMode(Client* client, const std::vector<std::string>& args) {
-     if (args.empty()) {
-        sendNumericReply(client, "461", "MODE :Not enough parameters");
-        return;
-    }
-    const std::string& target = args[0];
+void Server::cmdMode(Client* client, const MessageView& args) {
+    const std::string target = args[0].str();
 
     if (target[0] != '#') {
         // User mode changes are not supported in this basic server
@@ -363,77 +389,234 @@ void Server::cmdMode(Client* client, const std::vector<std::string>& args) {
         return;
     }
 
-    // Mode changes logic
-    std::string modeStr = args[1];
+    ModeChange change;
+    applyChannelModes(channel, args, 1, false, change);
+    if (change.modes.empty()) return;
+    broadcast(channel, LineBuilder() << ":" << client->getNickname() << " MODE " << channel->getName() << " "
+        << change.modes << change.params);
+    announceMode(client, channel, change);
+}
+
+// Applies the mode string args[first] and its parameters, which name users
+// by nick (from a client) or by UID (from another server). Records what
+// actually changed; 'k' always takes a parameter, so the servers agree.
+// Saves the channel when its settings, not just its operators, changed.
+void Server::applyChannelModes(Channel* channel, const MessageView& args, size_t first, bool byUid, ModeChange& change) {
+    std::string modeStr = args[first].str();
     bool add = true;
-    size_t arg_idx = 2;
+    bool settingsChanged = false;
+    char sign = 0;
+    size_t arg_idx = first + 1;
 
     for (size_t i = 0; i < modeStr.length(); ++i) {
         char c = modeStr[i];
-        if (c == '+') add = true;
-        else if (c == '-') add = false;
-        else {
-            switch(c) {
-                case 'i': channel->setMode('i', add); break;
-                case 't': channel->setMode('t', add); break;
-                case 'k':
-                    if (arg_idx < args.size()) {
-                        if (add) channel->setKey(args[arg_idx++]);
-                        else channel->setKey("");
+        if (c == '+') { add = true; continue; }
+        if (c == '-') { add = false; continue; }
+
+        bool applied = false;
+        std::string param, linkParam;
+        switch(c) {
+            case 'i':
+            case 't':
+                channel->setMode(c, add);
+                applied = true;
+                break;
+            case 'k':
+                if (arg_idx < args.size()) {
+                    param = linkParam = args[arg_idx++].str();
+                    channel->setKey(add ? param : "");
+                    applied = true;
+                }
+                break;
+            case 'o':
+                if (arg_idx < args.size()) {
+                    std::string name = args[arg_idx++].str();
+                    Client* targetClient = byUid ? findClientByUid(name) : findClientByNick(name);
+                    if(targetClient && channel->isClientInChannel(targetClient)) {
+                        if (add) channel->addOperator(targetClient);
+                        else channel->removeOperator(targetClient);
+                        param = targetClient->getNickname();
+                        linkParam = targetClient->getUid();
+                        applied = true;
                     }
-                    break;
-                case 'o':
+                }
+                break;
+            case 'l':
+                if (add) {
                     if (arg_idx < args.size()) {
-                        Client* targetClient = findClientByNick(args[arg_idx++]);
-                        if(targetClient && channel->isClientInChannel(targetClient)) {
-                            if (add) channel->addOperator(targetClient);
-                            else channel->removeOperator(targetClient);
-                        }
-                    }
-                    break;
-                case 'l':
-                    if (add) {
-                         if (arg_idx < args.size()) channel->setUserLimit(std::atoi(args[arg_idx++].c_str()));
-                    } else {
-                        channel->setUserLimit(0);
+                        param = linkParam = args[arg_idx++].str();
+                        channel->setUserLimit(std::atoi(param.c_str()));
+                        applied = true;
                     }
-                    break;
-            }
+                } else {
+                    channel->setUserLimit(0);
+                    applied = true;
+                }
+                break;
+        }
+        if (!applied) continue;
+        if (c != 'o') settingsChanged = true;
+        if (sign != (add ? '+' : '-')) {
+            sign = add ? '+' : '-';
+            change.modes += sign;
+        }
+        change.modes += c;
+        if (!param.empty()) {
+            change.params += " " + param;
+            change.linkParams += " " + linkParam;
         }
     }
-     std::string mode_msg = ":" + client->getNickname() + " MODE " + channel->getName() + " " + args[1];
-     if (args.size() > 2) mode_msg += " " + args[2];
-     std::vector<Client*> clients = channel->getClients();
-     for(size_t i = 0; i < clients.size(); i++) {
-         sendReply(clients[i], mode_msg);
-     }
+    if (settingsChanged) saveChannel(channel);
 }
 
-void Server::cmdQuit(Client* client, const std::vector<std::string>& args) {
-    std::string quit_message = args.empty() ? "Client Quit" : args[0];
-    
-    std::string quit_broadcast = ":" + client->getNickname() + "!" + client->getUsername() + "@" + client->getHostname() + " QUIT :Quit: " + quit_message;
-
-    std::vector<Channel*> channels_to_cleanup;
-     for (std::map<std::string, Channel*>::iterator it = _channels.begin(); it != _channels.end(); ++it) {
-        if (it->second->isClientInChannel(client)) {
-            std::vector<Client*> clients = it->second->getClients();
-            for(size_t i=0; i < clients.size(); i++)
-            {
-                if(clients[i]!= client)
-                     sendReply(clients[i], quit_broadcast);
+void Server::cmdQuit(Client* client, const MessageView& args) {
+    std::string quit_message = "Quit: " + (args.empty() ? "Client Quit" : args[0].str());
+    broadcastQuit(client, quit_message);
+    _metrics.quits.add();
+
+    // removeClient leaves the channels and deletes the ones left empty
+    removeClient(client->getFd(), quit_message);
+}
+
+void Server::cmdPing(Client* client, const MessageView& args) {
+    sendReply(client, LineBuilder() << ":" << _serverName << " PONG " << _serverName << " :" << args[0]);
+}
+
+void Server::cmdPong(Client* client, const MessageView& args) {
+    // Nothing to do: any traffic already proves the client is alive
+    (void)client;
+    (void)args;
+}
+
+void Server::cmdStats(Client* client, const MessageView& args) {
+    char query = args[0].empty() ? '*' : args[0][0];
+    switch (query) {
+        case 'm':
+            for (size_t i = 0; i < CMD_COUNT; ++i) {
+                std::ostringstream line;
+                line << _commandTable[i].name << " " << _metrics.messagesIn[i].get() << " "
+                     << _metrics.bytesIn[i].get() << " 0";
+                sendNumericReply(client, "212", line.str());
             }
-            it->second->removeClient(client);
-            if (it->second->getClients().empty()) {
-                channels_to_cleanup.push_back(it->second);
+            break;
+        case 'u': {
+            long up = time(NULL) - _startTime;
+            std::ostringstream line;
+            line << ":Server Up " << up / 86400 << " days " << (up / 3600) % 24 << ":"
+                 << ((up / 60) % 60 < 10 ? "0" : "") << (up / 60) % 60 << ":"
+                 << (up % 60 < 10 ? "0" : "") << up % 60;
+            sendNumericReply(client, "242", line.str());
+            break;
+        }
+        case 'z': {
+            std::vector<std::string> lines = describeRuntime();
+            for (size_t i = 0; i < lines.size(); ++i) {
+                sendNumericReply(client, "249", "z :" + lines[i]);
             }
+            break;
         }
     }
+    sendNumericReply(client, "219", std::string(1, query) + " :End of STATS report");
+}
+
+// --- CHATHISTORY ---
+// A message reference: "msgid=<id>" or "timestamp=<ISO 8601, UTC>"
+static bool parseHistoryRef(const std::string& ref, bool& byId, unsigned long& msgid, long long& timeMs) {
+    if (ref.compare(0, 6, "msgid=") == 0 && ref.length() > 6) {
+        char* end;
+        errno = 0;
+        msgid = std::strtoul(ref.c_str() + 6, &end, 10);
+        byId = true;
+        return *end == '\0' && errno == 0;
+    }
+    if (ref.compare(0, 10, "timestamp=") != 0) return false;
+    struct tm when = tm();
+    int millis = 0;
+    int used = 0;
+    const char* text = ref.c_str() + 10;
+    if (sscanf(text, "%4d-%2d-%2dT%2d:%2d:%2d%n", &when.tm_year, &when.tm_mon, &when.tm_mday,
+                    &when.tm_hour, &when.tm_min, &when.tm_sec, &used) != 6) return false;
+    text += used;
+    if (*text == '.') {
+        if (sscanf(text, ".%3d%n", &millis, &used) != 1) return false;
+        text += used;
+    }
+    if (std::strcmp(text, "Z") != 0) return false;
+    when.tm_year -= 1900;
+    when.tm_mon -= 1;
+    timeMs = static_cast<long long>(timegm(&when)) * 1000 + millis;
+    byId = false;
+    return true;
+}
 
-    for (size_t i = 0; i < channels_to_cleanup.size(); ++i) {
-        _channels.erase(channels_to_cleanup[i]->getName());
-        delete channels_to_cleanup[i];
+static std::string formatHistoryTime(long long timeMs) {
+    time_t seconds = timeMs / 1000;
+    struct tm when;
+    gmtime_r(&seconds, &when);
+    char text[32];
+    snprintf(text, sizeof(text), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ", when.tm_year + 1900, when.tm_mon + 1,
+                  when.tm_mday, when.tm_hour, when.tm_min, when.tm_sec, static_cast<int>(timeMs % 1000));
+    return text;
+}
+
+// CHATHISTORY <LATEST|BEFORE|AFTER|AROUND> <#chan> <*|msgid=|timestamp=> <limit>
+// References are exclusive, except AROUND's. The events come back oldest
+// first in a chathistory batch, tagged with their time and msgid.
+void Server::cmdChathistory(Client* client, const MessageView& args) {
+    const std::string sub = args[0].str();
+    const std::string target = args[1].str();
+    const std::string ref = args[2].str();
+
+    bool latest = sub == "LATEST";
+    if (!latest && sub != "BEFORE" && sub != "AFTER" && sub != "AROUND") {
+        sendReply(client, LineBuilder() << ":" << _serverName << " FAIL CHATHISTORY INVALID_PARAMS " << sub
+            << " :Unknown subcommand");
+        return;
     }
-    
-    removeClient(client->getFd());
-}
\ No newline at end of file
+    std::map<std::string, Channel*>::iterator it = _channels.find(target);
+    if (it == _channels.end() || !it->second->isClientInChannel(client)) {
+        sendReply(client, LineBuilder() << ":" << _serverName << " FAIL CHATHISTORY INVALID_TARGET " << sub << " "
+            << target << " :Messages could not be retrieved");
+        return;
+    }
+    bool byId = false;
+    unsigned long msgid = 0;
+    long long timeMs = 0;
+    char* end;
+    long limit = std::strtol(args[3].c_str(), &end, 10);
+    bool anyRef = latest && ref == "*";
+    if ((!anyRef && !parseHistoryRef(ref, byId, msgid, timeMs)) || *end != '\0' || limit <= 0) {
+        sendReply(client, LineBuilder() << ":" << _serverName << " FAIL CHATHISTORY INVALID_PARAMS " << sub << " "
+            << ref << " :Invalid message reference");
+        return;
+    }
+    if (limit > static_cast<long>(ChannelHistory::REPLY_MAX)) limit = ChannelHistory::REPLY_MAX;
+
+    const ChannelHistory& history = it->second->getHistory();
+    size_t count = history.size();
+    size_t first = 0, last = count;
+    if (sub == "BEFORE") {
+        last = byId ? history.firstFrom(msgid) : history.firstAt(timeMs);
+        first = last > static_cast<size_t>(limit) ? last - limit : 0;
+    } else if (sub == "AFTER" || latest) {
+        if (!anyRef) first = byId ? history.firstFrom(msgid + 1) : history.firstAt(timeMs + 1);
+        if (latest) first = std::max(first, count > static_cast<size_t>(limit) ? count - limit : 0);
+        else last = std::min(count, first + limit);
+    } else { // AROUND
+        size_t middle = byId ? history.firstFrom(msgid) : history.firstAt(timeMs);
+        first = middle > static_cast<size_t>(limit / 2) ? middle - limit / 2 : 0;
+        last = std::min(count, first + limit);
+    }
+
+    std::ostringstream batch;
+    batch << ++_nextBatch;
+    const std::string batchRef = batch.str();
+    sendReply(client, LineBuilder() << ":" << _serverName << " BATCH +" << batchRef << " chathistory " << target);
+    for (size_t i = first; i < last; ++i) {
+        const HistoryEvent& event = history.at(i);
+        std::ostringstream tags;
+        tags << "@batch=" << batchRef << ";time=" << formatHistoryTime(event.timeMs) << ";msgid=" << event.msgid << " ";
+        sendReply(client, LineBuilder() << tags.str() << StringView(event.line.data(), event.line.length() - 2));
+    }
+    sendReply(client, LineBuilder() << ":" << _serverName << " BATCH -" << batchRef);
+}
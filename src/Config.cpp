@@ -0,0 +1,138 @@
+#include "Config.hpp"
+#include "InputBuffer.hpp"
+#include <stdexcept>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <unistd.h>
+
+ServerConfig::ServerConfig()
+#ifdef __linux__
+    : backend("epoll"),
+#else
+    : backend("poll"),
+#endif
+      threads(1),
+      logFile("-"),
+      logLevel("info"),
+      logCategories("server,conn"),
+      floodRate(4),
+      floodBurst(40),
+      floodCostLight(1),
+      floodCostMessage(4),
+      floodCostState(8),
+      floodMaxLines(100),
+      recvq(65536),
+      sendq(1048576),
+      adminPort(0),
+      backlog(511),
+      acceptBatch(64),
+      deferAccept(0),
+      tcpNoDelay(true),
+      sendBuffer(0),
+      receiveBuffer(0),
+      drainTimeout(5),
+      serverName("irc.42.fr"),
+      sid("042"),
+      linkSendq(16L << 20),
+      channelDbCompact(4L << 20),
+      historyLines(100),
+      historyBytes(64L << 10),
+      historyMemory(64L << 20),
+      upgradeFd(-1) {}
+
+static long parseNumber(const std::string& name, const std::string& value, long min, long max) {
+    char* end;
+    errno = 0;
+    long number = std::strtol(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || errno == ERANGE || number < min || number > max)
+        throw std::runtime_error("Invalid value for --" + name + ": " + value);
+    return number;
+}
+
+// The path this process runs from, read once at startup: a chdir later
+// changes what a relative argv[0] means, and once a new binary replaces
+// the file /proc/self/exe names the old, deleted one
+static std::string findExecutable(const char* argv0) {
+    char path[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length > 0) return std::string(path, length);
+    if (realpath(argv0, path)) return path;
+    return argv0;
+}
+
+void ServerConfig::parse(int argc, char** argv, int first) {
+    command.assign(argv, argv + first);
+    executable = findExecutable(argv[0]);
+    for (int i = first; i < argc; ++i) {
+        std::string option(argv[i]);
+        size_t eq = option.find('=');
+        if (option.compare(0, 2, "--") != 0 || eq == std::string::npos)
+            throw std::runtime_error("Invalid option: " + option);
+
+        std::string name = option.substr(2, eq - 2);
+        std::string value = option.substr(eq + 1);
+
+        if (name == "backend") backend = value;
+        else if (name == "threads") threads = parseNumber(name, value, 1, 256);
+        else if (name == "log-file") logFile = value;
+        else if (name == "log-level") logLevel = value;
+        else if (name == "log-categories") logCategories = value;
+        else if (name == "flood-rate") floodRate = parseNumber(name, value, 0, 1000000);
+        else if (name == "flood-burst") floodBurst = parseNumber(name, value, 1, 1000000);
+        else if (name == "flood-cost-light") floodCostLight = parseNumber(name, value, 0, 1000000);
+        else if (name == "flood-cost-message") floodCostMessage = parseNumber(name, value, 0, 1000000);
+        else if (name == "flood-cost-state") floodCostState = parseNumber(name, value, 0, 1000000);
+        else if (name == "flood-max-lines") floodMaxLines = parseNumber(name, value, 1, 1000000);
+        else if (name == "recvq") recvq = parseNumber(name, value, InputBuffer::MAX_LINE, 1L << 30);
+        else if (name == "sendq") sendq = parseNumber(name, value, InputBuffer::MAX_LINE, 1L << 30);
+        else if (name == "admin-port") adminPort = parseNumber(name, value, 0, 65535);
+        else if (name == "backlog") backlog = parseNumber(name, value, 1, 65535);
+        else if (name == "accept-batch") acceptBatch = parseNumber(name, value, 1, 100000);
+        else if (name == "defer-accept") deferAccept = parseNumber(name, value, 0, 600);
+        else if (name == "tcp-nodelay") tcpNoDelay = parseNumber(name, value, 0, 1) != 0;
+        else if (name == "sndbuf") sendBuffer = parseNumber(name, value, 0, 64L << 20);
+        else if (name == "rcvbuf") receiveBuffer = parseNumber(name, value, 0, 64L << 20);
+        else if (name == "drain-timeout") drainTimeout = parseNumber(name, value, 0, 3600);
+        else if (name == "server-name") serverName = value;
+        else if (name == "sid") sid = value;
+        else if (name == "link-password") linkPassword = value;
+        else if (name == "link") links.push_back(value);
+        else if (name == "link-sendq") linkSendq = parseNumber(name, value, InputBuffer::MAX_LINE, 1L << 30);
+        else if (name == "channel-db") channelDb = value;
+        else if (name == "channel-db-compact") channelDbCompact = parseNumber(name, value, 4096, 1L << 30);
+        else if (name == "history-lines") historyLines = parseNumber(name, value, 0, 100000);
+        else if (name == "history-bytes") historyBytes = parseNumber(name, value, InputBuffer::MAX_LINE, 1L << 30);
+        else if (name == "history-memory") historyMemory = parseNumber(name, value, InputBuffer::MAX_LINE, 1L << 40);
+        else if (name == "upgrade-fd") upgradeFd = parseNumber(name, value, 0, 1 << 20);
+        else throw std::runtime_error("Unknown option: --" + name);
+        if (name != "upgrade-fd") command.push_back(option);
+    }
+    validate();
+}
+
+static bool isSidChar(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z');
+}
+
+bool ServerConfig::isValidSid(const std::string& sid) {
+    return sid.length() == 3 && sid[0] >= '0' && sid[0] <= '9' && isSidChar(sid[1]) && isSidChar(sid[2]);
+}
+
+// Names and ids travel as single protocol tokens between servers
+void ServerConfig::validate() {
+    if (serverName.empty() || serverName.find_first_of(" :,") != std::string::npos || serverName.find('.') == std::string::npos)
+        throw std::runtime_error("Invalid value for --server-name: " + serverName + " (needs a dot, no spaces)");
+    if (!isValidSid(sid))
+        throw std::runtime_error("Invalid value for --sid: " + sid + " (a digit, then two digits or capitals)");
+    if (linkPassword.find(' ') != std::string::npos)
+        throw std::runtime_error("Invalid value for --link-password: no spaces");
+    for (size_t i = 0; i < links.size(); ++i) {
+        size_t colon = links[i].rfind(':');
+        if (colon == std::string::npos || colon == 0)
+            throw std::runtime_error("Invalid value for --link: " + links[i] + " (expected host:port)");
+        parseNumber("link", links[i].substr(colon + 1), 1, 65535);
+    }
+    if (!links.empty() && linkPassword.empty())
+        throw std::runtime_error("--link needs --link-password");
+}
@@ -0,0 +1,81 @@
+#include "FloodControl.hpp"
+#include "Config.hpp"
+
+FloodClass floodClassOf(CommandId id) {
+    switch (id) {
+        case CMD_PRIVMSG:
+            return FLOOD_MESSAGE;
+        case CMD_NICK:
+        case CMD_JOIN:
+        case CMD_PART:
+        case CMD_TOPIC:
+        case CMD_KICK:
+        case CMD_INVITE:
+        case CMD_MODE:
+        case CMD_STATS:
+        case CMD_CHATHISTORY:
+        case CMD_NAMES:
+            return FLOOD_STATE;
+        default:
+            return FLOOD_LIGHT;
+    }
+}
+
+
+// --- FloodPolicy ---
+FloodPolicy::FloodPolicy(const ServerConfig& config)
+    : rate(config.floodRate), burst(config.floodBurst), maxLines(config.floodMaxLines) {
+    cost[FLOOD_LIGHT] = config.floodCostLight;
+    cost[FLOOD_MESSAGE] = config.floodCostMessage;
+    cost[FLOOD_STATE] = config.floodCostState;
+}
+
+bool FloodPolicy::enabled() const { return rate > 0; }
+
+// Classifies a raw line by its command word without parsing it. JOIN,
+// PRIVMSG and NAMES pay for each comma-separated target, so a target list is no
+// cheaper than the lines it replaces.
+long FloodPolicy::costOfLine(const char* line, size_t length) const {
+    size_t pos = 0;
+    if (pos < length && line[pos] == ':') {
+        while (pos < length && line[pos] != ' ') ++pos;
+    }
+    while (pos < length && line[pos] == ' ') ++pos;
+    size_t start = pos;
+    while (pos < length && line[pos] != ' ') ++pos;
+    CommandId id = lookupCommand(StringView(line + start, pos - start));
+    long targets = 1;
+    if (id == CMD_JOIN || id == CMD_PRIVMSG || id == CMD_NAMES) {
+        while (pos < length && line[pos] == ' ') ++pos;
+        for (; pos < length && line[pos] != ' '; ++pos) {
+            if (line[pos] == ',') ++targets;
+        }
+    }
+    return cost[floodClassOf(id)] * targets;
+}
+
+// --- TokenBucket ---
+TokenBucket::TokenBucket() : _tokens(0), _stamp(-1) {}
+
+bool TokenBucket::ready(const FloodPolicy& policy, long nowMs) {
+    long capacity = policy.burst * 1000;
+    if (_stamp < 0) {
+        _tokens = capacity;
+    } else if (nowMs > _stamp) {
+        // rate tokens per second is rate thousandths per millisecond
+        long elapsed = nowMs - _stamp;
+        _tokens = (elapsed >= (capacity - _tokens) / policy.rate + 1) ? capacity
+                                                                     : _tokens + elapsed * policy.rate;
+    }
+    _stamp = nowMs;
+    return _tokens > 0;
+}
+
+void TokenBucket::charge(long cost) {
+    _tokens -= cost * 1000;
+}
+
+long TokenBucket::waitMs(const FloodPolicy& policy) const {
+    if (_tokens > 0) return 0;
+    return (-_tokens) / policy.rate + 1;
+}
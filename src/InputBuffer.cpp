@@ -0,0 +1,96 @@
+#include "InputBuffer.hpp"
+#include "MemoryAccount.hpp"
+#include <cstring>
+
+// A drained buffer larger than this gives its memory back
+static const size_t SHRINK_ABOVE = 16384;
+
+InputBuffer::InputBuffer() : _read(0), _scan(0), _write(0), _discarding(false) {}
+
+InputBuffer::~InputBuffer() {
+    MemoryAccount::release(_data.size());
+}
+
+char* InputBuffer::writePtr(size_t minSpace) {
+    if (_read == _write && _data.size() > SHRINK_ABOVE) {
+        MemoryAccount::release(_data.size());
+        std::vector<char>().swap(_data);
+        _read = _scan = _write = 0;
+    }
+    if (_data.size() - _write < minSpace) {
+        if (_read > 0) {
+            std::memmove(&_data[0], &_data[_read], _write - _read);
+            _write -= _read;
+            _scan -= _read;
+            _read = 0;
+        }
+        if (_data.size() - _write < minSpace) {
+            size_t oldSize = _data.size();
+            _data.resize(_write + minSpace > 2 * oldSize ? _write + minSpace : 2 * oldSize);
+            MemoryAccount::charge(_data.size() - oldSize);
+        }
+    }
+    return &_data[_write];
+}
+
+size_t InputBuffer::writeSpace() const {
+    return _data.size() - _write;
+}
+
+void InputBuffer::commit(size_t n) { _write += n; }
+
+bool InputBuffer::nextLine(char*& line, size_t& length) {
+    while (true) {
+        char* base = _data.empty() ? NULL : &_data[0];
+        char* newline = (_scan < _write) ? static_cast<char*>(std::memchr(base + _scan, '\n', _write - _scan)) : NULL;
+
+        if (_discarding) {
+            // Still inside an overlong line: drop everything up to its LF
+            if (!newline) {
+                _read = _scan = _write;
+                return false;
+            }
+            _read = _scan = (newline - base) + 1;
+            _discarding = false;
+            continue;
+        }
+
+        size_t end;
+        if (newline) {
+            end = newline - base;
+            _scan = end + 1;
+        } else if (_write - _read >= MAX_LINE) {
+            end = _read + MAX_LINE - 2; // Room for the CR LF we never saw
+            _scan = end;
+            _discarding = true;
+        } else {
+            _scan = _write;
+            return false;
+        }
+
+        line = base + _read;
+        length = end - _read;
+        if (length > 0 && line[length - 1] == '\r') --length;
+        if (length > MAX_LINE - 2) length = MAX_LINE - 2;
+        line[length] = '\0';
+        _read = newline ? end + 1 : end;
+        if (_discarding) _scan = _read;
+        return true;
+    }
+}
+
+size_t InputBuffer::size() const { return _write - _read; }
+const char* InputBuffer::data() const { return _data.empty() ? "" : &_data[_read]; }
+
+size_t InputBuffer::pendingLines() const {
+    size_t count = 0;
+    const char* end = _data.empty() ? NULL : &_data[0] + _write;
+    const char* pos = _data.empty() ? NULL : &_data[0] + _read;
+    while (pos < end) {
+        const char* newline = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+        if (!newline) break;
+        ++count;
+        pos = newline + 1;
+    }
+    return count;
+}
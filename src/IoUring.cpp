@@ -0,0 +1,308 @@
+#include "IoUring.hpp"
+#include <stdexcept>
+
+#ifdef __linux__
+# include <linux/io_uring.h>
+#endif
+
+#ifdef IORING_RECV_MULTISHOT
+# include <cstring>
+# include <cerrno>
+# include <poll.h>
+# include <unistd.h>
+# include <endian.h>
+# include <stdint.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+
+// The only provided-buffer group: every receive draws from it
+static const unsigned short BUFFER_GROUP = 0;
+
+static std::runtime_error systemError(const char* what) {
+    return std::runtime_error(std::string(what) + ": " + std::strerror(errno));
+}
+
+// --- IoCompletion ---
+bool IoCompletion::more() const { return (flags & IORING_CQE_F_MORE) != 0; }
+bool IoCompletion::hasBuffer() const { return (flags & IORING_CQE_F_BUFFER) != 0; }
+unsigned int IoCompletion::bufferId() const { return flags >> IORING_CQE_BUFFER_SHIFT; }
+
+// --- Setup ---
+IoUring::IoUring(unsigned int entries, unsigned int bufferCount, unsigned int bufferSize)
+    : _fd(-1), _ring(MAP_FAILED), _ringSize(0), _sqes(NULL), _sqesSize(0), _sqHead(NULL), _sqTail(NULL),
+      _sqMask(0), _sqEntries(0), _cqHead(NULL), _cqTail(NULL), _cqMask(0), _cqes(NULL), _queued(0),
+      _bufRing(NULL), _bufRingSize(0), _buffers(NULL), _bufferCount(bufferCount), _bufferSize(bufferSize),
+      _bufTail(0) {
+    if (bufferCount == 0 || (bufferCount & (bufferCount - 1)) != 0 || bufferCount > 32768)
+        throw std::runtime_error("io_uring buffer count must be a power of two up to 32768");
+    try {
+        setupRings(entries);
+        setupBuffers();
+    } catch (...) {
+        release();
+        throw;
+    }
+}
+
+IoUring::~IoUring() {
+    release();
+}
+
+// Closing the ring cancels whatever is still in flight
+void IoUring::release() {
+    if (_fd >= 0) close(_fd);
+    if (_sqes) munmap(_sqes, _sqesSize);
+    if (_ring != MAP_FAILED) munmap(_ring, _ringSize);
+    if (_bufRing) munmap(_bufRing, _bufRingSize);
+    if (_buffers) munmap(_buffers, static_cast<size_t>(_bufferCount) * _bufferSize);
+    _fd = -1;
+    _sqes = NULL;
+    _ring = MAP_FAILED;
+    _bufRing = NULL;
+    _buffers = NULL;
+}
+
+void IoUring::setupRings(unsigned int entries) {
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    // Multishot requests post many completions per submission
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+    _fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (_fd < 0) throw systemError("io_uring_setup");
+
+    unsigned int required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((params.features & required) != required)
+        throw std::runtime_error("io_uring lacks required features (needs Linux 5.11+)");
+
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    _ringSize = sqSize > cqSize ? sqSize : cqSize;
+    _ring = mmap(NULL, _ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    if (_ring == MAP_FAILED) throw systemError("io_uring ring mmap");
+    _sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(NULL, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) throw systemError("io_uring sqe mmap");
+    _sqes = static_cast<struct io_uring_sqe*>(sqes);
+
+    char* ring = static_cast<char*>(_ring);
+    _sqHead = reinterpret_cast<unsigned int*>(ring + params.sq_off.head);
+    _sqTail = reinterpret_cast<unsigned int*>(ring + params.sq_off.tail);
+    _sqMask = *reinterpret_cast<unsigned int*>(ring + params.sq_off.ring_mask);
+    _sqEntries = params.sq_entries;
+    _cqHead = reinterpret_cast<unsigned int*>(ring + params.cq_off.head);
+    _cqTail = reinterpret_cast<unsigned int*>(ring + params.cq_off.tail);
+    _cqMask = *reinterpret_cast<unsigned int*>(ring + params.cq_off.ring_mask);
+    _cqes = reinterpret_cast<struct io_uring_cqe*>(ring + params.cq_off.cqes);
+
+    // Slot i of the submission array always names SQE i
+    unsigned int* array = reinterpret_cast<unsigned int*>(ring + params.sq_off.array);
+    for (unsigned int i = 0; i < _sqEntries; ++i) {
+        array[i] = i;
+    }
+}
+
+void IoUring::setupBuffers() {
+    _bufRingSize = _bufferCount * sizeof(struct io_uring_buf);
+    void* ring = mmap(NULL, _bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) throw systemError("io_uring buffer ring mmap");
+    _bufRing = static_cast<struct io_uring_buf_ring*>(ring);
+    void* buffers = mmap(NULL, static_cast<size_t>(_bufferCount) * _bufferSize, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers == MAP_FAILED) throw systemError("io_uring buffer mmap");
+    _buffers = static_cast<char*>(buffers);
+
+    struct io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uintptr_t>(_bufRing);
+    reg.ring_entries = _bufferCount;
+    reg.bgid = BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, _fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        throw systemError("io_uring buffer ring registration (needs Linux 5.19+)");
+    for (unsigned int i = 0; i < _bufferCount; ++i) {
+        recycle(i);
+    }
+}
+
+// A throwaway ring and socketpair: multishot receive is the newest
+// feature used, and the kernel only rejects it once it runs
+bool IoUring::supported(std::string& reason) {
+    try {
+        IoUring ring(8, 8, 64);
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) < 0) throw systemError("socketpair");
+        ring.recvMultishot(pair[0], 1);
+        bool ok = write(pair[1], "x", 1) == 1;
+        ring.submitAndWait(1000);
+        IoCompletion completion;
+        ok = ok && ring.nextCompletion(completion) && completion.result == 1 && completion.more();
+        close(pair[0]);
+        close(pair[1]);
+        if (!ok) reason = "multishot receive is not supported (needs Linux 6.0+)";
+        return ok;
+    } catch (const std::exception& e) {
+        reason = e.what();
+        return false;
+    }
+}
+
+// --- Submission ---
+// The returned entry is zeroed; queue() hands it to the kernel side
+struct io_uring_sqe* IoUring::prepare(unsigned char opcode, int fd, unsigned long long userData) {
+    unsigned int tail = *_sqTail;
+    if (tail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) >= _sqEntries) {
+        // Full: submit what is queued without waiting for anything
+        int submitted = enter(_queued, 0, 0, -1);
+        if (submitted < 0) throw systemError("io_uring_enter");
+        _queued -= submitted;
+        if (tail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) >= _sqEntries)
+            throw std::runtime_error("io_uring submission queue stuck");
+    }
+    struct io_uring_sqe* sqe = &_sqes[tail & _sqMask];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = userData;
+    return sqe;
+}
+
+void IoUring::queue() {
+    __atomic_store_n(_sqTail, *_sqTail + 1, __ATOMIC_RELEASE);
+    ++_queued;
+}
+
+void IoUring::acceptMultishot(int fd, unsigned long long userData) {
+    struct io_uring_sqe* sqe = prepare(IORING_OP_ACCEPT, fd, userData);
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    queue();
+}
+
+void IoUring::pollMultishot(int fd, unsigned long long userData) {
+    struct io_uring_sqe* sqe = prepare(IORING_OP_POLL_ADD, fd, userData);
+    sqe->len = IORING_POLL_ADD_MULTI;
+    unsigned int events = POLLIN;
+# if __BYTE_ORDER == __BIG_ENDIAN
+    events = (events << 16) | (events >> 16); // The kernel reads the field as two halves
+# endif
+    sqe->poll32_events = events;
+    queue();
+}
+
+void IoUring::recvMultishot(int fd, unsigned long long userData) {
+    struct io_uring_sqe* sqe = prepare(IORING_OP_RECV, fd, userData);
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    queue();
+}
+
+void IoUring::sendmsg(int fd, const struct msghdr* msg, unsigned long long userData) {
+    struct io_uring_sqe* sqe = prepare(IORING_OP_SENDMSG, fd, userData);
+    sqe->addr = reinterpret_cast<uintptr_t>(msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    queue();
+}
+
+void IoUring::cancel(unsigned long long target, unsigned long long userData) {
+    struct io_uring_sqe* sqe = prepare(IORING_OP_ASYNC_CANCEL, -1, userData);
+    sqe->addr = target;
+    queue();
+}
+
+void IoUring::cancelAll(unsigned long long userData) {
+    struct io_uring_sqe* sqe = prepare(IORING_OP_ASYNC_CANCEL, -1, userData);
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+    queue();
+}
+
+int IoUring::enter(unsigned int toSubmit, unsigned int minComplete, unsigned int flags, int timeoutMs) {
+    struct __kernel_timespec timeout;
+    struct io_uring_getevents_arg arg;
+    void* argp = NULL;
+    size_t argSize = 0;
+    if (timeoutMs >= 0 && (flags & IORING_ENTER_GETEVENTS)) {
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+        std::memset(&arg, 0, sizeof(arg));
+        arg.ts = reinterpret_cast<uintptr_t>(&timeout);
+        argp = &arg;
+        argSize = sizeof(arg);
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+    return syscall(__NR_io_uring_enter, _fd, toSubmit, minComplete, flags, argp, argSize);
+}
+
+void IoUring::submitAndWait(int timeoutMs) {
+    bool waiting = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE) != *_cqHead;
+    if (waiting && _queued == 0) return;
+    unsigned int flags = (waiting || timeoutMs == 0) ? 0 : IORING_ENTER_GETEVENTS;
+    int submitted = enter(_queued, flags ? 1 : 0, flags, timeoutMs);
+    if (submitted < 0) {
+        // Timed out, interrupted, or short of memory for completions: the
+        // caller just goes round again
+        if (errno == ETIME || errno == EINTR || errno == EAGAIN || errno == EBUSY) return;
+        throw systemError("io_uring_enter");
+    }
+    _queued -= submitted;
+}
+
+// --- Completion ---
+bool IoUring::nextCompletion(IoCompletion& completion) {
+    unsigned int head = *_cqHead;
+    if (head == __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE)) return false;
+    const struct io_uring_cqe* cqe = &_cqes[head & _cqMask];
+    completion.userData = cqe->user_data;
+    completion.result = cqe->res;
+    completion.flags = cqe->flags;
+    __atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// --- Provided Buffers ---
+const char* IoUring::buffer(unsigned int id) const {
+    return _buffers + static_cast<size_t>(id) * _bufferSize;
+}
+
+// Slot 0's reserved field is the ring tail, so slots are filled field by
+// field, never cleared as a whole. The slots are indexed by hand: in C++
+// the header's flexible bufs[] member does not start at offset 0.
+void IoUring::recycle(unsigned int id) {
+    struct io_uring_buf* slot = reinterpret_cast<struct io_uring_buf*>(_bufRing) + (_bufTail & (_bufferCount - 1));
+    slot->addr = reinterpret_cast<uintptr_t>(buffer(id));
+    slot->len = _bufferSize;
+    slot->bid = static_cast<unsigned short>(id);
+    ++_bufTail;
+    __atomic_store_n(&_bufRing->tail, _bufTail, __ATOMIC_RELEASE);
+}
+
+#else // No io_uring headers: the backend is never selected
+
+bool IoCompletion::more() const { return false; }
+bool IoCompletion::hasBuffer() const { return false; }
+unsigned int IoCompletion::bufferId() const { return 0; }
+
+IoUring::IoUring(unsigned int, unsigned int, unsigned int) {
+    throw std::runtime_error("io_uring is not available on this platform");
+}
+
+IoUring::~IoUring() {}
+
+bool IoUring::supported(std::string& reason) {
+    reason = "not built with io_uring support";
+    return false;
+}
+
+void IoUring::acceptMultishot(int, unsigned long long) {}
+void IoUring::pollMultishot(int, unsigned long long) {}
+void IoUring::recvMultishot(int, unsigned long long) {}
+void IoUring::sendmsg(int, const struct msghdr*, unsigned long long) {}
+void IoUring::cancel(unsigned long long, unsigned long long) {}
+void IoUring::cancelAll(unsigned long long) {}
+void IoUring::submitAndWait(int) {}
+bool IoUring::nextCompletion(IoCompletion&) { return false; }
+const char* IoUring::buffer(unsigned int) const { return NULL; }
+void IoUring::recycle(unsigned int) {}
+
+#endif
@@ -0,0 +1,36 @@
+#include "IrcString.hpp"
+
+char ircToLower(char c) {
+    if (c >= 'A' && c <= '^') return c + ('a' - 'A'); // A-Z [ \ ] ^ -> a-z { | } ~
+    return c;
+}
+
+std::string ircToLower(const std::string& s) {
+    std::string lower(s);
+    for (size_t i = 0; i < lower.length(); ++i) {
+        lower[i] = ircToLower(lower[i]);
+    }
+    return lower;
+}
+
+bool ircEquals(const std::string& a, const std::string& b) {
+    if (a.length() != b.length()) return false;
+    for (size_t i = 0; i < a.length(); ++i) {
+        if (ircToLower(a[i]) != ircToLower(b[i])) return false;
+    }
+    return true;
+}
+
+// FNV-1a over the folded bytes
+size_t IrcCaseHash::operator()(const std::string& s) const {
+    size_t h = 2166136261UL;
+    for (size_t i = 0; i < s.length(); ++i) {
+        h ^= (unsigned char)ircToLower(s[i]);
+        h *= 16777619UL;
+    }
+    return h;
+}
+
+bool IrcCaseEqual::operator()(const std::string& a, const std::string& b) const {
+    return ircEquals(a, b);
+}
@@ -0,0 +1,185 @@
+#include "Logger.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <strings.h>
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+#include <fcntl.h>
+
+static const char* const LEVEL_NAMES[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+static const char* const CATEGORY_NAMES[] = { "server", "conn", "wire" };
+
+// Idle writer thread checks the ring this often
+static const useconds_t IDLE_SLEEP_US = 5000;
+// Formatted bytes buffered before a write()
+static const size_t BATCH_BYTES = 64 * 1024;
+
+Logger& Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger()
+    : _ring(RING_SIZE), _enqueuePos(0), _dequeuePos(0), _dropped(0), _droppedReported(0),
+      _level(LOG_INFO), _fd(STDOUT_FILENO), _ownsFd(false), _threadStarted(false), _running(0) {
+    for (size_t i = 0; i < RING_SIZE; ++i) {
+        _ring[i].sequence = i;
+    }
+    _categories[LOG_SERVER] = true;
+    _categories[LOG_CONN] = true;
+    _categories[LOG_WIRE] = false;
+}
+
+Logger::~Logger() {
+    stop();
+    if (_ownsFd) close(_fd);
+}
+
+void Logger::configure(const std::string& path, const std::string& level, const std::string& categories) {
+    bool found = false;
+    for (int i = LOG_DEBUG; i <= LOG_ERROR; ++i) {
+        if (strcasecmp(level.c_str(), LEVEL_NAMES[i]) == 0) {
+            _level = static_cast<LogLevel>(i);
+            found = true;
+        }
+    }
+    if (!found) throw std::runtime_error("Unknown log level: " + level);
+
+    for (int i = 0; i < LOG_CATEGORY_COUNT; ++i) {
+        _categories[i] = false;
+    }
+    size_t start = 0;
+    while (start <= categories.length()) {
+        size_t end = categories.find(',', start);
+        if (end == std::string::npos) end = categories.length();
+        std::string name = categories.substr(start, end - start);
+        found = name.empty();
+        for (int i = 0; i < LOG_CATEGORY_COUNT; ++i) {
+            if (name == CATEGORY_NAMES[i] || name == "all") {
+                _categories[i] = true;
+                found = true;
+            }
+        }
+        if (!found) throw std::runtime_error("Unknown log category: " + name);
+        start = end + 1;
+    }
+
+    if (path != "-") {
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) throw std::runtime_error("Failed to open log file: " + path);
+        if (_ownsFd) close(_fd);
+        _fd = fd;
+        _ownsFd = true;
+    }
+}
+
+bool Logger::enabled(LogLevel level, LogCategory category) const {
+    return level >= _level && _categories[category];
+}
+
+unsigned long Logger::dropped() const {
+    return __atomic_load_n(&_dropped, __ATOMIC_RELAXED);
+}
+
+// --- Producer Side (any thread) ---
+// Bounded MPMC ring with per-slot sequence numbers (Vyukov): a slot is free
+// for position pos when its sequence equals pos, and readable at pos + 1.
+void Logger::write(LogLevel level, LogCategory category, const std::string& text) {
+    size_t pos = __atomic_load_n(&_enqueuePos, __ATOMIC_RELAXED);
+    Record* record;
+    while (true) {
+        record = &_ring[pos & (RING_SIZE - 1)];
+        size_t sequence = __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE);
+        long diff = (long)sequence - (long)pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&_enqueuePos, &pos, pos + 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0) {
+            __atomic_add_fetch(&_dropped, 1, __ATOMIC_RELAXED); // Ring full
+            return;
+        } else {
+            pos = __atomic_load_n(&_enqueuePos, __ATOMIC_RELAXED);
+        }
+    }
+
+    gettimeofday(&record->time, NULL);
+    record->level = level;
+    record->category = category;
+    record->length = text.length() < TEXT_MAX ? text.length() : TEXT_MAX;
+    std::memcpy(record->text, text.data(), record->length);
+    __atomic_store_n(&record->sequence, pos + 1, __ATOMIC_RELEASE);
+}
+
+// --- Writer Thread ---
+void Logger::start() {
+    if (_threadStarted) return;
+    __atomic_store_n(&_running, 1, __ATOMIC_SEQ_CST);
+    if (pthread_create(&_thread, NULL, &Logger::threadMain, this) != 0)
+        throw std::runtime_error("Failed to start logger thread");
+    _threadStarted = true;
+}
+
+void Logger::stop() {
+    if (!_threadStarted) return;
+    __atomic_store_n(&_running, 0, __ATOMIC_SEQ_CST);
+    pthread_join(_thread, NULL);
+    _threadStarted = false;
+    drain();
+}
+
+void* Logger::threadMain(void* arg) {
+    Logger* logger = static_cast<Logger*>(arg);
+    while (__atomic_load_n(&logger->_running, __ATOMIC_SEQ_CST)) {
+        logger->drain();
+        usleep(IDLE_SLEEP_US);
+    }
+    return NULL;
+}
+
+// Appends the next record, formatted, to out. Single consumer only.
+bool Logger::popInto(std::string& out) {
+    Record& record = _ring[_dequeuePos & (RING_SIZE - 1)];
+    if (__atomic_load_n(&record.sequence, __ATOMIC_ACQUIRE) != _dequeuePos + 1) return false;
+
+    char stamp[32];
+    time_t seconds = record.time.tv_sec;
+    struct tm local;
+    localtime_r(&seconds, &local);
+    size_t len = strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+    snprintf(stamp + len, sizeof(stamp) - len, ".%03d ", (int)(record.time.tv_usec / 1000));
+
+    out += stamp;
+    out += LEVEL_NAMES[record.level];
+    out += ' ';
+    out += CATEGORY_NAMES[record.category];
+    out += ": ";
+    out.append(record.text, record.length);
+    out += '\n';
+
+    __atomic_store_n(&record.sequence, _dequeuePos + RING_SIZE, __ATOMIC_RELEASE);
+    ++_dequeuePos;
+    return true;
+}
+
+void Logger::drain() {
+    std::string batch;
+    while (true) {
+        bool more = popInto(batch);
+        if (batch.length() >= BATCH_BYTES || (!more && !batch.empty())) {
+            ssize_t ret = ::write(_fd, batch.data(), batch.length());
+            (void)ret;
+            batch.clear();
+        }
+        if (!more) break;
+    }
+
+    unsigned long dropped = this->dropped();
+    if (dropped != _droppedReported) {
+        char note[96];
+        int len = snprintf(note, sizeof(note), "logger: %lu records dropped (ring full)\n", dropped - _droppedReported);
+        ssize_t ret = ::write(_fd, note, len);
+        (void)ret;
+        _droppedReported = dropped;
+    }
+}
@@ -0,0 +1,15 @@
+#include "MemoryAccount.hpp"
+
+volatile size_t MemoryAccount::_used = 0;
+
+void MemoryAccount::charge(size_t bytes) {
+    __atomic_add_fetch(&_used, bytes, __ATOMIC_RELAXED);
+}
+
+void MemoryAccount::release(size_t bytes) {
+    __atomic_sub_fetch(&_used, bytes, __ATOMIC_RELAXED);
+}
+
+size_t MemoryAccount::used() {
+    return __atomic_load_n(&_used, __ATOMIC_RELAXED);
+}
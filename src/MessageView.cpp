@@ -0,0 +1,83 @@
+#include "MessageView.hpp"
+#include <cstring>
+
+// --- StringView ---
+StringView::StringView() : _data(""), _length(0) {}
+
+StringView::StringView(const char* data, size_t length) : _data(data), _length(length) {}
+
+const char* StringView::data() const { return _data; }
+const char* StringView::c_str() const { return _data; }
+size_t StringView::length() const { return _length; }
+size_t StringView::size() const { return _length; }
+bool StringView::empty() const { return _length == 0; }
+char StringView::operator[](size_t i) const { return _data[i]; }
+
+std::string StringView::str() const { return std::string(_data, _length); }
+
+bool StringView::equalsIgnoreCase(const char* literal) const {
+    size_t i = 0;
+    for (; i < _length && literal[i]; ++i) {
+        char c = _data[i];
+        if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+        if (c != literal[i]) return false;
+    }
+    return i == _length && literal[i] == '\0';
+}
+
+bool operator==(const StringView& a, const std::string& b) {
+    return a.length() == b.length() && std::memcmp(a.data(), b.data(), a.length()) == 0;
+}
+
+bool operator!=(const StringView& a, const std::string& b) {
+    return !(a == b);
+}
+
+// --- MessageView ---
+MessageView::MessageView() : paramCount(0) {}
+
+size_t MessageView::size() const { return paramCount; }
+bool MessageView::empty() const { return paramCount == 0; }
+const StringView& MessageView::operator[](size_t i) const { return params[i]; }
+
+// Cuts the token starting at line[pos] at the next space and returns its view
+static StringView takeToken(char* line, size_t length, size_t& pos) {
+    size_t start = pos;
+    while (pos < length && line[pos] != ' ') ++pos;
+    StringView token(line + start, pos - start);
+    if (pos < length) line[pos++] = '\0';
+    return token;
+}
+
+static void skipSpaces(const char* line, size_t length, size_t& pos) {
+    while (pos < length && line[pos] == ' ') ++pos;
+}
+
+bool parseMessage(char* line, size_t length, MessageView& message) {
+    message.prefix = StringView();
+    message.command = StringView();
+    message.paramCount = 0;
+
+    size_t pos = 0;
+    skipSpaces(line, length, pos);
+    if (pos < length && line[pos] == ':') {
+        ++pos;
+        message.prefix = takeToken(line, length, pos);
+        skipSpaces(line, length, pos);
+    }
+    if (pos >= length) return false;
+    message.command = takeToken(line, length, pos);
+
+    while (message.paramCount < MessageView::MAX_PARAMS) {
+        skipSpaces(line, length, pos);
+        if (pos >= length) break;
+        // The last slot always takes the rest of the line, as RFC 1459 does
+        if (line[pos] == ':' || message.paramCount == MessageView::MAX_PARAMS - 1) {
+            if (line[pos] == ':') ++pos;
+            message.params[message.paramCount++] = StringView(line + pos, length - pos);
+            break;
+        }
+        message.params[message.paramCount++] = takeToken(line, length, pos);
+    }
+    return true;
+}
@@ -0,0 +1,54 @@
+#include "Metrics.hpp"
+
+const unsigned long LATENCY_BOUNDS_US[] = { 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 100000 };
+const size_t LATENCY_BOUND_COUNT = sizeof(LATENCY_BOUNDS_US) / sizeof(LATENCY_BOUNDS_US[0]);
+
+const unsigned long FANOUT_BOUNDS[] = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 5000 };
+const size_t FANOUT_BOUND_COUNT = sizeof(FANOUT_BOUNDS) / sizeof(FANOUT_BOUNDS[0]);
+
+// --- Counter / Gauge ---
+Counter::Counter() : _value(0) {}
+void Counter::add(unsigned long n) { __atomic_add_fetch(&_value, n, __ATOMIC_RELAXED); }
+unsigned long Counter::get() const { return __atomic_load_n(&_value, __ATOMIC_RELAXED); }
+
+Gauge::Gauge() : _value(0) {}
+void Gauge::set(unsigned long value) { __atomic_store_n(&_value, value, __ATOMIC_RELAXED); }
+unsigned long Gauge::get() const { return __atomic_load_n(&_value, __ATOMIC_RELAXED); }
+
+// --- Histogram ---
+Histogram::Histogram(const unsigned long* bounds, size_t count)
+    : _bounds(bounds), _boundCount(count < MAX_BOUNDS ? count : MAX_BOUNDS) {}
+
+void Histogram::record(unsigned long value) {
+    size_t i = 0;
+    while (i < _boundCount && value > _bounds[i]) ++i;
+    _buckets[i].add();
+    _count.add();
+    _sum.add(value);
+}
+
+size_t Histogram::boundCount() const { return _boundCount; }
+unsigned long Histogram::bound(size_t i) const { return _bounds[i]; }
+unsigned long Histogram::bucket(size_t i) const { return _buckets[i].get(); }
+unsigned long Histogram::count() const { return _count.get(); }
+unsigned long Histogram::sum() const { return _sum.get(); }
+
+unsigned long Histogram::quantileBound(double q) const {
+    unsigned long total = 0;
+    for (size_t i = 0; i <= _boundCount; ++i) total += bucket(i);
+    if (total == 0) return 0;
+
+    unsigned long rank = static_cast<unsigned long>(q * total);
+    if (rank >= total) rank = total - 1;
+    unsigned long seen = 0;
+    for (size_t i = 0; i < _boundCount; ++i) {
+        seen += bucket(i);
+        if (seen > rank) return _bounds[i];
+    }
+    return 0;
+}
+
+// --- ServerMetrics ---
+ServerMetrics::ServerMetrics()
+    : fanout(FANOUT_BOUNDS, FANOUT_BOUND_COUNT),
+      coreLatency(LATENCY_BOUNDS_US, LATENCY_BOUND_COUNT) {}
@@ -0,0 +1,83 @@
+#include "MpscQueue.hpp"
+#include <stdexcept>
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef __linux__
+# include <sys/eventfd.h>
+#endif
+
+// --- MpscQueue ---
+MpscQueue::MpscQueue() : _head(&_stub), _tail(&_stub) {}
+
+MpscQueue::~MpscQueue() {}
+
+void MpscQueue::push(MpscNode* node) {
+    __atomic_store_n(&node->next, (MpscNode*)0, __ATOMIC_RELAXED);
+    MpscNode* prev = __atomic_exchange_n(&_head, node, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+}
+
+MpscNode* MpscQueue::pop() {
+    MpscNode* tail = _tail;
+    MpscNode* next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (tail == &_stub) {
+        if (!next) return 0;
+        _tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+    if (next) {
+        _tail = next;
+        return tail;
+    }
+    if (tail != __atomic_load_n(&_head, __ATOMIC_ACQUIRE)) return 0; // Push in progress
+    push(&_stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next) {
+        _tail = next;
+        return tail;
+    }
+    return 0;
+}
+
+// --- Notifier ---
+Notifier::Notifier() : _readFd(-1), _writeFd(-1), _pending(0) {
+#ifdef __linux__
+    _readFd = _writeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_readFd < 0) throw std::runtime_error("Failed to create eventfd");
+#else
+    int fds[2];
+    if (pipe(fds) < 0) throw std::runtime_error("Failed to create wakeup pipe");
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    _readFd = fds[0];
+    _writeFd = fds[1];
+#endif
+}
+
+Notifier::~Notifier() {
+    if (_writeFd != _readFd) close(_writeFd);
+    close(_readFd);
+}
+
+int Notifier::fd() const { return _readFd; }
+
+void Notifier::notify() {
+    if (__atomic_exchange_n(&_pending, 1, __ATOMIC_SEQ_CST) == 0) {
+#ifdef __linux__
+        unsigned long long one = 1;
+        ssize_t ret = write(_writeFd, &one, sizeof(one));
+#else
+        char one = 1;
+        ssize_t ret = write(_writeFd, &one, sizeof(one));
+#endif
+        (void)ret;
+    }
+}
+
+void Notifier::consume() {
+    // Reset first: a push that lands after this point will notify again
+    __atomic_store_n(&_pending, 0, __ATOMIC_SEQ_CST);
+    char buffer[64];
+    while (read(_readFd, buffer, sizeof(buffer)) > 0) {}
+}
@@ -0,0 +1,82 @@
+#include "OutputQueue.hpp"
+#include "MemoryAccount.hpp"
+#include <cerrno>
+
+// Upper bound on iovecs per writev(); well below IOV_MAX everywhere
+static const size_t MAX_IOVECS = 64;
+
+OutputQueue::OutputQueue() : _offset(0), _bytes(0) {}
+
+OutputQueue::~OutputQueue() {
+    MemoryAccount::release(_bytes);
+}
+
+void OutputQueue::push(const PayloadRef& line) {
+    if (line.empty()) return;
+    _lines.push_back(line);
+    _bytes += line.length();
+    MemoryAccount::charge(line.length());
+}
+
+bool OutputQueue::empty() const { return _lines.empty(); }
+
+size_t OutputQueue::bytes() const { return _bytes; }
+
+void OutputQueue::appendTo(std::string& out) const {
+    out.reserve(out.length() + _bytes);
+    for (std::deque<PayloadRef>::const_iterator it = _lines.begin(); it != _lines.end(); ++it) {
+        size_t skip = (it == _lines.begin()) ? _offset : 0;
+        out.append(it->data() + skip, it->length() - skip);
+    }
+}
+
+ssize_t OutputQueue::flush(int fd) {
+    ssize_t total = 0;
+    while (!_lines.empty()) {
+        struct iovec iov[MAX_IOVECS];
+        size_t count = gather(iov, NULL, MAX_IOVECS);
+        size_t requested = 0;
+        for (size_t i = 0; i < count; ++i) {
+            requested += iov[i].iov_len;
+        }
+
+        ssize_t written = writev(fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return total;
+            return -1;
+        }
+        total += written;
+        consume(written);
+        if ((size_t)written < requested) return total; // Socket buffer is full
+    }
+    return total;
+}
+
+size_t OutputQueue::gather(struct iovec* iov, PayloadRef* lines, size_t max) const {
+    size_t count = 0;
+    for (std::deque<PayloadRef>::const_iterator it = _lines.begin(); it != _lines.end() && count < max; ++it) {
+        size_t skip = (count == 0) ? _offset : 0;
+        iov[count].iov_base = const_cast<char*>(it->data()) + skip;
+        iov[count].iov_len = it->length() - skip;
+        if (lines) lines[count] = *it;
+        ++count;
+    }
+    return count;
+}
+
+// Pops every line that went out completely, remembers where we stopped
+void OutputQueue::consume(size_t bytes) {
+    _bytes -= bytes;
+    MemoryAccount::release(bytes);
+    while (bytes > 0) {
+        size_t left = _lines.front().length() - _offset;
+        if (bytes < left) {
+            _offset += bytes;
+            break;
+        }
+        bytes -= left;
+        _lines.pop_front();
+        _offset = 0;
+    }
+}
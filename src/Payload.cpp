@@ -0,0 +1,134 @@
+#include "Payload.hpp"
+#include "SlabPool.hpp"
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+// --- Block Pools ---
+// Size classes for header + line; IRC caps lines at 512 bytes, so only
+// oversized server output falls through to the heap.
+static const size_t SIZE_CLASSES[] = { 64, 128, 256, 576 };
+static const size_t SIZE_CLASS_COUNT = sizeof(SIZE_CLASSES) / sizeof(SIZE_CLASSES[0]);
+static const char* const POOL_NAMES[] = { "payload64", "payload128", "payload256", "payload576" };
+
+static SlabPool** createPools() {
+    SlabPool** pools = new SlabPool*[SIZE_CLASS_COUNT];
+    for (size_t i = 0; i < SIZE_CLASS_COUNT; ++i) {
+        pools[i] = new SlabPool(POOL_NAMES[i], SIZE_CLASSES[i]);
+    }
+    return pools;
+}
+
+// Created on first use, never destroyed: reactors release payloads late
+static SlabPool** payloadPools() {
+    static SlabPool** pools = createPools();
+    return pools;
+}
+
+// Pool for a block of this many bytes, or NULL for the heap
+static SlabPool* poolFor(size_t bytes) {
+    for (size_t i = 0; i < SIZE_CLASS_COUNT; ++i) {
+        if (bytes <= SIZE_CLASSES[i]) return payloadPools()[i];
+    }
+    return NULL;
+}
+
+// --- LineBuilder ---
+LineBuilder::LineBuilder() : _count(0), _length(0) {}
+
+LineBuilder& LineBuilder::operator<<(const std::string& piece) { return append(piece.data(), piece.length()); }
+LineBuilder& LineBuilder::operator<<(const StringView& piece) { return append(piece.data(), piece.length()); }
+LineBuilder& LineBuilder::operator<<(const char* piece) { return append(piece, std::strlen(piece)); }
+
+LineBuilder& LineBuilder::append(const char* data, size_t length) {
+    if (_count == MAX_PIECES) throw std::runtime_error("LineBuilder: too many pieces");
+    _pieces[_count] = data;
+    _lengths[_count] = length;
+    ++_count;
+    _length += length;
+    return *this;
+}
+
+size_t LineBuilder::length() const { return _length; }
+
+void LineBuilder::copyTo(char* out) const {
+    for (size_t i = 0; i < _count; ++i) {
+        std::memcpy(out, _pieces[i], _lengths[i]);
+        out += _lengths[i];
+    }
+}
+
+std::string LineBuilder::str() const {
+    std::string line(_length, '\0');
+    if (_length) copyTo(&line[0]);
+    return line;
+}
+
+// --- Payload ---
+Payload* Payload::create(const std::string& line) {
+    return create(LineBuilder() << line);
+}
+
+// One allocation, sized up front, and one copy of every piece
+Payload* Payload::create(const LineBuilder& line) {
+    Payload* payload = allocate(line.length() + 2);
+    line.copyTo(payload->bytes());
+    std::memcpy(payload->bytes() + line.length(), "\r\n", 2);
+    return payload;
+}
+
+Payload* Payload::createRaw(const std::string& bytes) {
+    Payload* payload = allocate(bytes.length());
+    std::memcpy(payload->bytes(), bytes.data(), bytes.length());
+    return payload;
+}
+
+Payload* Payload::allocate(size_t length) {
+    SlabPool* pool = poolFor(sizeof(Payload) + length);
+    void* block = pool ? pool->allocate() : ::operator new(sizeof(Payload) + length);
+    return new (block) Payload(length);
+}
+
+Payload::Payload(size_t length) : _refs(1), _length(length) {}
+
+Payload::~Payload() {}
+
+// Recipients may live on different reactor threads, so counting is atomic
+void Payload::retain() { __atomic_add_fetch(&_refs, 1, __ATOMIC_RELAXED); }
+
+void Payload::release() {
+    if (__atomic_sub_fetch(&_refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        SlabPool* pool = poolFor(sizeof(Payload) + _length);
+        this->~Payload();
+        if (pool) pool->deallocate(this);
+        else ::operator delete(this);
+    }
+}
+
+char* Payload::bytes() { return reinterpret_cast<char*>(this + 1); }
+const char* Payload::data() const { return reinterpret_cast<const char*>(this + 1); }
+size_t Payload::length() const { return _length; }
+
+// --- PayloadRef ---
+PayloadRef::PayloadRef() : _payload(NULL) {}
+
+PayloadRef::PayloadRef(Payload* payload) : _payload(payload) {}
+
+PayloadRef::PayloadRef(const PayloadRef& other) : _payload(other._payload) {
+    if (_payload) _payload->retain();
+}
+
+PayloadRef& PayloadRef::operator=(const PayloadRef& other) {
+    if (other._payload) other._payload->retain();
+    if (_payload) _payload->release();
+    _payload = other._payload;
+    return *this;
+}
+
+PayloadRef::~PayloadRef() {
+    if (_payload) _payload->release();
+}
+
+const char* PayloadRef::data() const { return _payload ? _payload->data() : ""; }
+size_t PayloadRef::length() const { return _payload ? _payload->length() : 0; }
+bool PayloadRef::empty() const { return _payload == NULL; }
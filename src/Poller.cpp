@@ -0,0 +1,151 @@
+#include "Poller.hpp"
+#include <stdexcept>
+#include <cerrno>
+#include <unistd.h>
+
+Poller::~Poller() {}
+
+bool Poller::isEdgeTriggered() const { return false; }
+
+Poller* Poller::create(const std::string& backend) {
+    if (backend == "poll")
+        return new PollPoller();
+#ifdef __linux__
+    if (backend == "epoll")
+        return new EpollPoller(false);
+    if (backend == "epoll-et")
+        return new EpollPoller(true);
+#endif
+    throw std::runtime_error("Unsupported event backend: " + backend);
+}
+
+// --- PollPoller ---
+PollPoller::PollPoller() {}
+
+PollPoller::~PollPoller() {}
+
+static short toPollEvents(unsigned int events) {
+    short pollEvents = 0;
+    if (events & POLLER_READ) pollEvents |= POLLIN;
+    if (events & POLLER_WRITE) pollEvents |= POLLOUT;
+    return pollEvents;
+}
+
+void PollPoller::add(int fd, unsigned int events) {
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = toPollEvents(events);
+    pfd.revents = 0;
+    _index[fd] = _pollfds.size();
+    _pollfds.push_back(pfd);
+}
+
+void PollPoller::modify(int fd, unsigned int events) {
+    std::map<int, size_t>::iterator it = _index.find(fd);
+    if (it != _index.end()) {
+        _pollfds[it->second].events = toPollEvents(events);
+    }
+}
+
+void PollPoller::remove(int fd) {
+    std::map<int, size_t>::iterator it = _index.find(fd);
+    if (it == _index.end()) return;
+
+    // Swap with the last entry so removal stays O(log n)
+    size_t pos = it->second;
+    size_t last = _pollfds.size() - 1;
+    if (pos != last) {
+        _pollfds[pos] = _pollfds[last];
+        _index[_pollfds[pos].fd] = pos;
+    }
+    _pollfds.pop_back();
+    _index.erase(it);
+}
+
+int PollPoller::wait(std::vector<PollerEvent>& ready, int timeoutMs) {
+    ready.clear();
+    int count = poll(_pollfds.empty() ? NULL : &_pollfds[0], _pollfds.size(), timeoutMs);
+    if (count < 0) {
+        if (errno == EINTR) return 0;
+        throw std::runtime_error("Poll failed");
+    }
+    for (size_t i = 0; i < _pollfds.size() && (int)ready.size() < count; ++i) {
+        short revents = _pollfds[i].revents;
+        if (!revents) continue;
+
+        PollerEvent ev;
+        ev.fd = _pollfds[i].fd;
+        ev.events = 0;
+        if (revents & POLLIN) ev.events |= POLLER_READ;
+        if (revents & POLLOUT) ev.events |= POLLER_WRITE;
+        if (revents & (POLLHUP | POLLERR | POLLNVAL)) ev.events |= POLLER_ERROR;
+        ready.push_back(ev);
+    }
+    return ready.size();
+}
+
+const char* PollPoller::name() const { return "poll"; }
+
+#ifdef __linux__
+// --- EpollPoller ---
+EpollPoller::EpollPoller(bool edgeTriggered)
+    : _epfd(epoll_create1(EPOLL_CLOEXEC)), _edgeTriggered(edgeTriggered), _events(256) {
+    if (_epfd < 0) throw std::runtime_error("Failed to create epoll instance");
+}
+
+EpollPoller::~EpollPoller() {
+    close(_epfd);
+}
+
+unsigned int EpollPoller::toEpoll(unsigned int events) const {
+    unsigned int epollEvents = EPOLLRDHUP;
+    if (events & POLLER_READ) epollEvents |= EPOLLIN;
+    if (events & POLLER_WRITE) epollEvents |= EPOLLOUT;
+    if (_edgeTriggered) epollEvents |= EPOLLET;
+    return epollEvents;
+}
+
+void EpollPoller::add(int fd, unsigned int events) {
+    struct epoll_event ev;
+    ev.events = toEpoll(events);
+    ev.data.fd = fd;
+    if (epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+        throw std::runtime_error("epoll_ctl(ADD) failed");
+}
+
+void EpollPoller::modify(int fd, unsigned int events) {
+    struct epoll_event ev;
+    ev.events = toEpoll(events);
+    ev.data.fd = fd;
+    epoll_ctl(_epfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+void EpollPoller::remove(int fd) {
+    epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+int EpollPoller::wait(std::vector<PollerEvent>& ready, int timeoutMs) {
+    ready.clear();
+    int count = epoll_wait(_epfd, &_events[0], _events.size(), timeoutMs);
+    if (count < 0) {
+        if (errno == EINTR) return 0;
+        throw std::runtime_error("epoll_wait failed");
+    }
+    for (int i = 0; i < count; ++i) {
+        PollerEvent ev;
+        ev.fd = _events[i].data.fd;
+        ev.events = 0;
+        if (_events[i].events & EPOLLIN) ev.events |= POLLER_READ;
+        if (_events[i].events & EPOLLOUT) ev.events |= POLLER_WRITE;
+        if (_events[i].events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) ev.events |= POLLER_ERROR;
+        ready.push_back(ev);
+    }
+    // A full batch means more may be pending: grow for the next call
+    if (count == (int)_events.size()) _events.resize(_events.size() * 2);
+    return count;
+}
+
+bool EpollPoller::isEdgeTriggered() const { return _edgeTriggered; }
+
+const char* EpollPoller::name() const { return _edgeTriggered ? "epoll-et" : "epoll"; }
+#endif
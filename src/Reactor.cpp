@@ -0,0 +1,832 @@
+#include "Reactor.hpp"
+#include "Server.hpp"
+#include "Logger.hpp"
+#include "Clock.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#include <stdint.h>
+
+// Minimum free space offered to each recv()
+static const size_t READ_CHUNK = 4096;
+
+// io_uring backend sizing, per reactor: submission slots, and receive
+// buffers of READ_CHUNK bytes for the kernel to fill
+static const unsigned int URING_ENTRIES = 1024;
+static const unsigned int URING_BUFFERS = 512;
+// Lines per sendmsg(), as OutputQueue does for writev()
+static const size_t URING_SEND_IOVECS = 64;
+
+// What an io_uring completion is for, in the top byte of its user data.
+// Receives carry the fd and 24 bits of the client id, so completions for a
+// closed connection whose fd was reused are recognised; sends carry their
+// UringSend.
+enum UringTag {
+    URING_ACCEPT = 1,
+    URING_NOTIFY,
+    URING_RECV,
+    URING_SEND,
+    URING_CANCEL
+};
+
+static const int URING_TAG_SHIFT = 56;
+static const unsigned long long URING_VALUE_MASK = (1ULL << URING_TAG_SHIFT) - 1;
+static const unsigned long URING_ID_MASK = 0xffffff;
+
+static unsigned long long uringData(UringTag tag, unsigned long long value) {
+    return (static_cast<unsigned long long>(tag) << URING_TAG_SHIFT) | value;
+}
+
+static unsigned long long recvData(const Client* client) {
+    unsigned long long id = client->getId() & URING_ID_MASK;
+    return uringData(URING_RECV, (id << 32) | static_cast<unsigned int>(client->getFd()));
+}
+
+// One sendmsg() in flight. It holds references to the lines it points
+// into, so closing the client meanwhile cannot free them under the kernel.
+struct UringSend {
+    Client* client;
+    unsigned long clientId;
+    int fd;
+    struct msghdr msg;
+    struct iovec iov[URING_SEND_IOVECS];
+    PayloadRef lines[URING_SEND_IOVECS];
+};
+
+ReactorStats::ReactorStats() : loopLatency(LATENCY_BOUNDS_US, LATENCY_BOUND_COUNT) {}
+
+Reactor::Reactor(Server& server, int id, int listenFd, const ServerConfig& config)
+    : _server(server), _id(id), _listenFd(listenFd), _poller(NULL), _running(1),
+      _threadStarted(false), _inbound(NULL), _flood(config), _now(monotonicMs()),
+      _recvqLimit(config.recvq), _sendqLimit(config.sendq), _linkSendqLimit(config.linkSendq), _acceptBatch(config.acceptBatch),
+      _acceptPending(false), _acceptFailing(false), _tcpNoDelay(config.tcpNoDelay), _sendBuffer(config.sendBuffer),
+      _receiveBuffer(config.receiveBuffer), _uring(NULL), _uringActive(false), _uringStopping(false),
+      _uringPending(0) {
+    // The io_uring loop hands its connections to an epoll instance
+    // whenever it stops, for shutdown and upgrades
+    _poller = Poller::create(config.backend == "io_uring" ? "epoll" : config.backend);
+    _poller->add(_listenFd, POLLER_READ);
+    _poller->add(_notifier.fd(), POLLER_READ);
+    if (config.backend == "io_uring") {
+        try {
+            _uring = new IoUring(URING_ENTRIES, URING_BUFFERS, READ_CHUNK);
+        } catch (...) {
+            delete _poller;
+            throw;
+        }
+    }
+}
+
+Reactor::~Reactor() {
+    for (std::map<int, Client*>::iterator it = _connections.begin(); it != _connections.end(); ++it) {
+        close(it->first);
+        delete it->second;
+    }
+    while (MpscNode* node = _inbox.pop()) {
+        delete node;
+    }
+    delete _inbound;
+    if (_listenFd >= 0) close(_listenFd);
+    delete _uring; // Before the sends whose lines it may still be reading
+    for (size_t i = 0; i < _spareSends.size(); ++i) {
+        delete _spareSends[i];
+    }
+    delete _poller;
+}
+
+int Reactor::getId() const { return _id; }
+const ReactorStats& Reactor::getStats() const { return _stats; }
+int Reactor::getListenFd() const { return _listenFd; }
+
+// --- Event Loop ---
+// Runs until stop(), which may come before run() is even entered
+void Reactor::run() {
+    if (_uring) {
+        runUring();
+        return;
+    }
+    std::vector<PollerEvent> ready;
+    while (__atomic_load_n(&_running, __ATOMIC_SEQ_CST)) {
+        _poller->wait(ready, nextTimeout());
+        long started = monotonicUs();
+        _now = started / 1000;
+
+        for (size_t i = 0; i < ready.size(); ++i) {
+            int fd = ready[i].fd;
+            if (fd == _listenFd) {
+                _acceptPending = true;
+                continue;
+            }
+            if (fd == _notifier.fd()) {
+                drainInbox();
+                continue;
+            }
+            // The client may already be gone if an earlier event removed it
+            std::map<int, Client*>::iterator it = _connections.find(fd);
+            if (it == _connections.end() || it->second->isClosing()) continue;
+            Client* client = it->second;
+
+            if (ready[i].events & POLLER_WRITE) {
+                handleClientWrite(client);
+            }
+            if ((ready[i].events & POLLER_READ) && isConnected(fd, client)) {
+                handleClientData(client);
+            }
+            if ((ready[i].events & POLLER_ERROR) && isConnected(fd, client)) {
+                reportDisconnect(client);
+            }
+        }
+        // After the existing connections have had their turn
+        if (_acceptPending) handleNewConnection();
+        serviceThrottled();
+        if (!_server.isThreaded()) _server.runTimers();
+        flushPendingOutput();
+        postInbound();
+        _stats.loopLatency.record(monotonicUs() - started);
+    }
+}
+
+void* Reactor::threadMain(void* arg) {
+    Reactor* reactor = static_cast<Reactor*>(arg);
+    try {
+        reactor->run();
+    } catch (const std::exception& e) {
+        LOG(LOG_ERROR, LOG_SERVER, "Reactor " << reactor->_id << " stopped: " << e.what());
+    }
+    return NULL;
+}
+
+void Reactor::start() {
+    if (pthread_create(&_thread, NULL, &Reactor::threadMain, this) != 0)
+        throw std::runtime_error("Failed to start reactor thread");
+    _threadStarted = true;
+}
+
+void Reactor::stop() {
+    __atomic_store_n(&_running, 0, __ATOMIC_SEQ_CST);
+    _notifier.notify();
+}
+
+void Reactor::join() {
+    if (_threadStarted) {
+        pthread_join(_thread, NULL);
+        _threadStarted = false;
+    }
+}
+
+void Reactor::resume() {
+    __atomic_store_n(&_running, 1, __ATOMIC_SEQ_CST);
+}
+
+// --- Connection Handling ---
+// Accepts until the queue is empty, but at most _acceptBatch connections
+// per turn so a connection storm cannot starve established clients. When
+// the cap is hit _acceptPending stays set and the next turn does not block
+// (edge-triggered backends will not report the listener again).
+void Reactor::handleNewConnection() {
+    _acceptPending = false;
+    for (size_t accepted = 0; accepted < _acceptBatch; ++accepted) {
+        struct sockaddr_in clientAddr;
+        int clientFd = acceptConnection(clientAddr);
+        if (clientFd < 0) return;
+        addConnection(clientFd, clientAddr);
+    }
+    _acceptPending = true;
+}
+
+void Reactor::addConnection(int fd, const struct sockaddr_in& address) {
+    tuneConnection(fd);
+    char client_ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &address.sin_addr, client_ip, INET_ADDRSTRLEN);
+
+    Client* newClient = new Client(fd, std::string(client_ip), this);
+    _connections[fd] = newClient;
+    _stats.accepted.add();
+    watch(newClient);
+
+    LOG(LOG_INFO, LOG_CONN, "New connection from " << client_ip << " on fd " << fd);
+    deliver(InboundEvent::CONNECTED, newClient, NULL, 0);
+}
+
+// Returns a non-blocking, close-on-exec socket, or -1 once nothing more
+// can be accepted this turn
+int Reactor::acceptConnection(struct sockaddr_in& address) {
+    while (true) {
+        socklen_t length = sizeof(address);
+#ifdef SOCK_NONBLOCK
+        int fd = accept4(_listenFd, (struct sockaddr*)&address, &length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+        int fd = accept(_listenFd, (struct sockaddr*)&address, &length);
+        if (fd >= 0 && (fcntl(fd, F_SETFL, O_NONBLOCK) < 0 || fcntl(fd, F_SETFD, FD_CLOEXEC) < 0)) {
+            close(fd);
+            continue;
+        }
+#endif
+        if (fd >= 0) {
+            _acceptFailing = false;
+            return fd;
+        }
+        // The peer gave up while queued; the next one may be fine
+        if (errno == EINTR || errno == ECONNABORTED) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return -1;
+        reportAcceptError(errno);
+        return -1;
+    }
+}
+
+// Level-triggered backends retry on every turn until it clears, so only
+// the first error of a run is logged
+void Reactor::reportAcceptError(int error) {
+    _stats.acceptFailed.add();
+    if (!_acceptFailing) {
+        LOG(LOG_WARN, LOG_CONN, "accept failed: " << strerror(error));
+        _acceptFailing = true;
+    }
+}
+
+// Failures only cost performance, so they are ignored
+void Reactor::tuneConnection(int fd) {
+    if (_tcpNoDelay) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    if (_sendBuffer > 0) setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &_sendBuffer, sizeof(_sendBuffer));
+    if (_receiveBuffer > 0) setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &_receiveBuffer, sizeof(_receiveBuffer));
+}
+
+void Reactor::handleClientData(Client* client) {
+    int clientFd = client->getFd();
+    InputBuffer& input = client->getInput();
+
+    // Level-triggered backends read once per wakeup; edge-triggered ones
+    // must keep reading until the socket reports EAGAIN.
+    while (true) {
+        char* dest = input.writePtr(READ_CHUNK);
+        ssize_t bytesRead = recv(clientFd, dest, input.writeSpace(), 0);
+
+        if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (bytesRead <= 0) {
+            reportDisconnect(client);
+            return;
+        }
+
+        input.commit(bytesRead);
+        if (!handleInput(client)) return;
+        if (!_poller->isEdgeTriggered()) return;
+    }
+}
+
+// Runs the complete lines just received. Returns false if the client is
+// gone (QUIT, or dropped for flooding or an overfull input buffer).
+bool Reactor::handleInput(Client* client) {
+    if (!processBufferedLines(client)) return false;
+    if (client->getInput().size() > _recvqLimit) {
+        _stats.recvqExceeded.add();
+        dropConnection(client, "RecvQ exceeded");
+        return false;
+    }
+    return true;
+}
+
+// Returns false if the client is gone (QUIT, or dropped for flooding)
+bool Reactor::processBufferedLines(Client* client) {
+    int clientFd = client->getFd();
+    TokenBucket& bucket = client->getFloodBucket();
+    char* line;
+    size_t length;
+    while (true) {
+        bool limited = isFloodLimited(client);
+        if (limited && !bucket.ready(_flood, _now)) return throttle(client);
+        if (!client->getInput().nextLine(line, length)) return true;
+        if (length == 0) continue;
+        if (limited) bucket.charge(_flood.costOfLine(line, length));
+        deliver(InboundEvent::LINE, client, line, length);
+        if (!isConnected(clientFd, client)) return false;
+    }
+}
+
+// --- Flood Control ---
+// Servers relay many users' lines over one connection
+bool Reactor::isFloodLimited(Client* client) const {
+    return _flood.enabled() && !client->isServerLink();
+}
+
+// The client's next line has to wait for tokens; it stays in the input
+// buffer until serviceThrottled() finds the bucket refilled. Returns false
+// if the client was dropped for holding back too many lines.
+bool Reactor::throttle(Client* client) {
+    size_t pending = client->getInput().pendingLines();
+    if (pending == 0) return true;
+    if (pending > _flood.maxLines) {
+        _stats.excessFlood.add();
+        dropConnection(client, "Excess Flood");
+        return false;
+    }
+    if (!client->isThrottled()) {
+        client->setThrottled(true);
+        _throttled.push_back(client->getFd());
+        _stats.throttled.add();
+    }
+    return true;
+}
+
+void Reactor::serviceThrottled() {
+    std::vector<int> throttled;
+    throttled.swap(_throttled);
+    for (size_t i = 0; i < throttled.size(); ++i) {
+        std::map<int, Client*>::iterator it = _connections.find(throttled[i]);
+        if (it == _connections.end() || !it->second->isThrottled()) continue;
+
+        Client* client = it->second;
+        if (!client->isClosing() && isFloodLimited(client) && !client->getFloodBucket().ready(_flood, _now)) {
+            _throttled.push_back(throttled[i]);
+            continue;
+        }
+        client->setThrottled(false);
+        if (!client->isClosing()) processBufferedLines(client);
+    }
+    _stats.throttledNow.set(_throttled.size());
+}
+
+// Sleep until the first throttled client may run again or, without a
+// core thread, the server's next timer, or indefinitely; connections left
+// in the accept queue last turn mean no sleep at all
+int Reactor::nextTimeout() const {
+    if (_acceptPending) return 0;
+    long timeout = _server.isThreaded() ? -1 : _server.timerDelayMs();
+    for (size_t i = 0; i < _throttled.size(); ++i) {
+        std::map<int, Client*>::const_iterator it = _connections.find(_throttled[i]);
+        if (it == _connections.end()) continue;
+        long wait = isFloodLimited(it->second) ? it->second->getFloodBucket().waitMs(_flood) : 0;
+        if (timeout < 0 || wait < timeout) timeout = wait;
+    }
+    return static_cast<int>(timeout);
+}
+
+bool Reactor::isConnected(int fd, Client* client) const {
+    std::map<int, Client*>::const_iterator it = _connections.find(fd);
+    return it != _connections.end() && it->second == client && !client->isClosing();
+}
+
+// Inline mode calls straight into the server; threaded mode batches the
+// event for the core thread, preserving per-connection order.
+void Reactor::deliver(InboundEvent::Type type, Client* client, const char* line, size_t length) {
+    if (!_server.isThreaded()) {
+        switch (type) {
+            case InboundEvent::CONNECTED: _server.onConnect(client); break;
+            case InboundEvent::LINE: _server.onLine(client, const_cast<char*>(line), length); break;
+            case InboundEvent::DISCONNECTED: _server.onDisconnect(client, line ? std::string(line, length) : std::string()); break;
+        }
+        return;
+    }
+    if (!_inbound) _inbound = new InboundBatch();
+    _inbound->events.push_back(InboundEvent());
+    InboundEvent& event = _inbound->events.back();
+    event.type = type;
+    event.client = client;
+    event.clientId = client->getId();
+    event.fd = client->getFd();
+    if (line) event.line.assign(line, length);
+}
+
+void Reactor::postInbound() {
+    if (_inbound) {
+        _server.postInbound(_inbound);
+        _inbound = NULL;
+    }
+}
+
+// The socket is dead. In threaded mode the fd stays open (so its number
+// can't be reused) until the core has cleaned up and sent the close back.
+// A non-empty reason is shown to the client's channels as its QUIT message.
+void Reactor::reportDisconnect(Client* client, const std::string& reason) {
+    if (_server.isThreaded()) {
+        unwatch(client);
+        client->setClosing(true);
+    }
+    deliver(InboundEvent::DISCONNECTED, client, reason.empty() ? NULL : reason.c_str(), reason.length());
+}
+
+// Server-side disconnect: tell the client why, then report it like a dead socket
+void Reactor::dropConnection(Client* client, const std::string& reason) {
+    LOG(LOG_INFO, LOG_CONN, "Dropping fd " << client->getFd() << ": " << reason);
+    // Straight into the queue, past the sendq limit; closing flushes it
+    client->getOutput().push(PayloadRef(Payload::create("ERROR :Closing Link: " + client->getHostname() + " (" + reason + ")")));
+    reportDisconnect(client, reason);
+}
+
+void Reactor::closeConnection(Client* client) {
+    int clientFd = client->getFd();
+    _connections.erase(clientFd);
+    // Not listed while serviceThrottled holds the list, if a line it runs
+    // closes this client
+    if (client->isThrottled()) {
+        std::vector<int>::iterator throttled = std::find(_throttled.begin(), _throttled.end(), clientFd);
+        if (throttled != _throttled.end()) _throttled.erase(throttled);
+        client->setThrottled(false);
+    }
+    if (!client->isClosing()) {
+        unwatch(client);
+    }
+
+    // Best effort: push out whatever is still queued (e.g. replies before
+    // QUIT). A send still in flight on the ring covers the front of the
+    // queue and finishes on its own; writing behind it could reorder lines.
+    if (!client->getOutput().empty() && !(_uringActive && client->isWriteArmed())) {
+        client->getOutput().flush(clientFd);
+    }
+
+    close(clientFd);
+    delete client;
+}
+
+// Its first output, queued by the core right after, is written (or
+// waits for writability) once a non-blocking connect() completes
+void Reactor::attach(Client* client) {
+    _connections[client->getFd()] = client;
+    tuneConnection(client->getFd());
+    watch(client);
+}
+
+// Lines held back before the handshake finished run on the next turn
+void Reactor::markServerLink(Client* client) {
+    client->setServerLink(true);
+}
+
+// --- Output Handling ---
+// A client whose queue would outgrow the sendq limit gets nothing more and
+// is dropped at the next flush, not here: the caller may be in the middle
+// of a channel fan-out.
+void Reactor::queueOutput(Client* client, const PayloadRef& payload) {
+    if (client->isSendqExceeded()) return;
+    size_t limit = client->isServerLink() ? _linkSendqLimit : _sendqLimit;
+    if (client->getOutput().bytes() + payload.length() > limit) {
+        client->setSendqExceeded(true);
+    } else {
+        client->getOutput().push(payload);
+    }
+    if (!client->isFlushPending()) {
+        client->setFlushPending(true);
+        _pendingFlush.push_back(client->getFd());
+    }
+}
+
+void Reactor::handleClientWrite(Client* client) {
+    if (!flushClient(client)) {
+        reportDisconnect(client);
+    }
+}
+
+// Replies produced while processing this iteration's events go out in one
+// writev() per client instead of one send() per line.
+// Dropping a client can queue more output (its QUIT), hence the outer loop.
+void Reactor::flushPendingOutput() {
+    while (!_pendingFlush.empty()) {
+        std::vector<int> pending;
+        pending.swap(_pendingFlush);
+        for (size_t i = 0; i < pending.size(); ++i) {
+            std::map<int, Client*>::iterator it = _connections.find(pending[i]);
+            if (it == _connections.end()) continue;
+
+            Client* client = it->second;
+            client->setFlushPending(false);
+            if (client->isClosing()) continue;
+            if (client->isSendqExceeded()) {
+                _stats.sendqExceeded.add();
+                dropConnection(client, "SendQ exceeded");
+            } else if (!flushClient(client)) {
+                reportDisconnect(client);
+            }
+        }
+    }
+}
+
+// Writes what the socket accepts and keeps writable interest registered
+// only while something is left. Returns false if the connection is dead.
+bool Reactor::flushClient(Client* client) {
+    if (_uringActive) {
+        sendUring(client); // Errors arrive as completions
+        return true;
+    }
+    OutputQueue& output = client->getOutput();
+    if (!output.empty() && output.flush(client->getFd()) < 0) {
+        return false;
+    }
+
+    bool wantWrite = !output.empty();
+    if (wantWrite != client->isWriteArmed()) {
+        _poller->modify(client->getFd(), wantWrite ? (POLLER_READ | POLLER_WRITE) : POLLER_READ);
+        client->setWriteArmed(wantWrite);
+    }
+    return true;
+}
+
+// --- Cross-thread Delivery ---
+void Reactor::post(OutboundBatch* batch) {
+    _inbox.push(batch);
+    _notifier.notify();
+}
+
+void Reactor::drainInbox() {
+    _notifier.consume();
+    while (MpscNode* node = _inbox.pop()) {
+        OutboundBatch* batch = static_cast<OutboundBatch*>(node);
+        for (size_t i = 0; i < batch->items.size(); ++i) {
+            OutboundItem& item = batch->items[i];
+            switch (item.action) {
+                case OutboundItem::ATTACH: attach(item.client); break;
+                case OutboundItem::LINK: markServerLink(item.client); break;
+                case OutboundItem::SEND:
+                    if (item.payload.empty()) closeConnection(item.client);
+                    else queueOutput(item.client, item.payload);
+                    break;
+            }
+        }
+        delete batch;
+    }
+}
+
+// --- io_uring Loop ---
+// Completions replace readiness: the listener, the notifier and every
+// connection keep one multishot request armed, and output goes out as one
+// sendmsg() per client per turn. All of it, and the wait, is a single
+// io_uring_enter() per turn. Leaves every connection on _poller again, so
+// drain(), an upgrade or the next run() find the reactor as the readiness
+// loop would leave it.
+void Reactor::runUring() {
+    startUring();
+    while (__atomic_load_n(&_running, __ATOMIC_SEQ_CST)) {
+        _uring->submitAndWait(nextTimeout());
+        long started = monotonicUs();
+        _now = started / 1000;
+
+        IoCompletion completion;
+        while (_uring->nextCompletion(completion)) {
+            handleCompletion(completion);
+        }
+        serviceThrottled();
+        if (!_server.isThreaded()) _server.runTimers();
+        flushPendingOutput();
+        postInbound();
+        _stats.loopLatency.record(monotonicUs() - started);
+    }
+    stopUring();
+}
+
+void Reactor::startUring() {
+    _uringActive = true;
+    _uringStopping = false;
+    if (_listenFd >= 0) armAccept();
+    armNotifier();
+    for (std::map<int, Client*>::iterator it = _connections.begin(); it != _connections.end(); ++it) {
+        Client* client = it->second;
+        if (client->isClosing()) continue; // Already out of _poller, waiting for the core
+        _poller->remove(it->first);
+        client->setWriteArmed(false);
+        armRecv(client);
+        if (!client->getOutput().empty() && !client->isFlushPending()) {
+            client->setFlushPending(true);
+            _pendingFlush.push_back(it->first);
+        }
+    }
+}
+
+// Cancels every request and waits for the last completion, so no bytes
+// are read or written behind the caller's back afterwards
+void Reactor::stopUring() {
+    _uringStopping = true;
+    _uring->cancelAll(uringData(URING_CANCEL, 0));
+    ++_uringPending;
+    while (_uringPending > 0) {
+        _uring->submitAndWait(-1);
+        IoCompletion completion;
+        while (_uring->nextCompletion(completion)) {
+            handleCompletion(completion);
+        }
+    }
+    _uringActive = false;
+
+    for (std::map<int, Client*>::iterator it = _connections.begin(); it != _connections.end(); ++it) {
+        Client* client = it->second;
+        if (client->isClosing()) continue;
+        bool wantWrite = !client->getOutput().empty();
+        _poller->add(it->first, wantWrite ? (POLLER_READ | POLLER_WRITE) : POLLER_READ);
+        client->setWriteArmed(wantWrite);
+    }
+}
+
+void Reactor::armAccept() {
+    if (_uringStopping) return;
+    _uring->acceptMultishot(_listenFd, uringData(URING_ACCEPT, 0));
+    ++_uringPending;
+}
+
+void Reactor::armNotifier() {
+    if (_uringStopping) return;
+    _uring->pollMultishot(_notifier.fd(), uringData(URING_NOTIFY, 0));
+    ++_uringPending;
+}
+
+void Reactor::armRecv(Client* client) {
+    if (_uringStopping) return;
+    _uring->recvMultishot(client->getFd(), recvData(client));
+    ++_uringPending;
+}
+
+// One send per client in flight (isWriteArmed); its completion sends
+// whatever was queued meanwhile
+void Reactor::sendUring(Client* client) {
+    OutputQueue& output = client->getOutput();
+    if (output.empty() || client->isWriteArmed() || _uringStopping) return;
+
+    UringSend* send;
+    if (_spareSends.empty()) {
+        send = new UringSend();
+    } else {
+        send = _spareSends.back();
+        _spareSends.pop_back();
+    }
+    send->client = client;
+    send->clientId = client->getId();
+    send->fd = client->getFd();
+    std::memset(&send->msg, 0, sizeof(send->msg));
+    send->msg.msg_iov = send->iov;
+    send->msg.msg_iovlen = output.gather(send->iov, send->lines, URING_SEND_IOVECS);
+
+    _uring->sendmsg(send->fd, &send->msg, uringData(URING_SEND, reinterpret_cast<uintptr_t>(send)));
+    ++_uringPending;
+    client->setWriteArmed(true);
+}
+
+void Reactor::handleCompletion(const IoCompletion& completion) {
+    if (!completion.more()) --_uringPending;
+    switch (completion.userData >> URING_TAG_SHIFT) {
+        case URING_ACCEPT: handleUringAccept(completion); break;
+        case URING_NOTIFY:
+            drainInbox();
+            if (!completion.more()) armNotifier();
+            break;
+        case URING_RECV: handleUringRecv(completion); break;
+        case URING_SEND: handleUringSend(completion); break;
+        default: break; // URING_CANCEL
+    }
+}
+
+// Multishot accept reports no peer address, hence getpeername()
+void Reactor::handleUringAccept(const IoCompletion& completion) {
+    if (completion.result >= 0) {
+        int fd = completion.result;
+        struct sockaddr_in address;
+        socklen_t length = sizeof(address);
+        std::memset(&address, 0, sizeof(address));
+        getpeername(fd, (struct sockaddr*)&address, &length);
+        _acceptFailing = false;
+        addConnection(fd, address);
+    } else if (completion.result != -ECANCELED && completion.result != -ECONNABORTED) {
+        reportAcceptError(-completion.result);
+    }
+    if (!completion.more()) armAccept();
+}
+
+void Reactor::handleUringRecv(const IoCompletion& completion) {
+    int fd = static_cast<int>(completion.userData & 0xffffffffULL);
+    unsigned long id = (completion.userData >> 32) & URING_ID_MASK;
+    std::map<int, Client*>::iterator it = _connections.find(fd);
+    Client* client = NULL;
+    if (it != _connections.end() && (it->second->getId() & URING_ID_MASK) == id && !it->second->isClosing())
+        client = it->second;
+
+    if (completion.hasBuffer()) {
+        if (client && completion.result > 0) {
+            InputBuffer& input = client->getInput();
+            std::memcpy(input.writePtr(completion.result), _uring->buffer(completion.bufferId()), completion.result);
+            input.commit(completion.result);
+        }
+        _uring->recycle(completion.bufferId());
+    }
+    if (!client) return;
+
+    if (completion.result > 0) {
+        if (!handleInput(client)) return;
+    } else if (completion.result == 0 || (completion.result != -ENOBUFS && completion.result != -ECANCELED)) {
+        reportDisconnect(client);
+        return;
+    }
+    // Out of buffers, or the kernel ended the multishot early
+    if (!completion.more()) armRecv(client);
+}
+
+void Reactor::handleUringSend(const IoCompletion& completion) {
+    UringSend* send = reinterpret_cast<UringSend*>(static_cast<uintptr_t>(completion.userData & URING_VALUE_MASK));
+    std::map<int, Client*>::iterator it = _connections.find(send->fd);
+    Client* client = NULL;
+    if (it != _connections.end() && it->second == send->client && it->second->getId() == send->clientId)
+        client = it->second;
+    for (size_t i = 0; i < send->msg.msg_iovlen; ++i) {
+        send->lines[i] = PayloadRef();
+    }
+    _spareSends.push_back(send);
+    if (!client) return;
+
+    client->setWriteArmed(false);
+    if (client->isClosing() || completion.result == -ECANCELED) return;
+    if (completion.result < 0 && completion.result != -EAGAIN && completion.result != -EINTR) {
+        reportDisconnect(client);
+        return;
+    }
+    if (completion.result > 0) client->getOutput().consume(completion.result);
+    sendUring(client); // The rest of a short write, or lines queued meanwhile
+}
+
+// --- Readiness Registration ---
+// New connections, and connections leaving (disconnected in threaded mode,
+// or closed), on whichever mechanism is running
+void Reactor::watch(Client* client) {
+    if (_uringActive) armRecv(client);
+    else _poller->add(client->getFd(), POLLER_READ);
+}
+
+void Reactor::unwatch(Client* client) {
+    if (!_uringActive) {
+        _poller->remove(client->getFd());
+    } else if (!_uringStopping) {
+        _uring->cancel(recvData(client), uringData(URING_CANCEL, 0));
+        ++_uringPending;
+    }
+}
+
+// --- Shutdown and Upgrade ---
+void Reactor::settle() {
+    drainInbox();
+    flushPendingOutput();
+    postInbound();
+}
+
+size_t Reactor::drain(long deadlineMs) {
+    _poller->remove(_listenFd);
+    close(_listenFd);
+    _listenFd = -1;
+    _acceptPending = false;
+
+    std::vector<Client*> clients;
+    for (std::map<int, Client*>::iterator it = _connections.begin(); it != _connections.end(); ++it) {
+        clients.push_back(it->second);
+    }
+    for (size_t i = 0; i < clients.size(); ++i) {
+        Client* client = clients[i];
+        if (!client->isClosing()) {
+            client->getOutput().push(PayloadRef(Payload::create("ERROR :Closing Link: " + client->getHostname() + " (Server shutting down)")));
+        }
+        drainClient(client);
+    }
+
+    std::vector<PollerEvent> ready;
+    while (!_connections.empty()) {
+        long remaining = deadlineMs - monotonicMs();
+        if (remaining <= 0) break;
+        _poller->wait(ready, static_cast<int>(remaining));
+        for (size_t i = 0; i < ready.size(); ++i) {
+            if (ready[i].fd == _notifier.fd()) {
+                _notifier.consume(); // A late stop(); nothing left to do
+                continue;
+            }
+            std::map<int, Client*>::iterator it = _connections.find(ready[i].fd);
+            if (it != _connections.end()) drainClient(it->second);
+        }
+    }
+    return _connections.size();
+}
+
+// Writes what the socket takes and closes the connection once the queue
+// is empty or the socket is dead; otherwise waits for writability only.
+void Reactor::drainClient(Client* client) {
+    OutputQueue& output = client->getOutput();
+    if (client->isClosing() || output.empty() || output.flush(client->getFd()) < 0 || output.empty()) {
+        closeConnection(client);
+        return;
+    }
+    _poller->modify(client->getFd(), POLLER_WRITE);
+    client->setWriteArmed(true);
+}
+
+// Called before run(). Restored output goes out on the first writable
+// event; complete lines already buffered are run by the first
+// serviceThrottled(), as no new data may arrive to trigger a read.
+void Reactor::adopt(Client* client) {
+    int fd = client->getFd();
+    _connections[fd] = client;
+    bool wantWrite = !client->getOutput().empty();
+    _poller->add(fd, wantWrite ? (POLLER_READ | POLLER_WRITE) : POLLER_READ);
+    client->setWriteArmed(wantWrite);
+    if (client->getInput().pendingLines() > 0) {
+        client->setThrottled(true);
+        _throttled.push_back(fd);
+    }
+}
@@ -1,46 +1,72 @@
 #include "Server.hpp"
-#include <iostream>
+#include "Logger.hpp"
+#include "AdminListener.hpp"
+#include "Clock.hpp"
+#include "Upgrade.hpp"
+#include "IoUring.hpp"
 #include <string>
 #include <vector>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <poll.h>
 #include <cstring>
+#include <cstdio>
+#include <cerrno>
 #include <cstdlib>
 #include <ctime>
 #include <sstream>
 #include <algorithm>
+#include <set>
+#include <poll.h>
 
 // --- Helper Functions ---
+// Target lists split on every PRIVMSG, so no stream. As with getline, a
+// trailing delimiter adds no empty token.
 std::vector<std::string> split(const std::string& s, char delimiter) {
     std::vector<std::string> tokens;
-    std::string token;
-    std::istringstream tokenStream(s);
-    while (std::getline(tokenStream, token, delimiter)) {
-        tokens.push_back(token);
+    size_t start = 0;
+    while (start < s.length()) {
+        size_t end = s.find(delimiter, start);
+        if (end == std::string::npos) end = s.length();
+        tokens.push_back(s.substr(start, end - start));
+        start = end + 1;
     }
     return tokens;
 }
 
 // --- Constructor/Destructor ---
-Server::Server(int port, const std::string& password)
-    : _port(port), _password(password), _serverSocket(-1), _serverName("irc.42.fr") {
+Server::Server(int port, const std::string& password, const ServerConfig& config)
+    : _port(port), _password(password), _serverName(config.serverName),
+      _config(config), _nextUid(0), _nextBatch(0), _threaded(config.threads > 1),
+      _outputSlot(ServerMetrics::SLOT_NONE), _registered(0), _admin(NULL),
+      _stopMode(STOP_NONE), _reactorsReady(0) {
     _startTime = time(NULL);
+    ChannelHistory::configure(config.historyLines, config.historyBytes, config.historyMemory);
 }
 
 Server::~Server() {
-    for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
-        close(it->first);
-        delete it->second;
+    delete _admin;
+    for (size_t i = 0; i < _reactors.size(); ++i) {
+        _reactors[i]->stop();
+        _reactors[i]->join();
     }
+    // Channels first: their destructors still talk to their members
     for (std::map<std::string, Channel*>::iterator it = _channels.begin(); it != _channels.end(); ++it) {
         delete it->second;
     }
-    if (_serverSocket != -1) {
-        close(_serverSocket);
+    clearNetwork();
+    // Reactors own the connections and close them
+    for (size_t i = 0; i < _reactors.size(); ++i) {
+        delete _reactors[i];
+    }
+    while (MpscNode* node = _inbox.pop()) {
+        delete node;
+    }
+    for (size_t i = 0; i < _outbound.size(); ++i) {
+        delete _outbound[i];
     }
 }
 
@@ -50,223 +76,604 @@ void Server::run() {
     mainLoop();
 }
 
+// After an upgrade the listeners and connections come from the old
+// process; the old process is told to exit once they are all in place.
 void Server::setup() {
-    _serverSocket = socket(AF_INET, SOCK_STREAM, 0);
-    if (_serverSocket < 0) throw std::runtime_error("Failed to create socket");
+    if (_config.backend == "io_uring") {
+        std::string reason;
+        if (!IoUring::supported(reason)) {
+            _config.backend = ServerConfig().backend;
+            LOG(LOG_WARN, LOG_SERVER, "io_uring unavailable (" << reason << "); using " << _config.backend);
+        }
+    }
+    int count = _threaded ? _config.threads : 1;
+    std::vector<int> inherited;
+    std::string image;
+    size_t listeners = 0;
+    if (_config.upgradeFd >= 0) {
+        listeners = receiveUpgrade(inherited, image);
+    }
 
-    int opt = 1;
-    if (setsockopt(_serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0)
-        throw std::runtime_error("Failed to set socket options");
+    for (int i = 0; i < count; ++i) {
+        int listenFd = static_cast<size_t>(i) < listeners ? inherited[i] : createListener(_threaded);
+        try {
+            startListening(listenFd);
+            _reactors.push_back(new Reactor(*this, i, listenFd, _config));
+        } catch (...) {
+            close(listenFd);
+            throw;
+        }
+    }
+    for (size_t i = count; i < listeners; ++i) {
+        close(inherited[i]);
+    }
+    _outbound.resize(_reactors.size(), NULL);
+    openChannelStore();
 
-    if (fcntl(_serverSocket, F_SETFL, O_NONBLOCK) < 0)
-        throw std::runtime_error("Failed to set socket to non-blocking");
+    if (_config.upgradeFd >= 0) {
+        restoreState(inherited, image);
+        Upgrade::signalReady(_config.upgradeFd);
+        close(_config.upgradeFd);
+    }
+    startAdmin();
+    for (size_t i = 0; i < _config.links.size(); ++i) {
+        LinkTarget target;
+        size_t colon = _config.links[i].rfind(':');
+        target.host = _config.links[i].substr(0, colon);
+        target.port = std::atoi(_config.links[i].c_str() + colon + 1);
+        _linkTargets.push_back(target); // Due at once
+    }
 
-    struct sockaddr_in serverAddr;
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_addr.s_addr = INADDR_ANY;
-    serverAddr.sin_port = htons(_port);
+    // A stop requested before the reactors existed is applied here
+    __atomic_store_n(&_reactorsReady, _reactors.size(), __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&_stopMode, __ATOMIC_SEQ_CST) != STOP_NONE) {
+        requestStop(static_cast<StopMode>(_stopMode));
+    }
 
-    if (bind(_serverSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0)
-        throw std::runtime_error("Failed to bind socket");
+    LOG(LOG_INFO, LOG_SERVER, "Server listening on port " << _port << " (" << _config.backend << " backend, "
+        << count << (count == 1 ? " thread)" : " threads)"));
+}
 
-    if (listen(_serverSocket, 10) < 0)
-        throw std::runtime_error("Failed to listen on socket");
+void Server::startAdmin() {
+    if (_config.adminPort > 0) {
+        _admin = new AdminListener(*this, _config.adminPort);
+        _admin->start();
+        LOG(LOG_INFO, LOG_SERVER, "Metrics on http://127.0.0.1:" << _config.adminPort << "/metrics");
+    }
+}
 
-    struct pollfd pfd;
-    pfd.fd = _serverSocket;
-    pfd.events = POLLIN;
-    pfd.revents = 0;
-    _pollfds.push_back(pfd);
+// With several reactors each one gets its own SO_REUSEPORT socket on the
+// same port, and the kernel spreads incoming connections across them.
+int Server::createListener(bool reusePort) {
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) throw std::runtime_error("Failed to create socket");
+
+    try {
+        int opt = 1;
+        if (setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0)
+            throw std::runtime_error("Failed to set socket options");
+#ifdef SO_REUSEPORT
+        if (reusePort && setsockopt(listenFd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)
+            throw std::runtime_error("Failed to set SO_REUSEPORT");
+#else
+        if (reusePort)
+            throw std::runtime_error("SO_REUSEPORT is not supported on this platform");
+#endif
+
+        if (fcntl(listenFd, F_SETFL, O_NONBLOCK) < 0)
+            throw std::runtime_error("Failed to set socket to non-blocking");
+
+        struct sockaddr_in serverAddr;
+        memset(&serverAddr, 0, sizeof(serverAddr));
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_addr.s_addr = INADDR_ANY;
+        serverAddr.sin_port = htons(_port);
+
+        if (bind(listenFd, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0)
+            throw std::runtime_error("Failed to bind socket");
+
+    } catch (...) {
+        close(listenFd);
+        throw;
+    }
+    return listenFd;
+}
 
-    std::cout << "Server listening on port " << _port << std::endl;
+// Also applied to listeners inherited from an upgrade: listen() on a
+// listening socket just resizes its queue, so a new --backlog takes effect.
+void Server::startListening(int listenFd) {
+    // Accepted sockets inherit the listener's receive buffer, and only a
+    // size set before the handshake shapes the advertised window scale
+    if (_config.receiveBuffer > 0 && setsockopt(listenFd, SOL_SOCKET, SO_RCVBUF,
+            &_config.receiveBuffer, sizeof(_config.receiveBuffer)) < 0)
+        throw std::runtime_error("Failed to set SO_RCVBUF");
+#ifdef TCP_DEFER_ACCEPT
+    // IRC clients speak first, so a connection is only worth a wakeup once
+    // its PASS/NICK has arrived
+    if (setsockopt(listenFd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &_config.deferAccept, sizeof(_config.deferAccept)) < 0)
+        throw std::runtime_error("Failed to set TCP_DEFER_ACCEPT");
+#else
+    if (_config.deferAccept > 0)
+        LOG(LOG_WARN, LOG_SERVER, "TCP_DEFER_ACCEPT is not supported on this platform; ignoring --defer-accept");
+#endif
+    if (listen(listenFd, _config.backlog) < 0)
+        throw std::runtime_error("Failed to listen on socket");
 }
 
+// A failed upgrade leaves every connection in place, so serving resumes
 void Server::mainLoop() {
     while (true) {
-        if (poll(&_pollfds[0], _pollfds.size(), -1) < 0) {
-            throw std::runtime_error("Poll failed");
-        }
-
-        if (_pollfds[0].revents & POLLIN) {
-            handleNewConnection();
-        }
-
-        for (size_t i = _pollfds.size() - 1; i > 0; --i) {
-            if (_pollfds[i].revents & POLLIN) {
-                handleClientData(_pollfds[i].fd);
-            }
-             if (_pollfds[i].revents & (POLLHUP | POLLERR)) {
-                removeClient(_pollfds[i].fd);
+        runLoops();
+        if (__atomic_load_n(&_stopMode, __ATOMIC_SEQ_CST) == STOP_UPGRADE) {
+            if (handOff()) return;
+            for (size_t i = 0; i < _reactors.size(); ++i) {
+                _reactors[i]->resume();
             }
+            int expected = STOP_UPGRADE;
+            if (__atomic_compare_exchange_n(&_stopMode, &expected, STOP_NONE, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+                continue;
         }
+        drain();
+        return;
     }
 }
 
-// --- Connection Handling ---
-void Server::handleNewConnection() {
-    struct sockaddr_in clientAddr;
-    socklen_t clientLen = sizeof(clientAddr);
-    int clientFd = accept(_serverSocket, (struct sockaddr*)&clientAddr, &clientLen);
-    if (clientFd < 0) return;
-
-    if (fcntl(clientFd, F_SETFL, O_NONBLOCK) < 0) {
-        close(clientFd);
+// Runs the event loops until requestStop()
+void Server::runLoops() {
+    if (!_threaded) {
+        _reactors[0]->run();
         return;
     }
-    
-    char client_ip[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &clientAddr.sin_addr, client_ip, INET_ADDRSTRLEN);
 
-    Client* newClient = new Client(clientFd, std::string(client_ip));
-    _clients[clientFd] = newClient;
+    for (size_t i = 0; i < _reactors.size(); ++i) {
+        _reactors[i]->start();
+    }
 
     struct pollfd pfd;
-    pfd.fd = clientFd;
+    pfd.fd = _notifier.fd();
     pfd.events = POLLIN;
-    pfd.revents = 0;
-    _pollfds.push_back(pfd);
+    while (__atomic_load_n(&_stopMode, __ATOMIC_SEQ_CST) == STOP_NONE) {
+        pfd.revents = 0;
+        if (poll(&pfd, 1, static_cast<int>(timerDelayMs())) < 0 && errno != EINTR) {
+            throw std::runtime_error("Poll failed");
+        }
+        long started = monotonicUs();
+        _notifier.consume();
+        while (MpscNode* node = _inbox.pop()) {
+            InboundBatch* batch = static_cast<InboundBatch*>(node);
+            processInbound(batch);
+            delete batch;
+        }
+        runTimers();
+        postOutbound();
+        _metrics.coreLatency.record(monotonicUs() - started);
+    }
 
-    std::cout << "New connection from " << client_ip << " on fd " << clientFd << std::endl;
+    for (size_t i = 0; i < _reactors.size(); ++i) {
+        _reactors[i]->stop();
+    }
+    for (size_t i = 0; i < _reactors.size(); ++i) {
+        _reactors[i]->join();
+    }
+    settle();
 }
 
-void Server::handleClientData(int clientFd) {
-    char buffer[512];
-    memset(buffer, 0, sizeof(buffer));
-    ssize_t bytesRead = recv(clientFd, buffer, sizeof(buffer) - 1, 0);
-
-    if (bytesRead <= 0) {
-        removeClient(clientFd);
+// Single-threaded mode stops its reactor directly; threaded mode wakes
+// the core, which stops the reactors itself.
+void Server::requestStop(StopMode mode) {
+    __atomic_store_n(&_stopMode, mode, __ATOMIC_SEQ_CST);
+    if (_threaded) {
+        _notifier.notify();
         return;
     }
+    size_t ready = __atomic_load_n(&_reactorsReady, __ATOMIC_SEQ_CST);
+    for (size_t i = 0; i < ready; ++i) {
+        _reactors[i]->stop();
+    }
+}
+
+// --- Reactor Interface ---
+bool Server::isThreaded() const { return _threaded; }
+
+void Server::onConnect(Client* client) {
+    _clients[client->getFd()] = client;
+    updateGauges();
+}
+
+void Server::onLine(Client* client, char* line, size_t length) {
+    LOG(LOG_INFO, LOG_WIRE, "FD(" << client->getFd() << ") C: " << line);
+
+    MessageView message;
+    if (parseMessage(line, length, message)) {
+        CommandId id = lookupCommand(message.command);
+        _metrics.messagesIn[id].add();
+        _metrics.bytesIn[id].add(length + 2);
+
+        _outputSlot = id;
+        if (client->getPeer()) processLinkCommand(client, id, message);
+        else processCommand(client, id, message);
+        _outputSlot = ServerMetrics::SLOT_NONE;
+        updateGauges();
+    }
+}
+
+// Drops by the reactor (flood, recvq, sendq) arrive with a reason and are
+// counted there; an empty reason means the peer went away.
+void Server::onDisconnect(Client* client, const std::string& reason) {
+    if (reason.empty()) _metrics.closed.add();
+    else broadcastQuit(client, reason);
+    removeClient(client->getFd(), reason.empty() ? "Connection closed" : reason);
+    updateGauges();
+}
 
-    Client* client = _clients[clientFd];
-    client->appendToBuffer(buffer, bytesRead);
+// Reactor thread: hand a batch of events to the core thread
+void Server::postInbound(InboundBatch* batch) {
+    _inbox.push(batch);
+    _notifier.notify();
+}
 
-    std::string& clientBuffer = client->getBufferRef(); // Assuming Client class can return a reference
-    size_t pos;
-    while ((pos = clientBuffer.find('\n')) != std::string::npos) {
-        std::string message = clientBuffer.substr(0, pos);
-        
-        // If there's a '\r' before the '\n', remove it from the message
-        if (!message.empty() && message[message.length() - 1] == '\r') {
-            message.erase(message.length() - 1);
+void Server::processInbound(InboundBatch* batch) {
+    for (size_t i = 0; i < batch->events.size(); ++i) {
+        InboundEvent& event = batch->events[i];
+        if (event.type == InboundEvent::CONNECTED) {
+            onConnect(event.client);
+            continue;
         }
+        // Skip events that were queued before the core dropped the client
+        std::map<int, Client*>::iterator it = _clients.find(event.fd);
+        if (it == _clients.end() || it->second != event.client || event.client->getId() != event.clientId) {
+            continue;
+        }
+        if (event.type == InboundEvent::LINE) onLine(event.client, &event.line[0], event.line.length());
+        else onDisconnect(event.client, event.line);
+    }
+}
 
-        // Update the client's buffer by removing the processed command and the '\n'
-        client->clearBuffer(pos + 1);
-        
-        if (!message.empty()) {
-            processCommand(client, message);
+// Output produced while processing a batch leaves as one post per reactor
+void Server::postOutbound() {
+    for (size_t i = 0; i < _outbound.size(); ++i) {
+        if (_outbound[i]) {
+            _reactors[i]->post(_outbound[i]);
+            _outbound[i] = NULL;
         }
-        // The loop will continue if there are more commands in the buffer
     }
 }
 
+// reason goes to the other servers: the user's QUIT message, or why a
+// link dropped. Empty when a KILL has already told them.
+void Server::removeClient(int clientFd, const std::string& reason) {
+    std::map<int, Client*>::iterator found = _clients.find(clientFd);
+    if (found == _clients.end()) return;
+    Client* client = found->second;
+
+    if (client->getPeer()) {
+        splitLink(client, reason);
+    }
+    if (LinkTarget* target = findLinkTarget(client)) {
+        target->connection = NULL;
+        target->nextAttemptMs = monotonicMs() + LINK_RETRY_MS;
+    }
+    if (!client->getUid().empty() && !reason.empty()) {
+        sendToLinks(LineBuilder() << ":" << client->getUid() << " QUIT :" << reason);
+    }
+    detachClient(client);
+    if (client->getRegistrationState() == REGISTERED) {
+        --_registered;
+    }
 
-void Server::removeClient(int clientFd) {
-    Client* client = _clients[clientFd];
-    if (!client) return;
+    LOG(LOG_INFO, LOG_CONN, "Client " << client->getNickname() << " (fd: " << clientFd << ") disconnected.");
 
-    // Remove from all channels
-    for (std::map<std::string, Channel*>::iterator it = _channels.begin(); it != _channels.end(); ++it) {
-        if (it->second->isClientInChannel(client)) {
-            it->second->removeClient(client);
-             if (it->second->getClients().empty()) {
-                delete it->second;
-                _channels.erase(it);
-            }
+    _clients.erase(found);
+    releaseClient(client);
+}
+
+// Out of every channel, invite list and index; local or remote
+void Server::detachClient(Client* client) {
+    // Only visit the channels the client is actually in
+    while (!client->getChannels().empty()) {
+        Channel* channel = *client->getChannels().begin();
+        channel->removeClient(client); // Also drops it from client->getChannels()
+        if (channel->getMemberCount() == 0) {
+            _channels.erase(channel->getName());
+            forgetChannel(channel->getName());
+            delete channel;
         }
     }
+    while (!client->getInvites().empty()) {
+        (*client->getInvites().begin())->removeInvite(client);
+    }
+
+    if (!client->getNickname().empty() && findClientByNick(client->getNickname()) == client) {
+        _nickIndex.erase(client->getNickname());
+    }
+    if (!client->getUid().empty()) {
+        _uidIndex.erase(client->getUid());
+    }
+}
+
+// The last member out takes the channel with it
+void Server::partChannel(Channel* channel, Client* client) {
+    channel->removeClient(client);
+    if (channel->getMemberCount() == 0) {
+        _channels.erase(channel->getName());
+        forgetChannel(channel->getName());
+        delete channel;
+    }
+}
 
-    // Remove from pollfds
-    for (size_t i = 0; i < _pollfds.size(); ++i) {
-        if (_pollfds[i].fd == clientFd) {
-            _pollfds.erase(_pollfds.begin() + i);
-            break;
+// --- Channel Names ---
+// RPL_NAMREPLY in as many lines as the 512-byte limit needs, cut between
+// names. The list itself is the channel's cached one, so a join into a
+// big channel costs the copy into the replies, not a walk over every
+// member's flags.
+void Server::sendNames(Client* client, Channel* channel) {
+    const std::string& names = channel->getNames();
+    const std::string& nick = client->getNickname();
+    const std::string& name = channel->getName();
+    // ":server 353 nick = #chan :" and CRLF
+    size_t overhead = _serverName.length() + nick.length() + name.length() + 13;
+    size_t budget = overhead < InputBuffer::MAX_LINE ? InputBuffer::MAX_LINE - overhead : 1;
+
+    size_t start = 0;
+    while (start < names.length()) {
+        size_t end = names.length();
+        if (end - start > budget) {
+            end = names.rfind(' ', start + budget);
+            if (end == std::string::npos || end <= start) { // One name longer than the room
+                end = names.find(' ', start);
+                if (end == std::string::npos) end = names.length();
+            }
         }
+        sendReply(client, LineBuilder() << ":" << _serverName << " 353 " << nick << " = " << name << " :"
+            << StringView(names.data() + start, end - start));
+        start = end + 1;
+    }
+    sendNumericReply(client, "366", name + " :End of /NAMES list");
+}
+
+// The cached names of the client's channels still hold its old nick
+void Server::renamedMember(Client* client) {
+    const std::set<Channel*>& channels = client->getChannels();
+    for (std::set<Channel*>::const_iterator it = channels.begin(); it != channels.end(); ++it) {
+        (*it)->forgetNames();
+    }
+}
+
+// --- Channel Database ---
+// After a failed upgrade the live channels are already here
+void Server::openChannelStore() {
+    if (_config.channelDb.empty()) return;
+    _savedChannels.clear();
+    _channelStore.open(_config.channelDb, _config.channelDbCompact, _savedChannels);
+    for (std::map<std::string, Channel*>::iterator it = _channels.begin(); it != _channels.end(); ++it) {
+        _savedChannels.erase(it->first);
     }
+}
+
+void Server::saveChannel(Channel* channel) {
+    if (!_channelStore.isOpen()) return;
+    ChannelSettings settings;
+    settings.name = channel->getName();
+    settings.createdAt = channel->getCreatedAt();
+    settings.topic = channel->getTopic();
+    settings.topicTime = channel->getTopicTime();
+    settings.key = channel->getKey();
+    settings.inviteOnly = channel->getMode('i');
+    settings.topicRestricted = channel->getMode('t');
+    settings.userLimit = channel->getUserLimit();
+    _savedChannels.erase(settings.name);
+    _channelStore.save(settings);
+}
+
+void Server::forgetChannel(const std::string& name) {
+    if (_channelStore.isOpen()) _channelStore.forget(name);
+}
 
-    std::cout << "Client " << client->getNickname() << " (fd: " << clientFd << ") disconnected." << std::endl;
+// A channel created by a local JOIN takes back the settings it had when
+// the server last stopped, if any; its creator is its operator, as with
+// any new channel
+void Server::reviveChannel(Channel* channel) {
+    std::map<std::string, ChannelSettings>::iterator it = _savedChannels.find(channel->getName());
+    if (it == _savedChannels.end()) {
+        saveChannel(channel);
+        return;
+    }
+    const ChannelSettings& settings = it->second;
+    channel->setCreatedAt(settings.createdAt);
+    channel->setTopic(settings.topic, settings.topicTime);
+    channel->setKey(settings.key);
+    channel->setMode('i', settings.inviteOnly);
+    channel->setMode('t', settings.topicRestricted);
+    channel->setUserLimit(settings.userLimit);
+    _savedChannels.erase(it);
+}
 
-    close(clientFd);
-    delete client;
-    _clients.erase(clientFd);
+// A saved channel keeps its +i and +k across the restart: the JOIN that
+// would revive it must pass them, or its settings stay saved. No one can
+// be invited to it yet, and +l never refuses the first member
+bool Server::revivalAdmits(Client* client, const std::string& name, const std::string& key) {
+    std::map<std::string, ChannelSettings>::const_iterator it = _savedChannels.find(name);
+    if (it == _savedChannels.end()) return true;
+    if (it->second.inviteOnly) {
+        sendNumericReply(client, "473", name + " :Cannot join channel (+i)");
+        return false;
+    }
+    if (!it->second.key.empty() && key != it->second.key) {
+        sendNumericReply(client, "475", name + " :Cannot join channel (+k)");
+        return false;
+    }
+    return true;
 }
 
+// The core is done with the client: its reactor flushes, closes and frees it
+void Server::releaseClient(Client* client) {
+    if (!_threaded) {
+        client->getReactor()->closeConnection(client);
+        return;
+    }
+    OutboundBatch*& batch = _outbound[client->getReactor()->getId()];
+    if (!batch) batch = new OutboundBatch();
+    batch->items.push_back(OutboundItem(client, PayloadRef()));
+}
+
+// Changes to a connection itself, in order with the output around them
+void Server::postToReactor(Client* client, OutboundItem::Action action) {
+    if (!_threaded) {
+        if (action == OutboundItem::ATTACH) client->getReactor()->attach(client);
+        else client->getReactor()->markServerLink(client);
+        return;
+    }
+    OutboundBatch*& batch = _outbound[client->getReactor()->getId()];
+    if (!batch) batch = new OutboundBatch();
+    batch->items.push_back(OutboundItem(client, action));
+}
 
 // --- Command Processing ---
-void Server::processCommand(Client* client, const std::string& message) {
-    std::cout << "FD(" << client->getFd() << ") C: " << message << std::endl;
-    
-    std::string command;
-    std::vector<std::string> args;
-    std::string trailing;
-    
-    size_t space_pos = message.find(' ');
-    if (space_pos != std::string::npos) {
-        command = message.substr(0, space_pos);
-        std::string rest = message.substr(space_pos + 1);
-        
-        size_t colon_pos = rest.find(':');
-        if (colon_pos != std::string::npos) {
-            trailing = rest.substr(colon_pos + 1);
-            rest = rest.substr(0, colon_pos);
-        }
-        
-        std::stringstream ss(rest);
-        std::string arg;
-        while (ss >> arg) {
-            args.push_back(arg);
-        }
-        if (!trailing.empty()) {
-            args.push_back(trailing);
-        }
-    } else {
-        command = message;
+const Server::CommandSpec Server::_commandTable[CMD_COUNT] = {
+    { "PASS",    &Server::cmdPass,    1, ACCESS_ANY },
+    { "NICK",    &Server::cmdNick,    0, ACCESS_AUTHENTICATED },
+    { "USER",    &Server::cmdUser,    4, ACCESS_AUTHENTICATED },
+    { "QUIT",    &Server::cmdQuit,    0, ACCESS_ANY },
+    { "PING",    &Server::cmdPing,    1, ACCESS_ANY },
+    { "PONG",    &Server::cmdPong,    0, ACCESS_ANY },
+    { "PRIVMSG", &Server::cmdPrivmsg, 2, ACCESS_REGISTERED },
+    { "JOIN",    &Server::cmdJoin,    1, ACCESS_REGISTERED },
+    { "PART",    &Server::cmdPart,    1, ACCESS_REGISTERED },
+    { "TOPIC",   &Server::cmdTopic,   1, ACCESS_REGISTERED },
+    { "KICK",    &Server::cmdKick,    2, ACCESS_REGISTERED },
+    { "INVITE",  &Server::cmdInvite,  2, ACCESS_REGISTERED },
+    { "MODE",    &Server::cmdMode,    1, ACCESS_REGISTERED },
+    { "STATS",   &Server::cmdStats,   1, ACCESS_REGISTERED },
+    { "CHATHISTORY", &Server::cmdChathistory, 4, ACCESS_REGISTERED },
+    { "NAMES",   &Server::cmdNames,   0, ACCESS_REGISTERED },
+    // Server-to-server: only SERVER and ERROR mean anything before a link
+    // is established, and afterwards processLinkCommand handles them all
+    { "SERVER",  &Server::cmdServer,  3, ACCESS_ANY },
+    { "SID",     NULL,                0, ACCESS_ANY },
+    { "UID",     NULL,                0, ACCESS_ANY },
+    { "SJOIN",   NULL,                0, ACCESS_ANY },
+    { "TMODE",   NULL,                0, ACCESS_ANY },
+    { "TB",      NULL,                0, ACCESS_ANY },
+    { "EOB",     NULL,                0, ACCESS_ANY },
+    { "SQUIT",   NULL,                0, ACCESS_ANY },
+    { "KILL",    NULL,                0, ACCESS_ANY },
+    { "ERROR",   &Server::cmdError,   0, ACCESS_ANY }
+};
+
+void Server::processCommand(Client* client, CommandId id, const MessageView& message) {
+    bool registered = client->getRegistrationState() == REGISTERED;
+
+    if (id == CMD_UNKNOWN || !_commandTable[id].handler) {
+        if (!registered) sendNumericReply(client, "451", ":You have not registered");
+        else sendNumericReply(client, "421", message.command.str() + " :Unknown command");
+        return;
     }
-    
-    std::transform(command.begin(), command.end(), command.begin(), ::toupper);
 
-    if (command == "PASS") cmdPass(client, args);
-    else if (command == "NICK") cmdNick(client, args);
-    else if (command == "USER") cmdUser(client, args);
-    else if (command == "QUIT") cmdQuit(client, args);
-    else if (client->getRegistrationState() != REGISTERED) {
-         sendNumericReply(client, "451", ":You have not registered");
-         return;
+    const CommandSpec& spec = _commandTable[id];
+    if (spec.access == ACCESS_REGISTERED && !registered) {
+        sendNumericReply(client, "451", ":You have not registered");
+        return;
+    }
+    if (spec.access == ACCESS_AUTHENTICATED && !client->isAuthenticated()) {
+        sendNumericReply(client, "451", ":You have not registered (PASSWORD required)");
+        return;
     }
-    else if (command == "PRIVMSG") cmdPrivmsg(client, args);
-    else if (command == "JOIN") cmdJoin(client, args);
-    else if (command == "PART") cmdPart(client, args);
-    else if (command == "TOPIC") cmdTopic(client, args);
-    else if (command == "KICK") cmdKick(client, args);
-    else if (command == "INVITE") cmdInvite(client, args);
-    else if (command == "MODE") cmdMode(client, args);
-    else {
-        sendNumericReply(client, "421", command + " :Unknown command");
+    if (message.size() < spec.minParams) {
+        sendNumericReply(client, "461", std::string(spec.name) + " :Not enough parameters");
+        return;
     }
+    (this->*spec.handler)(client, message);
 }
 
 // --- Command Implementations ---
 #include "Commands.cpp" // Splitting implementations into a separate file for clarity
 
 // --- Utility Functions ---
-void Server::sendReply(Client* client, const std::string& reply) {
-    std::string full_reply = reply + "\r\n";
-    std::cout << "FD(" << client->getFd() << ") S: " << full_reply;
-    send(client->getFd(), full_reply.c_str(), full_reply.length(), 0);
+void Server::sendReply(Client* client, const LineBuilder& reply) {
+    LOG(LOG_INFO, LOG_WIRE, "FD(" << client->getFd() << ") S: " << reply.str());
+    sendPayload(client, PayloadRef(Payload::create(reply)));
 }
 
-void Server::sendNumericReply(Client* client, const std::string& code, const std::string& message) {
-    std::string reply = ":" + _serverName + " " + code + " " + client->getNickname() + " " + message;
-    sendReply(client, reply);
+void Server::sendPayload(Client* client, const PayloadRef& payload) {
+    _metrics.messagesOut[_outputSlot].add();
+    _metrics.bytesOut[_outputSlot].add(payload.length());
+    if (!_threaded) {
+        client->getReactor()->queueOutput(client, payload);
+        return;
+    }
+    OutboundBatch*& batch = _outbound[client->getReactor()->getId()];
+    if (!batch) batch = new OutboundBatch();
+    batch->items.push_back(OutboundItem(client, payload));
 }
 
-Client* Server::findClientByNick(const std::string& nick) {
-    for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
-        if (it->second->getNickname() == nick) {
-            return it->second;
+// Builds the wire line once; every member's queue holds a reference to it,
+// and so can the channel's history.
+PayloadRef Server::broadcast(Channel* channel, const LineBuilder& message, Client* except) {
+    PayloadRef payload(Payload::create(message));
+    const std::vector<Client*>& clients = channel->getMembers();
+    LOG(LOG_INFO, LOG_WIRE, channel->getName() << " S(" << clients.size() << "): " << message.str());
+    size_t recipients = 0;
+    for (size_t i = 0; i < clients.size(); ++i) {
+        // Remote members hear it from their own server (relayToChannel)
+        if (clients[i] != except && !clients[i]->isRemote()) {
+            sendPayload(clients[i], payload);
+            ++recipients;
         }
     }
-    return NULL;
+    _metrics.fanout.record(recipients);
+    return payload;
+}
+
+// Users sharing several channels with the quitter get the QUIT once
+void Server::broadcastQuit(Client* client, const std::string& reason) {
+    PayloadRef payload(Payload::create(LineBuilder() << client->getPrefix() << " QUIT :" << reason));
+
+    std::set<Client*> notified;
+    notified.insert(client);
+    size_t recipients = 0;
+    const std::set<Channel*>& channels = client->getChannels();
+    for (std::set<Channel*>::const_iterator it = channels.begin(); it != channels.end(); ++it) {
+        const std::vector<Client*>& clients = (*it)->getMembers();
+        for (size_t i = 0; i < clients.size(); ++i) {
+            if (notified.insert(clients[i]).second && !clients[i]->isRemote()) {
+                sendPayload(clients[i], payload);
+                ++recipients;
+            }
+        }
+    }
+    _metrics.fanout.record(recipients);
+}
+
+// Before the rename, so the line carries the old prefix. Like QUIT, once
+// per user however many channels they share; a local user sees their own.
+void Server::broadcastNick(Client* client, const std::string& nick) {
+    PayloadRef payload(Payload::create(LineBuilder() << client->getPrefix() << " NICK :" << nick));
+
+    std::set<Client*> notified;
+    size_t recipients = 0;
+    if (!client->isRemote()) {
+        sendPayload(client, payload);
+        ++recipients;
+    }
+    notified.insert(client);
+    const std::set<Channel*>& channels = client->getChannels();
+    for (std::set<Channel*>::const_iterator it = channels.begin(); it != channels.end(); ++it) {
+        const std::vector<Client*>& clients = (*it)->getMembers();
+        for (size_t i = 0; i < clients.size(); ++i) {
+            if (notified.insert(clients[i]).second && !clients[i]->isRemote()) {
+                sendPayload(clients[i], payload);
+                ++recipients;
+            }
+        }
+    }
+    _metrics.fanout.record(recipients);
+}
+
+void Server::sendNumericReply(Client* client, const std::string& code, const std::string& message) {
+    sendReply(client, LineBuilder() << ":" << _serverName << " " << code << " " << client->getNickname() << " " << message);
+}
+
+Client* Server::findClientByNick(const std::string& nick) {
+    Client** found = _nickIndex.find(nick);
+    return found ? *found : NULL;
 }
\ No newline at end of file
@@ -0,0 +1,874 @@
+#include "Server.hpp"
+#include "Logger.hpp"
+#include "Clock.hpp"
+#include <sstream>
+#include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <algorithm>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Server-to-server linking, after the TS6 protocol of ratbox/charybdis:
+//
+//   PASS <link-password> TS 6 :<SID>        handshake, both directions
+//   SERVER <name> 1 :<description>
+//   :<SID> SID <name> <hops> <SID> :<desc>  a server further away
+//   :<SID> UID <nick> <hops> <nickTS> + <user> <host> 0 <UID> :<realname>
+//   :<SID> SJOIN <channelTS> <#chan> <modes> [params] :[@]<UID> ...
+//   :<SID> TB <#chan> <topicTS> :<topic>
+//   :<SID> EOB                              end of burst
+//   :<UID> NICK <nick> :<nickTS>            and QUIT, PART, TOPIC, KICK,
+//   :<UID> JOIN <channelTS> <#chan> +       INVITE, PRIVMSG as for clients,
+//   :<UID> TMODE <channelTS> <#chan> <modes> [params]   UIDs for nicks
+//   :<SID> SQUIT <SID> :<reason>            a server left
+//   :<SID> KILL <UID> :<reason>             nick collision
+//
+// Users and servers are named by ids, so a nick change never races a
+// message. Every server holds the whole network state; links form a tree,
+// and a line is passed on to every link but the one it came from. Channel
+// messages are the exception: they only go down links with members behind
+// them, once per link however many members that is.
+
+static const char* const SERVER_DESCRIPTION = "ft_irc";
+
+// Lines of an SJOIN burst stay below the 512-byte limit
+static const size_t SJOIN_LINE_MAX = 450;
+
+static std::string toString(long value) {
+    std::ostringstream out;
+    out << value;
+    return out.str();
+}
+
+// The whole line again, to pass on unchanged
+static std::string joinMessage(const MessageView& message) {
+    std::string line;
+    if (!message.prefix.empty()) {
+        line += ':';
+        line += message.prefix.str();
+        line += ' ';
+    }
+    line += message.command.str();
+    for (size_t i = 0; i < message.size(); ++i) {
+        line += i + 1 == message.size() ? " :" : " ";
+        line += message[i].str();
+    }
+    return line;
+}
+
+// "+tkl key 10", or "+" for none: the form SJOIN carries
+static std::string channelModes(Channel* channel) {
+    std::string modes = channel->getModesString();
+    if (modes.empty()) return "+";
+    if (channel->getMode('k')) modes += " " + channel->getKey();
+    if (channel->getMode('l')) modes += " " + toString(channel->getUserLimit());
+    return modes;
+}
+
+// --- Timers ---
+long Server::timerDelayMs() const {
+    long delay = -1;
+    long now = monotonicMs();
+    for (size_t i = 0; i < _linkTargets.size(); ++i) {
+        if (_linkTargets[i].connection) continue;
+        long wait = std::max(0L, _linkTargets[i].nextAttemptMs - now);
+        if (delay < 0 || wait < delay) delay = wait;
+    }
+    return delay;
+}
+
+// Core thread, once per turn of its loop
+void Server::runTimers() {
+    if (_linkTargets.empty()) return;
+    long now = monotonicMs();
+    for (size_t i = 0; i < _linkTargets.size(); ++i) {
+        if (!_linkTargets[i].connection && now >= _linkTargets[i].nextAttemptMs) {
+            connectLink(_linkTargets[i]);
+        }
+    }
+}
+
+// --- Connections ---
+// Non-blocking: the handshake is queued at once and leaves when the
+// connection completes; a refused one comes back as a disconnect
+void Server::connectLink(LinkTarget& target) {
+    target.nextAttemptMs = monotonicMs() + LINK_RETRY_MS;
+
+    struct addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* address = NULL;
+    int error = getaddrinfo(target.host.c_str(), toString(target.port).c_str(), &hints, &address);
+    if (error != 0) {
+        LOG(LOG_WARN, LOG_SERVER, "Link to " << target.host << ":" << target.port << ": " << gai_strerror(error));
+        return;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    bool started = fd >= 0 && fcntl(fd, F_SETFL, O_NONBLOCK) == 0 && fcntl(fd, F_SETFD, FD_CLOEXEC) == 0
+        && (connect(fd, address->ai_addr, address->ai_addrlen) == 0 || errno == EINPROGRESS);
+    error = errno;
+    freeaddrinfo(address);
+    if (!started) {
+        LOG(LOG_WARN, LOG_SERVER, "Link to " << target.host << ":" << target.port << ": " << strerror(error));
+        if (fd >= 0) close(fd);
+        return;
+    }
+
+    Client* connection = new Client(fd, target.host, _reactors[fd % _reactors.size()]);
+    connection->setServerLink(true); // Not yet published to the reactor
+    target.connection = connection;
+    _clients[fd] = connection;
+    postToReactor(connection, OutboundItem::ATTACH);
+    startHandshake(connection);
+    LOG(LOG_INFO, LOG_SERVER, "Connecting to " << target.host << ":" << target.port);
+}
+
+LinkTarget* Server::findLinkTarget(Client* connection) {
+    for (size_t i = 0; i < _linkTargets.size(); ++i) {
+        if (_linkTargets[i].connection == connection) return &_linkTargets[i];
+    }
+    return NULL;
+}
+
+void Server::startHandshake(Client* connection) {
+    sendReply(connection, LineBuilder() << "PASS " << _config.linkPassword << " TS 6 :" << _config.sid);
+    sendReply(connection, LineBuilder() << "SERVER " << _serverName << " 1 :" << SERVER_DESCRIPTION);
+}
+
+// --- Handshake ---
+// SERVER <name> <hops> :<description>, after a PASS naming a SID. The side
+// that accepted the connection answers with its own PASS and SERVER; then
+// both send their bursts.
+void Server::cmdServer(Client* client, const MessageView& args) {
+    if (client->getRegistrationState() == REGISTERED) {
+        sendNumericReply(client, "462", ":You may not reregister");
+        return;
+    }
+    const std::string name = args[0].str();
+    const std::string sid = client->getLinkSid();
+    if (sid.empty()) {
+        closeLink(client, "Access denied");
+        return;
+    }
+    // Lines from servers are told from user lines by a 3-character prefix
+    if (!ServerConfig::isValidSid(sid)) {
+        closeLink(client, "Invalid SID");
+        return;
+    }
+    // A second path to a server we know would close a loop
+    if (name == _serverName || sid == _config.sid || findServerByName(name) || findServer(sid)) {
+        closeLink(client, "Server exists");
+        return;
+    }
+    if (!findLinkTarget(client)) {
+        startHandshake(client);
+        postToReactor(client, OutboundItem::LINK); // Before the burst it is about to receive
+    }
+    establishLink(client, name, sid, args[2].str());
+}
+
+// ERROR from a server refusing our handshake; clients have no business
+// sending it
+void Server::cmdError(Client* client, const MessageView& args) {
+    if (!findLinkTarget(client)) return;
+    LOG(LOG_WARN, LOG_SERVER, "Link to " << client->getHostname() << " refused: " << (args.empty() ? "" : args[0].str()));
+    removeClient(client->getFd(), "");
+}
+
+void Server::establishLink(Client* link, const std::string& name, const std::string& sid, const std::string& description) {
+    RemoteServer* peer = new RemoteServer();
+    peer->name = name;
+    peer->sid = sid;
+    peer->description = description;
+    peer->link = link;
+    _servers[sid] = peer;
+    link->setPeer(peer);
+    link->setLinkSid("");
+
+    sendToLinks(LineBuilder() << ":" << _config.sid << " SID " << name << " 2 " << sid << " :" << description);
+    _links.push_back(link);
+    sendBurst(link);
+    LOG(LOG_INFO, LOG_SERVER, "Linked with " << name << " (" << sid << ")");
+}
+
+// Everything this side knows, parents before children: servers, users,
+// channels with their members and modes, topics
+void Server::sendBurst(Client* link) {
+    std::vector<RemoteServer*> servers;
+    for (std::map<std::string, RemoteServer*>::iterator it = _servers.begin(); it != _servers.end(); ++it) {
+        if (it->second->link != link) servers.push_back(it->second);
+    }
+    for (int hops = 1; !servers.empty(); ++hops) {
+        for (size_t i = 0; i < servers.size();) {
+            RemoteServer* server = servers[i];
+            if (server->hops != hops) {
+                ++i;
+                continue;
+            }
+            std::string uplink = server->uplink ? server->uplink->sid : _config.sid;
+            sendReply(link, LineBuilder() << ":" << uplink << " SID " << server->name << " " << toString(hops + 1)
+                << " " << server->sid << " :" << server->description);
+            servers[i] = servers.back();
+            servers.pop_back();
+        }
+    }
+
+    for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
+        if (!it->second->getUid().empty()) sendReply(link, LineBuilder() << uidLine(it->second));
+    }
+    for (std::map<std::string, RemoteServer*>::iterator it = _servers.begin(); it != _servers.end(); ++it) {
+        if (it->second->link == link) continue;
+        const std::set<Client*>& users = it->second->users;
+        for (std::set<Client*>::const_iterator user = users.begin(); user != users.end(); ++user) {
+            sendReply(link, LineBuilder() << uidLine(*user));
+        }
+    }
+
+    for (std::map<std::string, Channel*>::iterator it = _channels.begin(); it != _channels.end(); ++it) {
+        Channel* channel = it->second;
+        std::string head = ":" + _config.sid + " SJOIN " + toString(channel->getCreatedAt()) + " " + channel->getName()
+            + " " + channelModes(channel) + " :";
+        std::string members;
+        const std::vector<Client*>& clients = channel->getMembers();
+        for (size_t i = 0; i < clients.size(); ++i) {
+            if (clients[i]->getUid().empty()) continue;
+            if (head.length() + members.length() > SJOIN_LINE_MAX) {
+                sendReply(link, LineBuilder() << head << members);
+                members.clear();
+            }
+            if (!members.empty()) members += ' ';
+            if (channel->isOperator(clients[i])) members += '@';
+            members += clients[i]->getUid();
+        }
+        if (!members.empty()) sendReply(link, LineBuilder() << head << members);
+        if (!channel->getTopic().empty()) {
+            sendReply(link, LineBuilder() << ":" << _config.sid << " TB " << channel->getName() << " "
+                << toString(channel->getTopicTime()) << " :" << channel->getTopic());
+        }
+    }
+    sendReply(link, LineBuilder() << ":" << _config.sid << " EOB");
+}
+
+// ERROR to the peer, then the connection goes like any other
+void Server::closeLink(Client* connection, const std::string& reason) {
+    LOG(LOG_WARN, LOG_SERVER, "Closing link " << connection->getHostname() << " (fd " << connection->getFd() << "): " << reason);
+    sendReply(connection, LineBuilder() << "ERROR :Closing Link: " << connection->getHostname() << " (" << reason << ")");
+    removeClient(connection->getFd(), reason);
+}
+
+// Before an upgrade: links are re-established by the new process rather
+// than carried over
+void Server::closeLinks(const std::string& reason) {
+    std::vector<Client*> connections(_links);
+    for (size_t i = 0; i < _linkTargets.size(); ++i) {
+        if (_linkTargets[i].connection && !_linkTargets[i].connection->getPeer())
+            connections.push_back(_linkTargets[i].connection);
+    }
+    for (size_t i = 0; i < connections.size(); ++i) {
+        closeLink(connections[i], reason);
+    }
+    for (size_t i = 0; i < _linkTargets.size(); ++i) {
+        _linkTargets[i].nextAttemptMs = 0;
+    }
+}
+
+// The link is gone, and with it every server behind it
+void Server::splitLink(Client* link, const std::string& reason) {
+    RemoteServer* peer = link->getPeer();
+    link->setPeer(NULL);
+    _links.erase(std::find(_links.begin(), _links.end(), link));
+    sendToLinks(LineBuilder() << ":" << _config.sid << " SQUIT " << peer->sid << " :" << reason);
+    LOG(LOG_WARN, LOG_SERVER, "Lost link with " << peer->name << " (" << reason << ")");
+    removeServer(peer);
+}
+
+// A server and the servers behind it leave; their users QUIT with the
+// usual netsplit reason, "<uplink> <server>"
+void Server::removeServer(RemoteServer* server) {
+    std::vector<RemoteServer*> gone;
+    for (std::map<std::string, RemoteServer*>::iterator it = _servers.begin(); it != _servers.end(); ++it) {
+        RemoteServer* behind = it->second;
+        while (behind && behind != server) behind = behind->uplink;
+        if (behind) gone.push_back(it->second);
+    }
+    for (size_t i = 0; i < gone.size(); ++i) {
+        std::string reason = (gone[i]->uplink ? gone[i]->uplink->name : _serverName) + " " + gone[i]->name;
+        std::set<Client*> users(gone[i]->users);
+        for (std::set<Client*>::iterator user = users.begin(); user != users.end(); ++user) {
+            broadcastQuit(*user, reason);
+            removeRemoteUser(*user);
+        }
+    }
+    for (size_t i = 0; i < gone.size(); ++i) {
+        _servers.erase(gone[i]->sid);
+        delete gone[i];
+    }
+}
+
+void Server::removeRemoteUser(Client* user) {
+    detachClient(user);
+    user->getServer()->users.erase(user);
+    delete user;
+}
+
+// Shutdown: channels are already gone
+void Server::clearNetwork() {
+    for (std::map<std::string, RemoteServer*>::iterator it = _servers.begin(); it != _servers.end(); ++it) {
+        const std::set<Client*>& users = it->second->users;
+        for (std::set<Client*>::const_iterator user = users.begin(); user != users.end(); ++user) {
+            delete *user;
+        }
+        delete it->second;
+    }
+    _servers.clear();
+    _uidIndex.clear();
+    _links.clear();
+}
+
+// --- Identity ---
+// SID, then six characters starting with a letter: AAAAAA, AAAAAB, ...
+std::string Server::nextUid() {
+    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    unsigned long n = _nextUid++;
+    char id[6];
+    for (int i = 5; i > 0; --i) {
+        id[i] = digits[n % 36];
+        n /= 36;
+    }
+    id[0] = digits[n % 26];
+    return _config.sid + std::string(id, 6);
+}
+
+std::string Server::uidLine(Client* user) const {
+    std::ostringstream line;
+    RemoteServer* server = user->getServer();
+    line << ":" << (server ? server->sid : _config.sid) << " UID " << user->getNickname() << " "
+         << (server ? server->hops + 1 : 1) << " " << user->getNickTs() << " + " << user->getUsername() << " "
+         << user->getHostname() << " 0 " << user->getUid() << " :" << user->getRealname();
+    return line.str();
+}
+
+// A local client finished registering
+void Server::introduceUser(Client* client) {
+    client->setUid(nextUid());
+    _uidIndex.insert(client->getUid(), client);
+    if (!_links.empty()) sendToLinks(LineBuilder() << uidLine(client));
+}
+
+void Server::announceNick(Client* client) {
+    sendToLinks(LineBuilder() << ":" << client->getUid() << " NICK " << client->getNickname() << " :"
+        << toString(client->getNickTs()));
+}
+
+// A channel is born with an SJOIN carrying its timestamp and modes
+void Server::announceJoin(Client* client, Channel* channel, bool created) {
+    if (_links.empty()) return;
+    std::string ts = toString(channel->getCreatedAt());
+    if (created) {
+        sendToLinks(LineBuilder() << ":" << _config.sid << " SJOIN " << ts << " " << channel->getName() << " "
+            << channelModes(channel) << " :@" << client->getUid());
+    } else {
+        sendToLinks(LineBuilder() << ":" << client->getUid() << " JOIN " << ts << " " << channel->getName() << " +");
+    }
+}
+
+void Server::announceMode(Client* client, Channel* channel, const ModeChange& change) {
+    sendToLinks(LineBuilder() << ":" << client->getUid() << " TMODE " << toString(channel->getCreatedAt()) << " "
+        << channel->getName() << " " << change.modes << change.linkParams);
+}
+
+// The KILL goes everywhere but except; the user is gone here afterwards
+void Server::killUser(Client* user, const std::string& reason, Client* except) {
+    sendToLinks(LineBuilder() << ":" << _config.sid << " KILL " << user->getUid() << " :" << reason, except);
+    std::string quit = "Killed (" + reason + ")";
+    broadcastQuit(user, quit);
+    if (user->isRemote()) {
+        removeRemoteUser(user);
+        return;
+    }
+    sendReply(user, LineBuilder() << "ERROR :Closing Link: " << user->getHostname() << " (" << quit << ")");
+    removeClient(user->getFd(), "");
+}
+
+// Nick collision, TS6 rules: the nick taken first stays and the later one
+// is killed; equal times kill both. Kills the holder if it loses and
+// returns whether the newcomer may have the nick.
+bool Server::resolveCollision(Client* holder, time_t ts) {
+    LOG(LOG_WARN, LOG_SERVER, "Nick collision on " << holder->getNickname());
+    if (holder->getNickTs() >= ts) {
+        if (holder->getNickTs() == ts) killUser(holder, "Nick collision", NULL);
+        return false;
+    }
+    killUser(holder, "Nick collision", NULL);
+    return true;
+}
+
+// Channel timestamps, TS6 rules: when two sides created the same channel
+// independently the older one wins, and the newer one loses its modes and
+// operators. Returns whether the incoming side's modes and ops apply.
+bool Server::adoptChannelTs(Channel* channel, time_t ts) {
+    if (ts >= channel->getCreatedAt()) return ts == channel->getCreatedAt();
+
+    channel->setCreatedAt(ts);
+    std::string modes = channel->getModesString();
+    if (!modes.empty()) {
+        modes[0] = '-';
+        broadcast(channel, LineBuilder() << ":" << _serverName << " MODE " << channel->getName() << " " << modes);
+    }
+    channel->setMode('i', false);
+    channel->setMode('t', false);
+    channel->setKey("");
+    channel->setUserLimit(0);
+    saveChannel(channel);
+    const std::vector<Client*>& members = channel->getMembers();
+    for (size_t i = 0; i < members.size(); ++i) {
+        if (!channel->isOperator(members[i])) continue;
+        channel->removeOperator(members[i]);
+        broadcast(channel, LineBuilder() << ":" << _serverName << " MODE " << channel->getName() << " -o "
+            << members[i]->getNickname());
+    }
+    return true;
+}
+
+// --- Routing ---
+void Server::sendToLinks(const LineBuilder& line, Client* except) {
+    if (_links.empty()) return;
+    PayloadRef payload(Payload::create(line));
+    for (size_t i = 0; i < _links.size(); ++i) {
+        if (_links[i] != except) sendPayload(_links[i], payload);
+    }
+}
+
+void Server::sendToServer(RemoteServer* server, const LineBuilder& line) {
+    sendReply(server->link, line);
+}
+
+// Once down each link with members behind it, however many there are
+void Server::relayToChannel(Channel* channel, const LineBuilder& line, Client* except) {
+    if (_links.empty() || (_links.size() == 1 && _links[0] == except)) return;
+    std::vector<Client*> links;
+    const std::vector<Client*>& members = channel->getMembers();
+    for (size_t i = 0; i < members.size() && links.size() < _links.size(); ++i) {
+        if (!members[i]->isRemote()) continue;
+        Client* link = members[i]->getServer()->link;
+        if (link != except && std::find(links.begin(), links.end(), link) == links.end()) links.push_back(link);
+    }
+    if (links.empty()) return;
+    PayloadRef payload(Payload::create(line));
+    for (size_t i = 0; i < links.size(); ++i) {
+        sendPayload(links[i], payload);
+    }
+}
+
+void Server::forward(Client* link, const MessageView& message) {
+    if (_links.size() > 1) sendToLinks(LineBuilder() << joinMessage(message), link);
+}
+
+RemoteServer* Server::findServer(const std::string& sid) {
+    std::map<std::string, RemoteServer*>::iterator it = _servers.find(sid);
+    return it == _servers.end() ? NULL : it->second;
+}
+
+RemoteServer* Server::findServerByName(const std::string& name) {
+    for (std::map<std::string, RemoteServer*>::iterator it = _servers.begin(); it != _servers.end(); ++it) {
+        if (it->second->name == name) return it->second;
+    }
+    return NULL;
+}
+
+Client* Server::findClientByUid(const std::string& uid) {
+    Client** found = _uidIndex.find(uid);
+    return found ? *found : NULL;
+}
+
+// --- Lines From Links ---
+// Indexed by CommandId, like _commandTable
+const Server::LinkSpec Server::_linkTable[CMD_COUNT] = {
+    { NULL,                  0, false }, // PASS
+    { &Server::linkNick,     2, true  },
+    { NULL,                  0, false }, // USER
+    { &Server::linkQuit,     0, true  },
+    { &Server::linkPing,     1, false },
+    { NULL,                  0, false }, // PONG
+    { &Server::linkPrivmsg,  2, true  },
+    { &Server::linkJoin,     2, true  },
+    { &Server::linkPart,     1, true  },
+    { &Server::linkTopic,    2, true  },
+    { &Server::linkKick,     2, true  },
+    { &Server::linkInvite,   2, true  },
+    { NULL,                  0, false }, // MODE: TMODE instead
+    { NULL,                  0, false }, // STATS
+    { NULL,                  0, false }, // CHATHISTORY
+    { NULL,                  0, false }, // NAMES
+    { NULL,                  0, false }, // SERVER
+    { &Server::linkSid,      4, false },
+    { &Server::linkUid,      9, false },
+    { &Server::linkSjoin,    4, false },
+    { &Server::linkTmode,    3, true  },
+    { &Server::linkTb,       3, false },
+    { &Server::linkEob,      0, false },
+    { &Server::linkSquit,    1, false },
+    { &Server::linkKill,     1, false },
+    { &Server::linkError,    0, false }
+};
+
+// Lines whose source has left the network meanwhile are dropped, as are
+// lines arriving from the wrong direction for their source
+void Server::processLinkCommand(Client* link, CommandId id, const MessageView& message) {
+    if (id == CMD_UNKNOWN || !_linkTable[id].handler) {
+        LOG(LOG_DEBUG, LOG_SERVER, "Ignoring " << message.command.str() << " from " << link->getPeer()->name);
+        return;
+    }
+    const LinkSpec& spec = _linkTable[id];
+    if (message.size() < spec.minParams) {
+        LOG(LOG_WARN, LOG_SERVER, "Malformed " << message.command.str() << " from " << link->getPeer()->name);
+        return;
+    }
+
+    LinkSource source;
+    source.user = NULL;
+    source.server = link->getPeer();
+    if (!message.prefix.empty()) {
+        std::string prefix = message.prefix.str();
+        if (prefix.length() == 3) {
+            source.server = findServer(prefix);
+        } else {
+            source.user = findClientByUid(prefix);
+            source.server = source.user ? source.user->getServer() : NULL;
+        }
+        if (!source.server) return;
+        if (source.server->link != link) {
+            LOG(LOG_WARN, LOG_SERVER, "Fake direction: " << prefix << " from " << link->getPeer()->name);
+            return;
+        }
+    }
+    if (spec.userSource && !source.user) return;
+    // A peer's malformed line must not take the whole server down; what it
+    // already changed is set right by the burst after it reconnects
+    try {
+        (this->*spec.handler)(link, source, message);
+    } catch (const std::exception& e) {
+        LOG(LOG_ERROR, LOG_SERVER, "Bad " << message.command.str() << " from " << link->getHostname() << ": " << e.what());
+        if (link->getPeer()) closeLink(link, "Protocol error");
+    }
+}
+
+// :<UID> NICK <nick> :<nickTS>
+void Server::linkNick(Client* link, const LinkSource& source, const MessageView& args) {
+    const std::string nick = args[0].str();
+    time_t ts = std::strtol(args[1].c_str(), NULL, 10);
+    if (!isValidNick(nick)) {
+        killUser(source.user, "Erroneous nickname", NULL);
+        return;
+    }
+    Client* holder = findClientByNick(nick);
+    if (holder && holder != source.user && !resolveCollision(holder, ts)) {
+        killUser(source.user, "Nick collision", NULL);
+        return;
+    }
+    broadcastNick(source.user, nick);
+    _nickIndex.erase(source.user->getNickname());
+    source.user->setNickname(nick);
+    source.user->setNickTs(ts);
+    renamedMember(source.user);
+    _nickIndex.insert(nick, source.user);
+    forward(link, args);
+}
+
+void Server::linkQuit(Client* link, const LinkSource& source, const MessageView& args) {
+    broadcastQuit(source.user, args.empty() ? "Client Quit" : args[0].str());
+    removeRemoteUser(source.user);
+    forward(link, args);
+}
+
+void Server::linkPing(Client* link, const LinkSource& source, const MessageView& args) {
+    (void)source;
+    sendReply(link, LineBuilder() << ":" << _config.sid << " PONG " << _serverName << " :" << args[0]);
+}
+
+// :<UID> PRIVMSG <#chan|UID> :<text>
+void Server::linkPrivmsg(Client* link, const LinkSource& source, const MessageView& args) {
+    const std::string target = args[0].str();
+    if (target[0] == '#') {
+        std::map<std::string, Channel*>::iterator it = _channels.find(target);
+        if (it == _channels.end()) return;
+        it->second->getHistory().record(broadcast(it->second, LineBuilder() << source.user->getPrefix() << " PRIVMSG "
+            << target << " :" << args[1]));
+        relayToChannel(it->second, LineBuilder() << ":" << source.user->getUid() << " PRIVMSG " << target << " :" << args[1], link);
+        return;
+    }
+    Client* dest = findClientByUid(target);
+    if (!dest) return;
+    if (!dest->isRemote()) {
+        sendReply(dest, LineBuilder() << source.user->getPrefix() << " PRIVMSG " << dest->getNickname() << " :" << args[1]);
+    } else if (dest->getServer()->link != link) {
+        sendToServer(dest->getServer(), LineBuilder() << ":" << source.user->getUid() << " PRIVMSG " << target << " :" << args[1]);
+    }
+}
+
+// :<UID> JOIN <channelTS> <#chan> +
+void Server::linkJoin(Client* link, const LinkSource& source, const MessageView& args) {
+    const std::string name = args[1].str();
+    if (name[0] != '#') return;
+    time_t ts = std::strtol(args[0].c_str(), NULL, 10);
+
+    std::map<std::string, Channel*>::iterator it = _channels.find(name);
+    Channel* channel;
+    if (it == _channels.end()) {
+        // Crossed with the last PART here; nobody gets operator status
+        channel = new Channel(name, source.user);
+        channel->removeOperator(source.user);
+        channel->setCreatedAt(ts);
+        _channels[name] = channel;
+        saveChannel(channel);
+    } else {
+        channel = it->second;
+        adoptChannelTs(channel, ts);
+        if (!channel->addClient(source.user)) return;
+    }
+    channel->removeInvite(source.user);
+    channel->getHistory().record(broadcast(channel, LineBuilder() << source.user->getPrefix() << " JOIN :" << name));
+    forward(link, args);
+}
+
+void Server::linkPart(Client* link, const LinkSource& source, const MessageView& args) {
+    const std::string name = args[0].str();
+    std::map<std::string, Channel*>::iterator it = _channels.find(name);
+    if (it == _channels.end() || !it->second->isClientInChannel(source.user)) return;
+    std::string reason = args.size() > 1 ? args[1].str() : "Leaving";
+    it->second->getHistory().record(broadcast(it->second, LineBuilder() << source.user->getPrefix() << " PART " << name
+        << " :" << reason));
+    partChannel(it->second, source.user);
+    forward(link, args);
+}
+
+void Server::linkTopic(Client* link, const LinkSource& source, const MessageView& args) {
+    const std::string name = args[0].str();
+    std::map<std::string, Channel*>::iterator it = _channels.find(name);
+    if (it == _channels.end()) return;
+    const std::string topic = args[1].str();
+    it->second->setTopic(topic);
+    saveChannel(it->second);
+    it->second->getHistory().record(broadcast(it->second, LineBuilder() << source.user->getPrefix() << " TOPIC " << name
+        << " :" << topic));
+    forward(link, args);
+}
+
+// :<UID> KICK <#chan> <UID> :<reason>; the kicker's server checked its rights
+void Server::linkKick(Client* link, const LinkSource& source, const MessageView& args) {
+    const std::string name = args[0].str();
+    std::map<std::string, Channel*>::iterator it = _channels.find(name);
+    Client* target = findClientByUid(args[1].str());
+    if (it == _channels.end() || !target || !it->second->isClientInChannel(target)) return;
+    std::string reason = args.size() > 2 ? args[2].str() : "Kicked";
+    it->second->getHistory().record(broadcast(it->second, LineBuilder() << source.user->getPrefix() << " KICK " << name
+        << " " << target->getNickname() << " :" << reason));
+    partChannel(it->second, target);
+    forward(link, args);
+}
+
+// :<UID> INVITE <UID> <#chan>, routed to the invitee's server only
+void Server::linkInvite(Client* link, const LinkSource& source, const MessageView& args) {
+    Client* target = findClientByUid(args[0].str());
+    std::map<std::string, Channel*>::iterator it = _channels.find(args[1].str());
+    if (!target || it == _channels.end()) return;
+    if (target->isRemote()) {
+        if (target->getServer()->link != link) sendToServer(target->getServer(), LineBuilder() << joinMessage(args));
+        return;
+    }
+    it->second->addInvite(target);
+    sendReply(target, LineBuilder() << source.user->getPrefix() << " INVITE " << target->getNickname() << " :"
+        << it->second->getName());
+}
+
+// :<SID> SID <name> <hops> <SID> :<description>
+void Server::linkSid(Client* link, const LinkSource& source, const MessageView& args) {
+    const std::string name = args[0].str();
+    const std::string sid = args[2].str();
+    if (!ServerConfig::isValidSid(sid)) {
+        closeLink(link, "Invalid SID: " + sid);
+        return;
+    }
+    if (name == _serverName || sid == _config.sid || findServerByName(name) || findServer(sid)) {
+        closeLink(link, "Server exists: " + name);
+        return;
+    }
+    RemoteServer* server = new RemoteServer();
+    server->name = name;
+    server->sid = sid;
+    server->description = args[3].str();
+    server->hops = source.server->hops + 1;
+    server->link = link;
+    server->uplink = source.server;
+    _servers[sid] = server;
+    forward(link, args);
+}
+
+// :<SID> UID <nick> <hops> <nickTS> <umodes> <user> <host> <ip> <UID> :<realname>
+void Server::linkUid(Client* link, const LinkSource& source, const MessageView& args) {
+    if (source.user) return;
+    const std::string nick = args[0].str();
+    const std::string uid = args[7].str();
+    time_t ts = std::strtol(args[2].c_str(), NULL, 10);
+    if (findClientByUid(uid)) {
+        LOG(LOG_WARN, LOG_SERVER, "Duplicate UID " << uid << " from " << link->getPeer()->name);
+        return;
+    }
+    if (!isValidNick(nick)) {
+        sendReply(link, LineBuilder() << ":" << _config.sid << " KILL " << uid << " :Erroneous nickname");
+        return;
+    }
+    Client* holder = findClientByNick(nick);
+    if (holder && !resolveCollision(holder, ts)) {
+        sendReply(link, LineBuilder() << ":" << _config.sid << " KILL " << uid << " :Nick collision");
+        return;
+    }
+
+    Client* user = new Client(-1, args[5].str(), NULL);
+    user->setNickname(nick);
+    user->setUsername(args[4].str());
+    user->setRealname(args[8].str());
+    user->setUid(uid);
+    user->setNickTs(ts);
+    user->setServer(source.server);
+    user->setRegistrationState(REGISTERED);
+    source.server->users.insert(user);
+    _nickIndex.insert(nick, user);
+    _uidIndex.insert(uid, user);
+    forward(link, args);
+}
+
+// :<SID> SJOIN <channelTS> <#chan> <modes> [params] :[@]<UID> ...
+void Server::linkSjoin(Client* link, const LinkSource& source, const MessageView& args) {
+    const std::string name = args[1].str();
+    if (name[0] != '#') return;
+    time_t ts = std::strtol(args[0].c_str(), NULL, 10);
+
+    std::map<std::string, Channel*>::iterator it = _channels.find(name);
+    Channel* channel = it == _channels.end() ? NULL : it->second;
+    bool theirModes = channel ? adoptChannelTs(channel, ts) : true;
+    bool created = false;
+
+    std::vector<Client*> ops;
+    std::istringstream members(args[args.size() - 1].str());
+    std::string token;
+    while (members >> token) {
+        size_t at = token.find_first_not_of("@+");
+        if (at == std::string::npos) continue; // Status prefixes without a UID
+        bool op = token[0] == '@';
+        Client* member = findClientByUid(token.substr(at));
+        if (!member || !member->isRemote() || member->getServer()->link != link) continue;
+        if (!channel) {
+            channel = new Channel(name, member);
+            channel->removeOperator(member);
+            channel->setCreatedAt(ts);
+            channel->setMode('t', false); // The modes below are the whole set
+            _channels[name] = channel;
+            saveChannel(channel);
+            created = true;
+        } else if (!channel->addClient(member)) {
+            continue;
+        }
+        channel->removeInvite(member);
+        channel->getHistory().record(broadcast(channel, LineBuilder() << member->getPrefix() << " JOIN :" << name));
+        if (op && theirModes) {
+            channel->addOperator(member);
+            ops.push_back(member);
+        }
+    }
+    if (!channel) return;
+
+    if (theirModes && args[2] != "+") {
+        MessageView modes;
+        modes.paramCount = args.size() - 3; // Mode string and its parameters
+        for (size_t i = 0; i < modes.paramCount; ++i) modes.params[i] = args[i + 2];
+        ModeChange change;
+        applyChannelModes(channel, modes, 0, true, change);
+        if (!change.modes.empty() && !created) {
+            broadcast(channel, LineBuilder() << ":" << source.server->name << " MODE " << name << " "
+                << change.modes << change.params);
+        }
+    }
+    for (size_t i = 0; i < ops.size(); ++i) {
+        broadcast(channel, LineBuilder() << ":" << source.server->name << " MODE " << name << " +o " << ops[i]->getNickname());
+    }
+    forward(link, args);
+}
+
+// :<UID> TMODE <channelTS> <#chan> <modes> [params]; ignored by a channel
+// that is older than the one it was meant for
+void Server::linkTmode(Client* link, const LinkSource& source, const MessageView& args) {
+    std::map<std::string, Channel*>::iterator it = _channels.find(args[1].str());
+    if (it == _channels.end()) return;
+    Channel* channel = it->second;
+    if (std::strtol(args[0].c_str(), NULL, 10) > channel->getCreatedAt()) return;
+
+    ModeChange change;
+    applyChannelModes(channel, args, 2, true, change);
+    if (change.modes.empty()) return;
+    broadcast(channel, LineBuilder() << ":" << source.user->getNickname() << " MODE " << channel->getName() << " "
+        << change.modes << change.params);
+    forward(link, args);
+}
+
+// :<SID> TB <#chan> <topicTS> :<topic>; an older topic, or one where
+// there was none, replaces ours
+void Server::linkTb(Client* link, const LinkSource& source, const MessageView& args) {
+    std::map<std::string, Channel*>::iterator it = _channels.find(args[0].str());
+    if (it == _channels.end()) return;
+    Channel* channel = it->second;
+    time_t ts = std::strtol(args[1].c_str(), NULL, 10);
+    const std::string topic = args[2].str();
+    if (!channel->getTopic().empty() && (ts >= channel->getTopicTime() || topic == channel->getTopic())) return;
+
+    channel->setTopic(topic, ts);
+    saveChannel(channel);
+    channel->getHistory().record(broadcast(channel, LineBuilder() << ":" << source.server->name << " TOPIC "
+        << channel->getName() << " :" << topic));
+    forward(link, args);
+}
+
+void Server::linkEob(Client* link, const LinkSource& source, const MessageView& args) {
+    LOG(LOG_INFO, LOG_SERVER, "End of burst from " << source.server->name);
+    forward(link, args);
+}
+
+// :<SID> SQUIT <SID> :<reason>
+void Server::linkSquit(Client* link, const LinkSource& source, const MessageView& args) {
+    (void)source;
+    std::string reason = args.size() > 1 ? args[1].str() : "";
+    if (args[0] == _config.sid) {
+        closeLink(link, reason);
+        return;
+    }
+    RemoteServer* server = findServer(args[0].str());
+    if (!server || server->link != link) return;
+    if (server == link->getPeer()) {
+        closeLink(link, reason); // The peer itself is leaving
+        return;
+    }
+    LOG(LOG_WARN, LOG_SERVER, server->name << " split from the network (" << reason << ")");
+    removeServer(server);
+    forward(link, args);
+}
+
+// :<SID|UID> KILL <UID> :<reason>
+void Server::linkKill(Client* link, const LinkSource& source, const MessageView& args) {
+    Client* target = findClientByUid(args[0].str());
+    if (!target) return;
+    std::string by = source.user ? source.user->getNickname() : source.server->name;
+    killUser(target, by + " (" + (args.size() > 1 ? args[1].str() : "") + ")", link);
+}
+
+void Server::linkError(Client* link, const LinkSource& source, const MessageView& args) {
+    (void)source;
+    std::string reason = args.empty() ? "ERROR" : args[0].str();
+    LOG(LOG_WARN, LOG_SERVER, "ERROR from " << link->getPeer()->name << ": " << reason);
+    removeClient(link->getFd(), reason);
+}
@@ -0,0 +1,234 @@
+#include "Server.hpp"
+#include "Logger.hpp"
+#include "MemoryAccount.hpp"
+#include "SlabPool.hpp"
+#include <sstream>
+#include <ctime>
+
+// Reactor counters summed over every event loop
+struct ReactorTotals {
+    unsigned long accepted;
+    unsigned long acceptFailed;
+    unsigned long throttled;
+    unsigned long throttledNow;
+    unsigned long excessFlood;
+    unsigned long recvqExceeded;
+    unsigned long sendqExceeded;
+};
+
+static ReactorTotals sumReactors(const std::vector<Reactor*>& reactors) {
+    ReactorTotals totals = ReactorTotals();
+    for (size_t i = 0; i < reactors.size(); ++i) {
+        const ReactorStats& stats = reactors[i]->getStats();
+        totals.accepted += stats.accepted.get();
+        totals.acceptFailed += stats.acceptFailed.get();
+        totals.throttled += stats.throttled.get();
+        totals.throttledNow += stats.throttledNow.get();
+        totals.excessFlood += stats.excessFlood.get();
+        totals.recvqExceeded += stats.recvqExceeded.get();
+        totals.sendqExceeded += stats.sendqExceeded.get();
+    }
+    return totals;
+}
+
+static const char* slotName(size_t slot, const char* commandName) {
+    if (slot == ServerMetrics::SLOT_UNKNOWN) return "unknown";
+    if (slot == ServerMetrics::SLOT_NONE) return "none";
+    return commandName;
+}
+
+// Quantile bounds of 0 mean "above the top bucket"
+static std::string describeLatency(const std::string& loop, const Histogram& latency) {
+    std::ostringstream line;
+    line << "loop " << loop << " iterations " << latency.count() << " p50<=" << latency.quantileBound(0.5)
+         << "us p99<=" << latency.quantileBound(0.99) << "us";
+    return line.str();
+}
+
+// Core thread, after every event it handles
+void Server::updateGauges() {
+    _metrics.clients.set(_clients.size());
+    _metrics.registered.set(_registered);
+    _metrics.unregistered.set(_clients.size() > _registered ? _clients.size() - _registered : 0);
+    _metrics.channels.set(_channels.size());
+    _metrics.links.set(_links.size());
+    _metrics.servers.set(_servers.size());
+    size_t remote = 0;
+    for (std::map<std::string, RemoteServer*>::const_iterator it = _servers.begin(); it != _servers.end(); ++it) {
+        remote += it->second->users.size();
+    }
+    _metrics.remoteUsers.set(remote);
+    _metrics.historyEvents.set(ChannelHistory::eventCount());
+    _metrics.historyBytes.set(ChannelHistory::memoryUsed());
+}
+
+// --- STATS ---
+// Lines for the "STATS z" runtime report (RPL_STATSDEBUG)
+std::vector<std::string> Server::describeRuntime() const {
+    ReactorTotals totals = sumReactors(_reactors);
+    std::vector<std::string> lines;
+    std::ostringstream line;
+
+    line << "clients " << _metrics.clients.get() << " registered " << _metrics.registered.get()
+         << " channels " << _metrics.channels.get();
+    lines.push_back(line.str());
+
+    line.str("");
+    line << "network " << _config.sid << " links " << _metrics.links.get() << " servers " << _metrics.servers.get()
+         << " remote users " << _metrics.remoteUsers.get();
+    lines.push_back(line.str());
+
+    line.str("");
+    line << "history events " << _metrics.historyEvents.get() << " bytes " << _metrics.historyBytes.get();
+    lines.push_back(line.str());
+
+    line.str("");
+    line << "buffers " << MemoryAccount::used() << " bytes, accepted " << totals.accepted
+         << " connections (" << totals.acceptFailed << " accept errors), " << Logger::instance().dropped() << " log records dropped";
+    lines.push_back(line.str());
+
+    line.str("");
+    line << "pools (blocks in use/reserved)";
+    for (size_t i = 0; i < SlabPool::poolCount(); ++i) {
+        const SlabPool* pool = SlabPool::pool(i);
+        if (pool) line << " " << pool->name() << " " << pool->blocksInUse() << "/" << pool->blocksReserved();
+    }
+    lines.push_back(line.str());
+
+    line.str("");
+    line << "disconnects quit " << _metrics.quits.get() << " closed " << _metrics.closed.get()
+         << " excess_flood " << totals.excessFlood << " recvq " << totals.recvqExceeded
+         << " sendq " << totals.sendqExceeded;
+    lines.push_back(line.str());
+
+    line.str("");
+    line << "throttled now " << totals.throttledNow << " total " << totals.throttled;
+    lines.push_back(line.str());
+
+    line.str("");
+    const Histogram& fanout = _metrics.fanout;
+    line << "broadcasts " << fanout.count() << " recipients " << fanout.sum()
+         << " p50<=" << fanout.quantileBound(0.5) << " p99<=" << fanout.quantileBound(0.99);
+    lines.push_back(line.str());
+
+    for (size_t i = 0; i < _reactors.size(); ++i) {
+        line.str("");
+        line << "reactor" << i;
+        lines.push_back(describeLatency(line.str(), _reactors[i]->getStats().loopLatency));
+    }
+    if (_threaded) {
+        lines.push_back(describeLatency("core", _metrics.coreLatency));
+    }
+    return lines;
+}
+
+// --- Prometheus ---
+static void writeHeader(std::ostringstream& out, const char* name, const char* type, const char* help) {
+    out << "# HELP ircserv_" << name << " " << help << "\n";
+    out << "# TYPE ircserv_" << name << " " << type << "\n";
+}
+
+// scale converts recorded units to the exported ones (microseconds -> seconds)
+static void writeHistogram(std::ostringstream& out, const char* name, const std::string& labels,
+                           const Histogram& histogram, double scale) {
+    std::string sep = labels.empty() ? "" : ",";
+    unsigned long cumulative = 0;
+    for (size_t i = 0; i < histogram.boundCount(); ++i) {
+        cumulative += histogram.bucket(i);
+        out << "ircserv_" << name << "_bucket{" << labels << sep << "le=\"" << histogram.bound(i) * scale
+            << "\"} " << cumulative << "\n";
+    }
+    cumulative += histogram.bucket(histogram.boundCount());
+    out << "ircserv_" << name << "_bucket{" << labels << sep << "le=\"+Inf\"} " << cumulative << "\n";
+    std::string braces = labels.empty() ? "" : "{" + labels + "}";
+    out << "ircserv_" << name << "_sum" << braces << " " << histogram.sum() * scale << "\n";
+    out << "ircserv_" << name << "_count" << braces << " " << histogram.count() << "\n";
+}
+
+static void writePerSlot(std::ostringstream& out, const char* name, const Counter* counters,
+                         const char* const* commandNames) {
+    for (size_t slot = 0; slot < ServerMetrics::SLOT_COUNT; ++slot) {
+        out << "ircserv_" << name << "{command=\"" << slotName(slot, slot < CMD_COUNT ? commandNames[slot] : "")
+            << "\"} " << counters[slot].get() << "\n";
+    }
+}
+
+std::string Server::renderMetrics() const {
+    ReactorTotals totals = sumReactors(_reactors);
+    const char* commandNames[CMD_COUNT];
+    for (size_t i = 0; i < CMD_COUNT; ++i) commandNames[i] = _commandTable[i].name;
+
+    std::ostringstream out;
+    writeHeader(out, "uptime_seconds", "gauge", "Seconds since the server started.");
+    out << "ircserv_uptime_seconds " << time(NULL) - _startTime << "\n";
+    writeHeader(out, "clients", "gauge", "Connected clients.");
+    out << "ircserv_clients " << _metrics.clients.get() << "\n";
+    writeHeader(out, "clients_registered", "gauge", "Clients that completed registration.");
+    out << "ircserv_clients_registered " << _metrics.registered.get() << "\n";
+    writeHeader(out, "clients_unregistered", "gauge", "Clients still registering.");
+    out << "ircserv_clients_unregistered " << _metrics.unregistered.get() << "\n";
+    writeHeader(out, "channels", "gauge", "Channels.");
+    out << "ircserv_channels " << _metrics.channels.get() << "\n";
+    writeHeader(out, "links", "gauge", "Direct links to other servers.");
+    out << "ircserv_links " << _metrics.links.get() << "\n";
+    writeHeader(out, "servers", "gauge", "Other servers on the network.");
+    out << "ircserv_servers " << _metrics.servers.get() << "\n";
+    writeHeader(out, "remote_users", "gauge", "Users on other servers.");
+    out << "ircserv_remote_users " << _metrics.remoteUsers.get() << "\n";
+    writeHeader(out, "history_events", "gauge", "Channel events kept for CHATHISTORY.");
+    out << "ircserv_history_events " << _metrics.historyEvents.get() << "\n";
+    writeHeader(out, "history_bytes", "gauge", "Memory held by channel history.");
+    out << "ircserv_history_bytes " << _metrics.historyBytes.get() << "\n";
+
+    writeHeader(out, "messages_received_total", "counter", "Lines received, by command.");
+    writePerSlot(out, "messages_received_total", _metrics.messagesIn, commandNames);
+    writeHeader(out, "bytes_received_total", "counter", "Bytes received, by command.");
+    writePerSlot(out, "bytes_received_total", _metrics.bytesIn, commandNames);
+    writeHeader(out, "messages_sent_total", "counter", "Lines queued to clients, by the command that caused them.");
+    writePerSlot(out, "messages_sent_total", _metrics.messagesOut, commandNames);
+    writeHeader(out, "bytes_sent_total", "counter", "Bytes queued to clients, by the command that caused them.");
+    writePerSlot(out, "bytes_sent_total", _metrics.bytesOut, commandNames);
+
+    writeHeader(out, "broadcast_recipients", "histogram", "Recipients per channel broadcast.");
+    writeHistogram(out, "broadcast_recipients", "", _metrics.fanout, 1.0);
+
+    writeHeader(out, "accepted_connections_total", "counter", "Connections accepted.");
+    out << "ircserv_accepted_connections_total " << totals.accepted << "\n";
+    writeHeader(out, "accept_errors_total", "counter", "accept() failures such as running out of file descriptors.");
+    out << "ircserv_accept_errors_total " << totals.acceptFailed << "\n";
+    writeHeader(out, "disconnects_total", "counter", "Disconnects, by reason.");
+    out << "ircserv_disconnects_total{reason=\"quit\"} " << _metrics.quits.get() << "\n";
+    out << "ircserv_disconnects_total{reason=\"closed\"} " << _metrics.closed.get() << "\n";
+    out << "ircserv_disconnects_total{reason=\"excess_flood\"} " << totals.excessFlood << "\n";
+    out << "ircserv_disconnects_total{reason=\"recvq\"} " << totals.recvqExceeded << "\n";
+    out << "ircserv_disconnects_total{reason=\"sendq\"} " << totals.sendqExceeded << "\n";
+
+    writeHeader(out, "throttled_total", "counter", "Times a client ran out of flood tokens.");
+    out << "ircserv_throttled_total " << totals.throttled << "\n";
+    writeHeader(out, "throttled_clients", "gauge", "Clients with lines held back by flood control.");
+    out << "ircserv_throttled_clients " << totals.throttledNow << "\n";
+    writeHeader(out, "buffer_bytes", "gauge", "Bytes held in connection input buffers and output queues.");
+    out << "ircserv_buffer_bytes " << MemoryAccount::used() << "\n";
+    writeHeader(out, "pool_blocks", "gauge", "Slab pool blocks, by pool and whether they are in use or free.");
+    for (size_t i = 0; i < SlabPool::poolCount(); ++i) {
+        const SlabPool* pool = SlabPool::pool(i);
+        if (!pool) continue;
+        size_t inUse = pool->blocksInUse(); // Before reserved, which only grows
+        out << "ircserv_pool_blocks{pool=\"" << pool->name() << "\",state=\"in_use\"} " << inUse << "\n";
+        out << "ircserv_pool_blocks{pool=\"" << pool->name() << "\",state=\"free\"} "
+            << pool->blocksReserved() - inUse << "\n";
+    }
+    writeHeader(out, "log_dropped_total", "counter", "Log records dropped because the log ring was full.");
+    out << "ircserv_log_dropped_total " << Logger::instance().dropped() << "\n";
+
+    writeHeader(out, "event_loop_iteration_seconds", "histogram", "Time spent handling one event-loop wakeup.");
+    for (size_t i = 0; i < _reactors.size(); ++i) {
+        std::ostringstream labels;
+        labels << "loop=\"reactor\",id=\"" << i << "\"";
+        writeHistogram(out, "event_loop_iteration_seconds", labels.str(), _reactors[i]->getStats().loopLatency, 1e-6);
+    }
+    if (_threaded) {
+        writeHistogram(out, "event_loop_iteration_seconds", "loop=\"core\"", _metrics.coreLatency, 1e-6);
+    }
+    return out.str();
+}
@@ -0,0 +1,268 @@
+#include "Server.hpp"
+#include "Logger.hpp"
+#include "AdminListener.hpp"
+#include "Upgrade.hpp"
+#include "Clock.hpp"
+#include <stdexcept>
+#include <cstring>
+#include <csignal>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// First field of the state image; bump the number when the layout changes
+static const char* const STATE_MAGIC = "ircserv-state-2";
+// How long the old process waits for the new one to take over
+static const int READY_TIMEOUT_MS = 10000;
+
+// --- Shutdown ---
+// Threaded mode, reactors joined: run what they handed over before they
+// stopped through the core, and the core's replies back through them,
+// until both sides are quiet.
+void Server::settle() {
+    if (!_threaded) return;
+    while (true) {
+        for (size_t i = 0; i < _reactors.size(); ++i) {
+            _reactors[i]->settle();
+        }
+        bool busy = false;
+        while (MpscNode* node = _inbox.pop()) {
+            InboundBatch* batch = static_cast<InboundBatch*>(node);
+            processInbound(batch);
+            delete batch;
+            busy = true;
+        }
+        postOutbound();
+        if (!busy) break;
+    }
+}
+
+// Every client gets an ERROR and up to --drain-timeout seconds for its
+// pending output to reach the socket before the connection is closed.
+void Server::drain() {
+    LOG(LOG_INFO, LOG_SERVER, "Shutting down: flushing output to " << _clients.size() << " clients");
+
+    // Channels stay in the database: they come back with the server
+    _channelStore.close();
+    // Channels go first: their destructors still talk to their members
+    for (std::map<std::string, Channel*>::iterator it = _channels.begin(); it != _channels.end(); ++it) {
+        delete it->second;
+    }
+    _channels.clear();
+    clearNetwork();
+    _nickIndex.clear();
+    _clients.clear();
+    _registered = 0;
+    updateGauges();
+
+    long deadline = monotonicMs() + _config.drainTimeout * 1000L;
+    size_t unflushed = 0;
+    for (size_t i = 0; i < _reactors.size(); ++i) {
+        unflushed += _reactors[i]->drain(deadline);
+    }
+    if (unflushed) {
+        LOG(LOG_WARN, LOG_SERVER, "Drain timed out; " << unflushed << " connections closed with output pending");
+    }
+}
+
+// --- Upgrade: Old Process ---
+// Image layout, after the magic: start time, listener count, then
+//   clients:  reactor, host, nick, user, realname, nick TS, state, authenticated,
+//             unread input, unsent output
+//   channels: name, TS, topic, topic TS, key, +i, +t, +l, then (client, operator) per member
+//   invites:  (client, channel) pairs
+// Clients are numbered in the order their sockets follow the listeners.
+// Server links are closed first, taking the remote users with them; the
+// new process links up again and gets a fresh burst.
+bool Server::handOff() {
+    closeLinks("Server upgrading");
+    settle();
+    _channelStore.close(); // The new process reopens it
+
+    StateWriter state;
+    std::vector<int> fds;
+    state.putString(STATE_MAGIC);
+    state.putNumber(_startTime);
+    state.putNumber(_reactors.size());
+    for (size_t i = 0; i < _reactors.size(); ++i) {
+        fds.push_back(_reactors[i]->getListenFd());
+    }
+
+    std::map<Client*, size_t> clientIndex;
+    state.putNumber(_clients.size());
+    for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
+        Client* client = it->second;
+        size_t index = clientIndex.size();
+        clientIndex[client] = index;
+        fds.push_back(client->getFd());
+        state.putNumber(client->getReactor()->getId());
+        state.putString(client->getHostname());
+        state.putString(client->getNickname());
+        state.putString(client->getUsername());
+        state.putString(client->getRealname());
+        state.putNumber(client->getNickTs());
+        state.putNumber(client->getRegistrationState());
+        state.putNumber(client->isAuthenticated());
+        state.putString(std::string(client->getInput().data(), client->getInput().size()));
+        std::string output;
+        client->getOutput().appendTo(output);
+        state.putString(output);
+    }
+
+    std::map<Channel*, size_t> channelIndex;
+    state.putNumber(_channels.size());
+    for (std::map<std::string, Channel*>::iterator it = _channels.begin(); it != _channels.end(); ++it) {
+        Channel* channel = it->second;
+        size_t index = channelIndex.size();
+        channelIndex[channel] = index;
+        state.putString(channel->getName());
+        state.putNumber(channel->getCreatedAt());
+        state.putString(channel->getTopic());
+        state.putNumber(channel->getTopicTime());
+        state.putString(channel->getKey());
+        state.putNumber(channel->getMode('i'));
+        state.putNumber(channel->getMode('t'));
+        state.putNumber(channel->getUserLimit());
+        const std::vector<Client*>& members = channel->getMembers();
+        state.putNumber(members.size());
+        for (size_t i = 0; i < members.size(); ++i) {
+            state.putNumber(clientIndex[members[i]]);
+            state.putNumber(channel->isOperator(members[i]));
+        }
+    }
+
+    std::vector<std::pair<size_t, size_t> > invites;
+    for (std::map<Client*, size_t>::iterator it = clientIndex.begin(); it != clientIndex.end(); ++it) {
+        const std::set<Channel*>& channels = it->first->getInvites();
+        for (std::set<Channel*>::const_iterator ch = channels.begin(); ch != channels.end(); ++ch) {
+            invites.push_back(std::make_pair(it->second, channelIndex[*ch]));
+        }
+    }
+    state.putNumber(invites.size());
+    for (size_t i = 0; i < invites.size(); ++i) {
+        state.putNumber(invites[i].first);
+        state.putNumber(invites[i].second);
+    }
+
+    // The new process binds the admin port itself
+    delete _admin;
+    _admin = NULL;
+
+    LOG(LOG_INFO, LOG_SERVER, "Upgrade: handing " << _clients.size() << " clients and " << _channels.size()
+        << " channels to " << _config.executable);
+    int sock = -1;
+    pid_t pid = -1;
+    bool ready = false;
+    try {
+        pid = Upgrade::spawn(_config.executable, _config.command, sock);
+        Upgrade::sendState(sock, fds, state.data());
+        ready = Upgrade::waitReady(sock, READY_TIMEOUT_MS);
+    } catch (const std::exception& e) {
+        LOG(LOG_ERROR, LOG_SERVER, "Upgrade: " << e.what());
+    }
+    if (sock >= 0) close(sock);
+
+    if (!ready) {
+        if (pid > 0) {
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
+        }
+        LOG(LOG_ERROR, LOG_SERVER, "Upgrade failed; still serving");
+        startAdmin();
+        openChannelStore();
+        return false;
+    }
+    LOG(LOG_INFO, LOG_SERVER, "Upgrade: pid " << pid << " has taken over");
+    return true;
+}
+
+// --- Upgrade: New Process ---
+// Returns how many of fds are listening sockets
+size_t Server::receiveUpgrade(std::vector<int>& fds, std::string& image) {
+    Upgrade::receiveState(_config.upgradeFd, fds, image);
+    StateReader state(image);
+    if (state.getString() != STATE_MAGIC) throw std::runtime_error("Upgrade state has an unknown format");
+    state.getNumber(); // Start time
+    size_t listeners = state.getNumber();
+    if (listeners > fds.size()) throw std::runtime_error("Upgrade state is missing sockets");
+    return listeners;
+}
+
+void Server::restoreState(const std::vector<int>& fds, const std::string& image) {
+    StateReader state(image);
+    state.getString();
+    _startTime = state.getNumber();
+    size_t listeners = state.getNumber();
+
+    std::vector<Client*> clients(state.getNumber());
+    if (listeners + clients.size() != fds.size()) throw std::runtime_error("Upgrade state does not match the sockets");
+    for (size_t i = 0; i < clients.size(); ++i) {
+        int fd = fds[listeners + i];
+        Reactor* reactor = _reactors[state.getNumber() % _reactors.size()];
+        Client* client = new Client(fd, state.getString(), reactor);
+        clients[i] = client;
+        client->setNickname(state.getString());
+        client->setUsername(state.getString());
+        client->setRealname(state.getString());
+        client->setNickTs(state.getNumber());
+        client->setRegistrationState(static_cast<RegistrationState>(state.getNumber()));
+        client->setAuthenticated(state.getNumber() != 0);
+
+        std::string input = state.getString();
+        if (!input.empty()) {
+            std::memcpy(client->getInput().writePtr(input.length()), input.data(), input.length());
+            client->getInput().commit(input.length());
+        }
+        std::string output = state.getString();
+        if (!output.empty()) client->getOutput().push(PayloadRef(Payload::createRaw(output)));
+
+        _clients[fd] = client;
+        if (!client->getNickname().empty()) _nickIndex.insert(client->getNickname(), client);
+        if (client->getRegistrationState() == REGISTERED) {
+            ++_registered;
+            introduceUser(client); // UIDs are per process; no links yet
+        }
+        reactor->adopt(client);
+    }
+
+    std::vector<Channel*> channels(state.getNumber());
+    for (size_t i = 0; i < channels.size(); ++i) {
+        std::string name = state.getString();
+        time_t createdAt = state.getNumber();
+        std::string topic = state.getString();
+        time_t topicTime = state.getNumber();
+        std::string key = state.getString();
+        bool inviteOnly = state.getNumber() != 0;
+        bool topicRestricted = state.getNumber() != 0;
+        int limit = static_cast<int>(state.getNumber());
+
+        size_t memberCount = state.getNumber();
+        Channel* channel = NULL;
+        for (size_t m = 0; m < memberCount; ++m) {
+            Client* member = clients.at(state.getNumber());
+            bool op = state.getNumber() != 0;
+            if (!channel) channel = new Channel(name, member); // Makes the first member an operator
+            else channel->addClient(member);
+            if (op) channel->addOperator(member);
+            else channel->removeOperator(member);
+        }
+        if (!channel) throw std::runtime_error("Upgrade state has an empty channel");
+        channel->setCreatedAt(createdAt);
+        channel->setTopic(topic, topicTime);
+        channel->setKey(key);
+        channel->setMode('i', inviteOnly);
+        channel->setMode('t', topicRestricted);
+        channel->setUserLimit(limit);
+        channels[i] = channel;
+        _channels[name] = channel;
+        _savedChannels.erase(name); // Already in the channel database
+    }
+
+    size_t inviteCount = state.getNumber();
+    for (size_t i = 0; i < inviteCount; ++i) {
+        Client* client = clients.at(state.getNumber());
+        channels.at(state.getNumber())->addInvite(client);
+    }
+    updateGauges();
+
+    LOG(LOG_INFO, LOG_SERVER, "Upgrade: took over " << clients.size() << " clients and " << channels.size() << " channels");
+}
@@ -0,0 +1,98 @@
+#include "SlabPool.hpp"
+#include <new>
+#include <sched.h>
+
+// Blocks keep the alignment operator new would give them
+static const size_t BLOCK_ALIGN = 16;
+
+const SlabPool* volatile SlabPool::_registry[SlabPool::MAX_POOLS];
+volatile size_t SlabPool::_registered = 0;
+
+SlabPool::SlabPool(const char* name, size_t blockSize, size_t slabBytes)
+    : _name(name), _free(NULL), _carve(NULL), _carveEnd(NULL), _inUse(0), _reserved(0), _locked(false) {
+    if (blockSize < sizeof(FreeBlock)) blockSize = sizeof(FreeBlock);
+    _blockSize = (blockSize + BLOCK_ALIGN - 1) & ~(BLOCK_ALIGN - 1);
+    _blocksPerSlab = slabBytes / _blockSize;
+    if (_blocksPerSlab == 0) _blocksPerSlab = 1;
+
+    // Pools beyond the registry still work, they just aren't reported
+    size_t index = __atomic_fetch_add(&_registered, 1, __ATOMIC_RELAXED);
+    if (index < MAX_POOLS) __atomic_store_n(&_registry[index], this, __ATOMIC_RELEASE);
+}
+
+SlabPool::~SlabPool() {
+    for (size_t i = 0; i < _slabs.size(); ++i) {
+        ::operator delete(_slabs[i]);
+    }
+}
+
+// --- Allocation ---
+void* SlabPool::allocate() {
+    lock();
+    void* block;
+    if (_free) {
+        block = _free;
+        _free = _free->next;
+    } else {
+        if (_carve == _carveEnd) {
+            try {
+                grow();
+            } catch (...) {
+                unlock();
+                throw;
+            }
+        }
+        block = _carve;
+        _carve += _blockSize;
+    }
+    __atomic_store_n(&_inUse, _inUse + 1, __ATOMIC_RELAXED);
+    unlock();
+    return block;
+}
+
+void SlabPool::deallocate(void* block) {
+    if (!block) return;
+    lock();
+    FreeBlock* freed = static_cast<FreeBlock*>(block);
+    freed->next = _free;
+    _free = freed;
+    __atomic_store_n(&_inUse, _inUse - 1, __ATOMIC_RELAXED);
+    unlock();
+}
+
+// Called with the lock held once every block has been used. Blocks are
+// carved from the new slab on demand, so untouched pages stay out of RSS.
+void SlabPool::grow() {
+    _slabs.reserve(_slabs.size() + 1);
+    char* slab = static_cast<char*>(::operator new(_blockSize * _blocksPerSlab));
+    _slabs.push_back(slab);
+    _carve = slab;
+    _carveEnd = slab + _blockSize * _blocksPerSlab;
+    __atomic_store_n(&_reserved, _reserved + _blocksPerSlab, __ATOMIC_RELAXED);
+}
+
+// Held for a handful of instructions; a contender just yields and retries
+void SlabPool::lock() {
+    while (__atomic_test_and_set(&_locked, __ATOMIC_ACQUIRE)) {
+        sched_yield();
+    }
+}
+
+void SlabPool::unlock() {
+    __atomic_clear(&_locked, __ATOMIC_RELEASE);
+}
+
+// --- Introspection ---
+const char* SlabPool::name() const { return _name; }
+size_t SlabPool::blockSize() const { return _blockSize; }
+size_t SlabPool::blocksInUse() const { return __atomic_load_n(&_inUse, __ATOMIC_RELAXED); }
+size_t SlabPool::blocksReserved() const { return __atomic_load_n(&_reserved, __ATOMIC_RELAXED); }
+
+size_t SlabPool::poolCount() {
+    size_t count = __atomic_load_n(&_registered, __ATOMIC_RELAXED);
+    return count < MAX_POOLS ? count : MAX_POOLS;
+}
+
+const SlabPool* SlabPool::pool(size_t index) {
+    return __atomic_load_n(&_registry[index], __ATOMIC_ACQUIRE);
+}
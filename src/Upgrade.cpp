@@ -0,0 +1,222 @@
+#include "Upgrade.hpp"
+#include <stdexcept>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+
+// SCM_MAX_FD is 253 on Linux
+static const size_t FDS_PER_MESSAGE = 250;
+static const size_t DATA_PER_MESSAGE = 32 * 1024;
+// Neither side waits longer than this for the other to read or write
+static const int IO_TIMEOUT_SEC = 10;
+// The handoff socket's number in the new process
+static const int CHILD_FD = 3;
+
+enum MessageType {
+    MSG_FDS = 'F',  // Sockets in the ancillary data, no payload
+    MSG_DATA = 'D', // A piece of the state image
+    MSG_END = 'E',
+    MSG_READY = 'K' // New process -> old: serving now
+};
+
+// --- StateWriter ---
+void StateWriter::putNumber(unsigned long value) {
+    for (int i = 0; i < 8; ++i) {
+        _data += static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+}
+
+void StateWriter::putString(const std::string& value) {
+    putNumber(value.length());
+    _data += value;
+}
+
+const std::string& StateWriter::data() const { return _data; }
+
+// --- StateReader ---
+StateReader::StateReader(const std::string& data) : _data(data.data()), _length(data.length()), _pos(0) {}
+
+StateReader::StateReader(const char* data, size_t length) : _data(data), _length(length), _pos(0) {}
+
+void StateReader::need(size_t bytes) const {
+    if (_length - _pos < bytes) throw std::runtime_error("State image is truncated");
+}
+
+unsigned long StateReader::getNumber() {
+    need(8);
+    unsigned long value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value |= static_cast<unsigned long>(static_cast<unsigned char>(_data[_pos + i])) << (8 * i);
+    }
+    _pos += 8;
+    return value;
+}
+
+std::string StateReader::getString() {
+    unsigned long length = getNumber();
+    need(length);
+    std::string value(_data + _pos, length);
+    _pos += length;
+    return value;
+}
+
+bool StateReader::atEnd() const { return _pos == _length; }
+
+// --- Process Handoff ---
+static void setTimeouts(int sock) {
+    struct timeval timeout;
+    timeout.tv_sec = IO_TIMEOUT_SEC;
+    timeout.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+// Only async-signal-safe calls between fork() and exec()
+static void closeInheritedFds() {
+#ifdef SYS_close_range
+    if (syscall(SYS_close_range, CHILD_FD + 1, ~0U, 0) == 0) return;
+#endif
+    long maxFd = sysconf(_SC_OPEN_MAX);
+    for (long fd = CHILD_FD + 1; fd < maxFd; ++fd) {
+        close(static_cast<int>(fd));
+    }
+}
+
+pid_t Upgrade::spawn(const std::string& path, const std::vector<std::string>& command, int& sock) {
+    if (command.empty()) throw std::runtime_error("No command to upgrade to");
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair) < 0)
+        throw std::runtime_error("Failed to create the upgrade socket");
+
+    // Built before fork(): the child may not allocate
+    std::vector<std::string> args(command);
+    std::ostringstream fdOption;
+    fdOption << "--upgrade-fd=" << CHILD_FD;
+    args.push_back(fdOption.str());
+    std::vector<char*> argv;
+    for (size_t i = 0; i < args.size(); ++i) {
+        argv.push_back(const_cast<char*>(args[i].c_str()));
+    }
+    argv.push_back(NULL);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(pair[0]);
+        close(pair[1]);
+        throw std::runtime_error("Failed to fork the new server");
+    }
+    if (pid == 0) {
+        // Only the handoff socket and stdio survive: a stray copy of a
+        // client socket would keep that connection open after the new
+        // process closes it.
+        if (pair[1] == CHILD_FD) fcntl(CHILD_FD, F_SETFD, 0);
+        else if (dup2(pair[1], CHILD_FD) < 0) _exit(127);
+        closeInheritedFds();
+        execv(path.c_str(), &argv[0]);
+        _exit(127);
+    }
+
+    close(pair[1]);
+    sock = pair[0];
+    setTimeouts(sock);
+    return pid;
+}
+
+static void sendMessage(int sock, char type, const char* data, size_t length, const int* fds, size_t fdCount) {
+    struct iovec iov[2];
+    iov[0].iov_base = &type;
+    iov[0].iov_len = 1;
+    iov[1].iov_base = const_cast<char*>(data);
+    iov[1].iov_len = length;
+
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = length ? 2 : 1;
+
+    std::vector<char> control;
+    if (fdCount) {
+        control.resize(CMSG_SPACE(fdCount * sizeof(int)));
+        msg.msg_control = &control[0];
+        msg.msg_controllen = control.size();
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(fdCount * sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), fds, fdCount * sizeof(int));
+    }
+
+    while (sendmsg(sock, &msg, MSG_NOSIGNAL) < 0) {
+        if (errno != EINTR) throw std::runtime_error(std::string("Upgrade handoff failed: ") + std::strerror(errno));
+    }
+}
+
+void Upgrade::sendState(int sock, const std::vector<int>& fds, const std::string& image) {
+    for (size_t i = 0; i < fds.size(); i += FDS_PER_MESSAGE) {
+        size_t count = fds.size() - i < FDS_PER_MESSAGE ? fds.size() - i : FDS_PER_MESSAGE;
+        sendMessage(sock, MSG_FDS, NULL, 0, &fds[i], count);
+    }
+    for (size_t i = 0; i < image.length(); i += DATA_PER_MESSAGE) {
+        size_t length = image.length() - i < DATA_PER_MESSAGE ? image.length() - i : DATA_PER_MESSAGE;
+        sendMessage(sock, MSG_DATA, image.data() + i, length, NULL, 0);
+    }
+    sendMessage(sock, MSG_END, NULL, 0, NULL, 0);
+}
+
+void Upgrade::receiveState(int sock, std::vector<int>& fds, std::string& image) {
+    setTimeouts(sock);
+    std::vector<char> buffer(1 + DATA_PER_MESSAGE);
+    std::vector<char> control(CMSG_SPACE(FDS_PER_MESSAGE * sizeof(int)));
+    while (true) {
+        struct iovec iov;
+        iov.iov_base = &buffer[0];
+        iov.iov_len = buffer.size();
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = &control[0];
+        msg.msg_controllen = control.size();
+
+        ssize_t received = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) throw std::runtime_error("Upgrade handoff ended early");
+        if (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) throw std::runtime_error("Upgrade handoff message truncated");
+
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int* received_fds = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+            fds.insert(fds.end(), received_fds, received_fds + count);
+        }
+
+        switch (buffer[0]) {
+            case MSG_FDS: break;
+            case MSG_DATA: image.append(&buffer[1], received - 1); break;
+            case MSG_END: return;
+            default: throw std::runtime_error("Unexpected upgrade handoff message");
+        }
+    }
+}
+
+void Upgrade::signalReady(int sock) {
+    sendMessage(sock, MSG_READY, NULL, 0, NULL, 0);
+}
+
+bool Upgrade::waitReady(int sock, int timeoutMs) {
+    struct pollfd pfd;
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int ready;
+    while ((ready = poll(&pfd, 1, timeoutMs)) < 0 && errno == EINTR) {}
+    if (ready <= 0) return false;
+    char reply = 0;
+    return recv(sock, &reply, 1, 0) == 1 && reply == MSG_READY;
+}
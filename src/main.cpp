@@ -1,32 +1,46 @@
 #include "Server.hpp"
+#include "Logger.hpp"
 #include <iostream>
 #include <cstdlib>
 #include <csignal>
 
+static Server* runningServer = NULL;
+
+// SIGTERM and SIGINT drain the connections and exit; SIGUSR2 hands them to
+// a fresh copy of the binary. Either way run() returns once it is done.
 void signalHandler(int signum) {
-    (void)signum;
-    // In a real server, you would set a global flag to true
-    // and the main loop would check this flag to shutdown gracefully.
-    std::cout << "\nInterrupt signal received. Shutting down server." << std::endl;
-    // For now, we just exit.
-    exit(0);
+    if (runningServer) {
+        runningServer->requestStop(signum == SIGUSR2 ? Server::STOP_UPGRADE : Server::STOP_DRAIN);
+    }
 }
 
 int main(int argc, char **argv) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <port> <password>" << std::endl;
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <port> <password> [--option=value ...]" << std::endl;
         return 1;
     }
 
-    signal(SIGINT, signalHandler);
-    signal(SIGTERM, signalHandler);
+    signal(SIGPIPE, SIG_IGN); // A dead peer must not kill the server mid-writev
 
     try {
         long port = std::strtol(argv[1], NULL, 10);
         // Add more robust port validation here (e.g., check range 1024-65535)
         
-        Server server(static_cast<int>(port), argv[2]);
+        ServerConfig config;
+        config.parse(argc, argv, 3);
+        Logger::instance().configure(config.logFile, config.logLevel, config.logCategories);
+        Logger::instance().start();
+
+        Server server(static_cast<int>(port), argv[2], config);
+        runningServer = &server;
+        signal(SIGINT, signalHandler);
+        signal(SIGTERM, signalHandler);
+        signal(SIGUSR2, signalHandler);
         server.run();
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGUSR2, SIG_DFL);
+        runningServer = NULL;
     } catch (const std::exception &e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;